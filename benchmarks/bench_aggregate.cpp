@@ -0,0 +1,83 @@
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Average over a time range computed from retrieve() versus aggregate(),
+// which pushes the work into SQL and chunk pre-aggregates.
+// Usage: bench_aggregate [rows]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    template <typename Query>
+    void report(const std::string &label, Query query)
+    {
+        const int repetitions = 5;
+        double result = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < repetitions; ++i)
+            result = query();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << std::left << std::setw(24) << label << std::right
+                  << " avg: " << std::setw(14) << std::fixed << std::setprecision(4) << result
+                  << "  time: " << std::setw(10) << std::setprecision(3)
+                  << std::chrono::duration<double, std::milli>(end - start).count() / repetitions << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : 5000000;
+    const std::string path = "bench_aggregate.db";
+    for (const auto &file : {path, path + "-wal", path + "-shm"})
+        std::filesystem::remove(file);
+
+    SQLiteDiskStorage storage(path);
+    std::cout << "Writing " << rows << " rows" << std::endl;
+    for (size_t done = 0; done < rows; done += 10000)
+    {
+        std::vector<std::unique_ptr<HistoryEntry>> batch;
+        for (size_t i = done; i < std::min(rows, done + 10000); ++i)
+        {
+            std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+            if (i % 2 == 0)
+                batch.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, 500.0 + (i % 1000) * 0.125));
+            else
+                batch.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i % 1000)));
+        }
+        storage.flush(batch);
+    }
+
+    struct Range
+    {
+        std::string name;
+        std::time_t start;
+        std::time_t end;
+    };
+    const std::time_t last = BASE_TIMESTAMP + static_cast<std::time_t>(rows) - 1;
+    std::vector<Range> ranges = {{"full history", BASE_TIMESTAMP, last},
+                                 {"last day", std::max(BASE_TIMESTAMP, last - 86399), last},
+                                 {"last hour", std::max(BASE_TIMESTAMP, last - 3599), last}};
+
+    for (const auto &range : ranges)
+    {
+        report(range.name + ", retrieve", [&]
+               {
+            Aggregate result;
+            for (const auto &entry : storage.retrieve(range.start, range.end))
+                result.add(*entry);
+            return result.value(AggregateOp::Avg); });
+
+        report(range.name + ", aggregate", [&]
+               { return storage.aggregate(range.start, range.end).value(AggregateOp::Avg); });
+    }
+
+    return 0;
+}
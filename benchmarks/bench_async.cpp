@@ -0,0 +1,98 @@
+#include "sqlite_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+
+// Flush throughput when each batch waits for its commit (flush()) versus
+// keeping several batches in flight (flushAsync()), which lets the writer
+// thread commit queued batches together. Also times independent range
+// queries run one after another versus issued together with retrieveAsync().
+// Usage: bench_async [batches] [batch size] [batches in flight]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    void report(const std::string &label, size_t entries, double seconds, size_t transactions)
+    {
+        std::cout << std::left << std::setw(26) << label << std::right << std::fixed
+                  << " time: " << std::setw(7) << std::setprecision(3) << seconds << " s"
+                  << "  entries/second: " << std::setw(9) << std::setprecision(0) << entries / seconds
+                  << "  transactions: " << transactions << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t batches = argc > 1 ? std::stoull(argv[1]) : 5000;
+    size_t batchSize = argc > 2 ? std::stoull(argv[2]) : 100;
+    size_t inFlight = argc > 3 ? std::stoull(argv[3]) : 32;
+    const std::string path = "bench_async.db";
+
+    for (bool pipelined : {false, true})
+    {
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+        SQLiteDiskStorage storage(path);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::deque<std::future<void>> pending;
+        for (size_t i = 0; i < batches; ++i)
+        {
+            auto batch = makeBatch(BASE_TIMESTAMP + static_cast<std::time_t>(i * batchSize), batchSize, BatchMix::DoubleInt);
+            if (!pipelined)
+            {
+                storage.flush(batch);
+                continue;
+            }
+            pending.push_back(storage.flushAsync(std::move(batch)));
+            if (pending.size() >= inFlight)
+            {
+                pending.front().get();
+                pending.pop_front();
+            }
+        }
+        for (auto &done : pending)
+            done.get();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        report(pipelined ? "flushAsync, " + std::to_string(inFlight) + " in flight" : "flush",
+               batches * batchSize, std::chrono::duration<double>(end - start).count(), storage.getWriteTransactionCount());
+
+        if (!pipelined)
+            continue;
+
+        // Eight day-long ranges across the history
+        const size_t queries = 8;
+        const std::time_t span = static_cast<std::time_t>(batches * batchSize / queries);
+        for (bool async : {false, true})
+        {
+            size_t returned = 0;
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<std::future<std::vector<std::unique_ptr<HistoryEntry>>>> results;
+            for (size_t q = 0; q < queries; ++q)
+            {
+                std::time_t first = BASE_TIMESTAMP + static_cast<std::time_t>(q) * span;
+                std::time_t last = first + std::min<std::time_t>(span, 86400) - 1;
+                if (async)
+                    results.push_back(storage.retrieveAsync(first, last));
+                else
+                    returned += storage.retrieve(first, last).size();
+            }
+            for (auto &result : results)
+                returned += result.get().size();
+            end = std::chrono::high_resolution_clock::now();
+
+            std::cout << std::left << std::setw(26) << (async ? "8 x retrieveAsync" : "8 x retrieve") << std::right
+                      << " time: " << std::setw(7) << std::setprecision(3)
+                      << std::chrono::duration<double>(end - start).count() << " s  entries: " << returned << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "block_codec.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <map>
+#include <cmath>
+
+// Compression ratio and encode/decode throughput of the BlockCodec versions
+// on chunk-sized column blocks.
+// Usage: bench_block_codec [entries]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const size_t BLOCK_SIZE = 1000; // SQLiteDiskStorage::DEFAULT_CHUNK_SIZE
+
+    // Sensor-like data: regular sampling, slowly drifting values
+    std::vector<std::unique_ptr<HistoryEntry>> generateSensorData(size_t count)
+    {
+        std::vector<std::unique_ptr<HistoryEntry>> entries;
+        std::mt19937 gen(42);
+        std::normal_distribution<> step(0, 0.05);
+        std::uniform_int_distribution<> change(0, 99);
+        double temperature = 21.5;
+        int counter = 0;
+        bool state = false;
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i / 4) * 10;
+            switch (i % 4)
+            {
+            case 0:
+                temperature += step(gen);
+                entries.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, std::round(temperature * 100) / 100));
+                break;
+            case 1:
+                counter += change(gen) < 10 ? 1 : 0;
+                entries.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, counter));
+                break;
+            case 2:
+                state = change(gen) < 2 ? !state : state;
+                entries.push_back(std::make_unique<TypedHistoryEntry<bool>>(ts, state));
+                break;
+            case 3:
+                entries.push_back(std::make_unique<TypedHistoryEntry<std::string>>(ts, state ? "running" : "idle"));
+                break;
+            }
+        }
+        return entries;
+    }
+
+    // Splits entries by type into blocks of BLOCK_SIZE, as chunk sealing does
+    std::vector<ColumnBlock> makeBlocks(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+    {
+        std::map<EntryType, ColumnBlock> open;
+        std::vector<ColumnBlock> blocks;
+        for (const auto &entry : entries)
+        {
+            EntryType type = getEntryType(entry.get());
+            auto it = open.try_emplace(type, type).first;
+            it->second.append(entry.get());
+            if (it->second.size() == BLOCK_SIZE)
+            {
+                blocks.push_back(std::move(it->second));
+                it->second = ColumnBlock(type);
+            }
+        }
+        for (auto &[type, block] : open)
+        {
+            if (!block.empty())
+                blocks.push_back(std::move(block));
+        }
+        return blocks;
+    }
+
+    size_t rawBytes(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+    {
+        size_t bytes = 0;
+        for (const auto &entry : entries)
+            bytes += entry->getSize(); // Timestamp plus raw value
+        return bytes;
+    }
+
+    void report(const std::string &mix, const std::vector<std::unique_ptr<HistoryEntry>> &entries, uint8_t version)
+    {
+        auto blocks = makeBlocks(entries);
+        const int repetitions = 5;
+
+        std::vector<std::vector<uint8_t>> payloads(blocks.size());
+        auto startEncode = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repetitions; ++r)
+        {
+            for (size_t i = 0; i < blocks.size(); ++i)
+            {
+                payloads[i].clear();
+                BlockCodec::encode(blocks[i], payloads[i], version);
+            }
+        }
+        auto endEncode = std::chrono::high_resolution_clock::now();
+
+        size_t decoded = 0;
+        auto startDecode = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repetitions; ++r)
+        {
+            for (const auto &payload : payloads)
+                decoded += BlockCodec::decode(payload.data(), payload.size()).size();
+        }
+        auto endDecode = std::chrono::high_resolution_clock::now();
+
+        size_t encodedBytes = 0;
+        for (const auto &payload : payloads)
+            encodedBytes += payload.size();
+        double samples = static_cast<double>(entries.size()) * repetitions;
+
+        std::cout << std::left << std::setw(8) << mix << " v" << int(version) << std::right
+                  << "  bytes/sample: " << std::setw(6) << std::fixed << std::setprecision(2)
+                  << static_cast<double>(encodedBytes) / entries.size()
+                  << "  ratio: " << std::setw(6) << static_cast<double>(rawBytes(entries)) / encodedBytes
+                  << "  encode: " << std::setw(7) << std::setprecision(1)
+                  << samples / std::chrono::duration<double>(endEncode - startEncode).count() / 1e6 << " M/s"
+                  << "  decode: " << std::setw(7)
+                  << decoded / std::chrono::duration<double>(endDecode - startDecode).count() / 1e6 << " M/s" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    std::cout << "Ratios are against 8-byte timestamps plus raw values" << std::endl;
+
+    auto mixed = generateTestData(entries, BASE_TIMESTAMP, 42);
+    auto sensor = generateSensorData(entries);
+    for (uint8_t version = 1; version <= BlockCodec::CURRENT_VERSION; ++version)
+    {
+        report("mixed", mixed, version);
+        report("sensor", sensor, version);
+    }
+    return 0;
+}
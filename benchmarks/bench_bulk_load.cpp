@@ -0,0 +1,84 @@
+#include "history_storage.hpp"
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+
+// Backfill throughput through ConcreteHistoryStorage::store() versus
+// SQLiteDiskStorage::beginBulkLoad(). store() logs every 100 entries, so
+// std::cout is muted while either path runs.
+// Usage: bench_bulk_load [entries] [partition span]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1600000000;
+
+    void removeDatabase(const std::string &path)
+    {
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+    }
+
+    template <typename Load>
+    void report(const std::string &label, size_t entries, Load load)
+    {
+        auto *output = std::cout.rdbuf(nullptr);
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t stored = load();
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout.rdbuf(output);
+        std::cout.clear();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << std::left << std::setw(10) << label << std::right << std::fixed
+                  << " entries: " << std::setw(9) << entries
+                  << "  stored: " << std::setw(9) << stored
+                  << "  time: " << std::setw(8) << std::setprecision(2) << seconds << " s"
+                  << "  entries/second: " << std::setw(10) << std::setprecision(0) << entries / seconds << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    std::time_t partitionSpan = argc > 2 ? std::stoll(argv[2]) : 0;
+    const std::string path = "bench_bulk_load.db";
+
+    removeDatabase(path);
+    report("store()", entries, [&]
+           {
+        SQLiteDiskStorage disk(path, partitionSpan);
+        ConcreteHistoryStorage storage(100000, &disk, std::chrono::seconds(3600), 0.8, 0.5);
+        for (size_t i = 0; i < entries; ++i)
+        {
+            std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+            if (i % 2 == 0)
+                storage.store(std::make_unique<TypedHistoryEntry<double>>(ts, i * 0.25));
+            else
+                storage.store(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i)));
+        }
+        storage.flush();
+        return disk.getEntryCount() + storage.getInRamCount(); });
+
+    removeDatabase(path);
+    report("bulk load", entries, [&]
+           {
+        SQLiteDiskStorage disk(path, partitionSpan);
+        auto loader = disk.beginBulkLoad();
+        for (size_t i = 0; i < entries; ++i)
+        {
+            std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+            if (i % 2 == 0)
+                loader->append(ts, i * 0.25);
+            else
+                loader->append(ts, static_cast<int>(i));
+        }
+        loader->commit();
+        return disk.getEntryCount(); });
+
+    removeDatabase(path);
+    return 0;
+}
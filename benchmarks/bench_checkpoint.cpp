@@ -0,0 +1,92 @@
+#include "sqlite_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Flush latency and WAL size with SQLite's autocheckpoint (inside flush) versus
+// the background checkpointer, with and without a reader that keeps holding
+// snapshots. Usage: bench_checkpoint [flushes] [flush batch size]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    // Repeatedly opens a read transaction and holds it, pinning WAL frames
+    void holdSnapshots(const std::string &path, std::atomic<bool> &stop)
+    {
+        sqlite3 *db;
+        sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr);
+        while (!stop)
+        {
+            sqlite3_exec(db, "BEGIN; SELECT count(*) FROM history_meta;", nullptr, nullptr, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        sqlite3_close(db);
+    }
+
+    void runConfiguration(const std::string &label, bool background, bool pinningReader, size_t flushes, size_t batchSize)
+    {
+        const std::string path = "bench_checkpoint.db";
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+
+        SQLiteDiskStorage storage(path);
+        storage.setBackgroundCheckpointing(background);
+        storage.setWalSizeLimit(16 * 1024 * 1024);
+
+        std::atomic<bool> stop{false};
+        std::thread reader;
+        if (pinningReader)
+            reader = std::thread(holdSnapshots, path, std::ref(stop));
+
+        std::vector<double> latencies;
+        size_t maxWalSize = 0;
+        for (size_t i = 0; i < flushes; ++i)
+        {
+            auto batch = makeBatch(BASE_TIMESTAMP + static_cast<std::time_t>(i * batchSize), batchSize, BatchMix::DoubleString);
+            auto start = std::chrono::high_resolution_clock::now();
+            storage.flush(batch);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            maxWalSize = std::max(maxWalSize, storage.getWalSize());
+        }
+
+        stop = true;
+        if (reader.joinable())
+            reader.join();
+
+        std::sort(latencies.begin(), latencies.end());
+        auto stats = storage.getCheckpointStats();
+        std::cout << std::left << std::setw(28) << label << std::right << std::fixed << std::setprecision(2)
+                  << " flush p50: " << std::setw(7) << latencies[latencies.size() / 2] << " ms"
+                  << "  p99: " << std::setw(7) << latencies[latencies.size() * 99 / 100] << " ms"
+                  << "  max: " << std::setw(7) << latencies.back() << " ms"
+                  << "  max WAL: " << std::setw(7) << maxWalSize / (1024.0 * 1024.0) << " MiB"
+                  << "  checkpoints (passive/restart/truncate/busy): "
+                  << stats.passiveCount << "/" << stats.restartCount << "/" << stats.truncateCount << "/" << stats.busyCount
+                  << "  max checkpoint: " << stats.maxDuration.count() / 1000.0 << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t flushes = argc > 1 ? std::stoull(argv[1]) : 2000;
+    size_t batchSize = argc > 2 ? std::stoull(argv[2]) : 2000;
+
+    std::cout << flushes << " flushes of " << batchSize << " entries" << std::endl;
+    runConfiguration("autocheckpoint", false, false, flushes, batchSize);
+    runConfiguration("background", true, false, flushes, batchSize);
+    runConfiguration("autocheckpoint + reader", false, true, flushes, batchSize);
+    runConfiguration("background + reader", true, true, flushes, batchSize);
+
+    return 0;
+}
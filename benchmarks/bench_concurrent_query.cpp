@@ -0,0 +1,123 @@
+#include "sqlite_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Range query throughput while a writer flushes continuously. "serialized"
+// puts flush and retrieve behind one mutex, as with a single shared
+// connection; "pooled" lets retrieve run on the reader pool.
+// Usage: bench_concurrent_query [seconds per run] [max query threads]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const std::time_t QUERY_WIDTH = 60;
+    const size_t FLUSH_BATCH = 2000;
+    const size_t PRELOAD_ROWS = 1000000;
+
+    void runConfiguration(const std::string &label, bool serialized, size_t queryThreads, double seconds)
+    {
+        const std::string path = "bench_concurrent_query.db";
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+
+        SQLiteDiskStorage storage(path);
+        storage.setReaderPoolSize(queryThreads);
+        std::time_t written = 0;
+        for (; written < static_cast<std::time_t>(PRELOAD_ROWS); written += FLUSH_BATCH)
+        {
+            storage.flush(makeBatch(BASE_TIMESTAMP + written, FLUSH_BATCH, BatchMix::DoubleInt));
+        }
+
+        std::mutex connectionMutex;
+        std::atomic<bool> stop{false};
+        std::atomic<size_t> queries{0};
+        std::atomic<size_t> flushedRows{0};
+        std::vector<double> latencies;
+        std::mutex latencyMutex;
+
+        std::thread writer([&]
+                           {
+            while (!stop)
+            {
+                auto batch = makeBatch(BASE_TIMESTAMP + written, FLUSH_BATCH, BatchMix::DoubleInt);
+                if (serialized)
+                {
+                    std::lock_guard<std::mutex> lock(connectionMutex);
+                    storage.flush(batch);
+                }
+                else
+                {
+                    storage.flush(batch);
+                }
+                written += FLUSH_BATCH;
+                flushedRows += FLUSH_BATCH;
+            } });
+
+        std::vector<std::thread> readers;
+        for (size_t t = 0; t < queryThreads; ++t)
+        {
+            readers.emplace_back([&, t]
+                                 {
+                std::mt19937_64 gen(t + 1);
+                std::uniform_int_distribution<std::time_t> offset(0, PRELOAD_ROWS - QUERY_WIDTH);
+                std::vector<double> local;
+                while (!stop)
+                {
+                    std::time_t start = BASE_TIMESTAMP + offset(gen);
+                    auto begin = std::chrono::high_resolution_clock::now();
+                    if (serialized)
+                    {
+                        std::lock_guard<std::mutex> lock(connectionMutex);
+                        storage.retrieve(start, start + QUERY_WIDTH - 1);
+                    }
+                    else
+                    {
+                        storage.retrieve(start, start + QUERY_WIDTH - 1);
+                    }
+                    auto end = std::chrono::high_resolution_clock::now();
+                    local.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+                    queries++;
+                }
+                std::lock_guard<std::mutex> lock(latencyMutex);
+                latencies.insert(latencies.end(), local.begin(), local.end()); });
+        }
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        writer.join();
+        for (auto &reader : readers)
+            reader.join();
+        std::sort(latencies.begin(), latencies.end());
+
+        std::cout << std::left << std::setw(11) << label << std::right
+                  << " query threads: " << std::setw(2) << queryThreads
+                  << "  queries/second: " << std::setw(10) << std::fixed << std::setprecision(0) << queries / seconds
+                  << "  p50: " << std::setw(8) << latencies[latencies.size() / 2] << " us"
+                  << "  p99: " << std::setw(8) << latencies[latencies.size() * 99 / 100] << " us"
+                  << "  ingest rows/second: " << std::setw(10) << flushedRows / seconds << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? std::stod(argv[1]) : 5.0;
+    size_t maxThreads = argc > 2 ? std::stoull(argv[2]) : 4;
+
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        runConfiguration("serialized", true, threads, seconds);
+        runConfiguration("pooled", false, threads, seconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Full-history scan through retrieve() versus openCursor(): throughput, peak
+// resident memory and time to the first batch. Peak RSS is read from
+// /proc/self/status after resetting it through /proc/self/clear_refs (Linux).
+// Usage: bench_cursor [rows] [batch size]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    void resetPeakMemory()
+    {
+        std::ofstream("/proc/self/clear_refs") << "5";
+    }
+
+    size_t peakMemoryKiB()
+    {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("VmHWM:", 0) == 0)
+                return std::stoull(line.substr(6));
+        }
+        return 0;
+    }
+
+    void fill(SQLiteDiskStorage &storage, size_t rows)
+    {
+        for (size_t done = 0; done < rows; done += 10000)
+        {
+            std::vector<std::unique_ptr<HistoryEntry>> batch;
+            for (size_t i = done; i < std::min(rows, done + 10000); ++i)
+            {
+                std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+                if (i % 2 == 0)
+                    batch.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, 500.0 + (i % 1000) * 0.125));
+                else
+                    batch.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i % 1000)));
+            }
+            storage.flush(batch);
+        }
+    }
+
+    template <typename Scan>
+    void report(const std::string &label, Scan scan)
+    {
+        resetPeakMemory();
+        size_t baseline = peakMemoryKiB();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t returned = scan();
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        std::cout << std::left << std::setw(16) << label << std::right
+                  << " entries: " << std::setw(10) << returned
+                  << "  time: " << std::setw(9) << std::fixed << std::setprecision(3) << seconds << " s"
+                  << "  entries/second: " << std::setw(12) << std::setprecision(0) << returned / seconds
+                  << "  peak RSS growth: " << std::setw(8) << (std::max(peakMemoryKiB(), baseline) - baseline) / 1024.0 << " MiB" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : 5000000;
+    size_t batchSize = argc > 2 ? std::stoull(argv[2]) : 1000;
+    const std::string path = "bench_cursor.db";
+    for (const auto &file : {path, path + "-wal", path + "-shm"})
+        std::filesystem::remove(file);
+
+    SQLiteDiskStorage storage(path);
+    std::cout << "Writing " << rows << " rows" << std::endl;
+    fill(storage, rows);
+
+    const std::time_t last = BASE_TIMESTAMP + static_cast<std::time_t>(rows);
+
+    report("cursor", [&]
+           {
+        auto cursor = storage.openCursor(BASE_TIMESTAMP, last);
+        std::vector<std::unique_ptr<HistoryEntry>> batch;
+        size_t count = 0;
+        while (cursor->nextBatch(batch, batchSize))
+        {
+            count += batch.size();
+            batch.clear();
+        }
+        return count; });
+
+    report("retrieve", [&]
+           { return storage.retrieve(BASE_TIMESTAMP, last).size(); });
+
+    report("cursor, 1 batch", [&]
+           {
+        auto cursor = storage.openCursor(BASE_TIMESTAMP, last);
+        std::vector<std::unique_ptr<HistoryEntry>> batch;
+        cursor->nextBatch(batch, batchSize);
+        return batch.size(); });
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "history_entry.hpp"
+#include <vector>
+#include <memory>
+#include <random>
+#include <string>
+#include <ctime>
+
+// Entry generators shared by the benchmarks. Timestamps start at `first`
+// and advance by one second per entry.
+
+enum class BatchMix
+{
+    DoubleInt,    // Doubles alternating with ints
+    DoubleString, // Doubles alternating with 40-character strings
+    AllTypes      // Double, int, bool and 50-character string in turn
+};
+
+// Values follow the entry index, so every run writes the same data
+inline std::vector<std::unique_ptr<HistoryEntry>> makeBatch(std::time_t first, size_t count, BatchMix mix)
+{
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::time_t ts = first + static_cast<std::time_t>(i);
+        if (mix == BatchMix::AllTypes)
+        {
+            switch (i % 4)
+            {
+            case 0:
+                entries.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, i * 0.25));
+                break;
+            case 1:
+                entries.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i % 1000)));
+                break;
+            case 2:
+                entries.push_back(std::make_unique<TypedHistoryEntry<bool>>(ts, i % 2 == 0));
+                break;
+            case 3:
+                entries.push_back(std::make_unique<TypedHistoryEntry<std::string>>(ts, std::string(50, 'a' + (i % 26))));
+                break;
+            }
+        }
+        else if (i % 2 == 0)
+            entries.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, i * 0.25));
+        else if (mix == BatchMix::DoubleInt)
+            entries.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i % 1000)));
+        else
+            entries.push_back(std::make_unique<TypedHistoryEntry<std::string>>(ts, std::string(40, 'a' + (i % 26))));
+    }
+    return entries;
+}
+
+// Random doubles in [0, 1000)
+inline std::vector<std::unique_ptr<HistoryEntry>> makeRandomBatch(std::time_t first, size_t count, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<> value(0, 1000);
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        entries.push_back(std::make_unique<TypedHistoryEntry<double>>(first + static_cast<std::time_t>(i), value(gen)));
+    }
+    return entries;
+}
+
+// Double, int, bool and 50-character string in turn, with random values
+inline std::vector<std::unique_ptr<HistoryEntry>> generateTestData(size_t count, std::time_t first, unsigned seed)
+{
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    entries.reserve(count);
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<> dis_double(0, 1000);
+    std::uniform_int_distribution<> dis_int(0, 1000);
+    std::uniform_int_distribution<> dis_bool(0, 1);
+    for (size_t i = 0; i < count; ++i)
+    {
+        std::time_t ts = first + static_cast<std::time_t>(i);
+        switch (i % 4)
+        {
+        case 0:
+            entries.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, dis_double(gen)));
+            break;
+        case 1:
+            entries.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, dis_int(gen)));
+            break;
+        case 2:
+            entries.push_back(std::make_unique<TypedHistoryEntry<bool>>(ts, dis_bool(gen)));
+            break;
+        case 3:
+            entries.push_back(std::make_unique<TypedHistoryEntry<std::string>>(ts, std::string(50, 'a' + (i % 26))));
+            break;
+        }
+    }
+    return entries;
+}
@@ -0,0 +1,207 @@
+#include "segment_disk_storage.hpp"
+#include "lsm_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <atomic>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Query latency under heavy ingest with buffered and direct (O_DIRECT)
+// segment I/O, for the segment and LSM backends. A history is loaded first;
+// random one-hour queries over it are then timed on their own and while
+// another thread flushes new batches as fast as it can. "cached" is the
+// share of the history's and of the newly ingested files' pages that sit
+// in the page cache at the end (mincore).
+// Usage: bench_direct_io [history entries] [seconds per phase]
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const size_t BATCH_SIZE = 20000;
+    const size_t IN_FLIGHT = 4;
+    const std::string DIRECTORY = "bench_direct_io_data";
+
+    enum class Backend
+    {
+        Segment,
+        Lsm
+    };
+
+    std::vector<std::string> listFiles()
+    {
+        std::vector<std::string> paths;
+        for (const auto &file : std::filesystem::directory_iterator(DIRECTORY))
+        {
+            if (file.is_regular_file() && file.path().extension() == ".seg")
+                paths.push_back(file.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    // Percentage of the files' pages resident in the page cache
+    double cachedShare(const std::vector<std::string> &paths)
+    {
+#ifndef _WIN32
+        const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t resident = 0;
+        size_t total = 0;
+        for (const auto &path : paths)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                continue; // Compacted away
+            struct stat info;
+            size_t size = ::fstat(fd, &info) == 0 ? static_cast<size_t>(info.st_size) : 0;
+            void *mapped = size > 0 ? ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+            ::close(fd);
+            if (mapped == MAP_FAILED)
+                continue;
+            std::vector<unsigned char> pages((size + page - 1) / page);
+            if (::mincore(mapped, size, pages.data()) == 0)
+            {
+                for (unsigned char flags : pages)
+                    resident += flags & 1;
+                total += pages.size();
+            }
+            ::munmap(mapped, size);
+        }
+        return total > 0 ? 100.0 * static_cast<double>(resident) / static_cast<double>(total) : 0;
+#else
+        (void)paths;
+        return 0;
+#endif
+    }
+
+    std::unique_ptr<DiskStorage> open(Backend backend, SegmentWriter::Caching caching)
+    {
+        if (backend == Backend::Segment)
+            return std::make_unique<SegmentDiskStorage>(DIRECTORY, SegmentWriter::Mode::Auto, caching);
+        return std::make_unique<LsmDiskStorage>(DIRECTORY, LsmDiskStorage::DEFAULT_MEMTABLE_BYTES, caching);
+    }
+
+    // Random one-hour queries over the history until the deadline
+    std::vector<double> query(DiskStorage &storage, size_t history, double seconds, std::mt19937 &gen)
+    {
+        std::uniform_int_distribution<std::time_t> hour(BASE_TIMESTAMP, BASE_TIMESTAMP + static_cast<std::time_t>(history) - 3600);
+        std::vector<double> latencies;
+        auto deadline = Clock::now() + std::chrono::duration<double>(seconds);
+        while (Clock::now() < deadline)
+        {
+            std::time_t from = hour(gen);
+            auto start = Clock::now();
+            storage.retrieve(from, from + 3599);
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    void report(const std::string &label, const std::vector<double> &latencies, double ingestRate)
+    {
+        auto percentile = [&](double p)
+        { return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))]; };
+        std::cout << "  " << std::left << std::setw(8) << label << std::right << std::fixed
+                  << std::setw(6) << latencies.size() << " queries"
+                  << std::setprecision(3)
+                  << "  p50: " << std::setw(8) << percentile(0.50) << " ms"
+                  << "  p99: " << std::setw(8) << percentile(0.99) << " ms"
+                  << "  max: " << std::setw(8) << latencies.back() << " ms";
+        if (ingestRate > 0)
+            std::cout << "  ingest: " << std::setw(9) << std::setprecision(0) << ingestRate << " entries/s";
+        std::cout << std::endl;
+    }
+
+    void run(const std::string &label, Backend backend, SegmentWriter::Caching caching, size_t history, double seconds)
+    {
+        std::filesystem::remove_all(DIRECTORY);
+        std::cout << label << std::endl;
+        {
+            auto storage = open(backend, caching);
+            std::mt19937 gen(42);
+            for (size_t done = 0; done < history; done += BATCH_SIZE)
+            {
+                storage->flush(makeRandomBatch(BASE_TIMESTAMP + static_cast<std::time_t>(done), BATCH_SIZE, gen));
+            }
+            if (backend == Backend::Lsm)
+                static_cast<LsmDiskStorage &>(*storage).waitForCompactions();
+            std::vector<std::string> historyFiles = listFiles();
+
+            std::mt19937 queryGen(7);
+            report("idle", query(*storage, history, seconds, queryGen), 0);
+
+            // New data lands past the history, so queries never see it
+            std::atomic<bool> stop(false);
+            std::atomic<size_t> ingested(0);
+            std::thread ingest([&]
+                               {
+                std::mt19937 ingestGen(99);
+                std::deque<std::future<void>> pending;
+                std::time_t next = BASE_TIMESTAMP + static_cast<std::time_t>(history);
+                while (!stop)
+                {
+                    pending.push_back(storage->flushAsync(makeRandomBatch(next, BATCH_SIZE, ingestGen)));
+                    next += static_cast<std::time_t>(BATCH_SIZE);
+                    if (pending.size() >= IN_FLIGHT)
+                    {
+                        pending.front().get();
+                        pending.pop_front();
+                        ingested += BATCH_SIZE;
+                    }
+                }
+                for (auto &flush : pending)
+                {
+                    flush.get();
+                    ingested += BATCH_SIZE;
+                } });
+            auto start = Clock::now();
+            auto latencies = query(*storage, history, seconds, queryGen);
+            stop = true;
+            ingest.join();
+            double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+            report("ingest", latencies, static_cast<double>(ingested) / elapsed);
+
+            std::vector<std::string> newFiles;
+            for (const auto &path : listFiles())
+            {
+                if (!std::binary_search(historyFiles.begin(), historyFiles.end(), path))
+                    newFiles.push_back(path);
+            }
+            std::cout << "  cached: history " << std::setprecision(1) << cachedShare(historyFiles)
+                      << "%, ingested " << cachedShare(newFiles) << "%" << std::endl;
+        }
+        std::filesystem::remove_all(DIRECTORY);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t history = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    double seconds = argc > 2 ? std::stod(argv[2]) : 5;
+
+    for (const auto &[backend, backendName] : {std::make_pair(Backend::Segment, "segment"),
+                                               std::make_pair(Backend::Lsm, "lsm")})
+    {
+        for (const auto &[caching, cachingName] : {std::make_pair(SegmentWriter::Caching::Buffered, "buffered"),
+                                                   std::make_pair(SegmentWriter::Caching::Direct, "direct")})
+        {
+            run(std::string(backendName) + " " + cachingName, backend, caching, history, seconds);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "history_storage.hpp"
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+
+// Ingest with a periodic SQL report over the last hour. The report either
+// forces flush() first so the SQLite tables are complete, or runs against
+// the history_all view, which reads the RAM tier in place.
+// Usage: bench_hot_query [entries] [entries between reports] [RAM capacity]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 500000;
+    size_t reportEvery = argc > 2 ? std::stoull(argv[2]) : 5000;
+    size_t ramCapacity = argc > 3 ? std::stoull(argv[3]) : 100000;
+    const std::string path = "bench_hot_query.db";
+
+    // store() logs every 100 entries
+    std::streambuf *console = std::cout.rdbuf(nullptr);
+
+    for (bool forceFlush : {true, false})
+    {
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+
+        size_t reports = 0;
+        double checksum = 0;
+        double reportSeconds = 0;
+        size_t transactions = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            SQLiteDiskStorage disk(path);
+            ConcreteHistoryStorage storage(ramCapacity, &disk, std::chrono::seconds(3600), 0.9, 0.5);
+
+            for (size_t i = 0; i < entries; ++i)
+            {
+                std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+                storage.store(std::make_unique<TypedHistoryEntry<double>>(ts, (i % 1000) * 0.5));
+
+                if ((i + 1) % reportEvery == 0)
+                {
+                    auto reportStart = std::chrono::high_resolution_clock::now();
+                    if (forceFlush)
+                        storage.flush();
+                    disk.query("SELECT count(*), avg(value) FROM history_all WHERE timestamp > " + std::to_string(ts - 3600),
+                               [&](sqlite3_stmt *stmt)
+                               { checksum += sqlite3_column_int64(stmt, 0) + sqlite3_column_double(stmt, 1); });
+                    reportSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - reportStart).count();
+                    reports++;
+                }
+            }
+            transactions = disk.getWriteTransactionCount();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout.rdbuf(console);
+        std::cout << std::left << std::setw(22) << (forceFlush ? "flush, then query" : "query history_all") << std::right
+                  << std::fixed << " entries/second: " << std::setw(9) << std::setprecision(0) << entries / seconds
+                  << "  report: " << std::setw(7) << std::setprecision(3) << reportSeconds * 1000 / reports << " ms"
+                  << "  transactions: " << std::setw(5) << transactions
+                  << "  checksum: " << std::setprecision(1) << checksum << std::endl;
+        std::cout.rdbuf(nullptr);
+    }
+
+    std::cout.rdbuf(console);
+    return 0;
+}
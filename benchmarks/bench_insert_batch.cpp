@@ -0,0 +1,45 @@
+#include "sqlite_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+
+// Flush throughput of SQLiteDiskStorage for a sweep of multi-row INSERT widths.
+// Usage: bench_insert_batch [entries] [flush batch size]
+
+int main(int argc, char **argv)
+{
+    size_t totalEntries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    size_t flushBatch = argc > 2 ? std::stoull(argv[2]) : 2000;
+    std::vector<size_t> widths = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+    std::cout << "Flushing " << totalEntries << " entries in batches of " << flushBatch << std::endl;
+    for (size_t width : widths)
+    {
+        const std::string path = "bench_insert_batch.db";
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+
+        SQLiteDiskStorage storage(path);
+        storage.setInsertBatchWidth(width);
+
+        double seconds = 0;
+        for (size_t done = 0; done < totalEntries; done += flushBatch)
+        {
+            auto batch = makeBatch(1700000000 + static_cast<std::time_t>(done), std::min(flushBatch, totalEntries - done), BatchMix::AllTypes);
+            auto start = std::chrono::high_resolution_clock::now();
+            storage.flush(batch);
+            auto end = std::chrono::high_resolution_clock::now();
+            seconds += std::chrono::duration<double>(end - start).count();
+        }
+
+        std::cout << "Width " << std::setw(5) << storage.getInsertBatchWidth()
+                  << ": " << std::fixed << std::setprecision(2) << std::setw(12) << totalEntries / seconds
+                  << " entries/second (" << storage.getEntryCount() << " rows)" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Disk bytes per sample and full-range read throughput of the on-disk layouts.
+// The text-tag layout is built with raw SQL, then migrated by SQLiteDiskStorage.
+// Usage: bench_layout [rows]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    void removeDatabase(const std::string &path)
+    {
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+    }
+
+    void vacuum(const std::string &path)
+    {
+        sqlite3 *db;
+        sqlite3_open(path.c_str(), &db);
+        sqlite3_exec(db, "VACUUM; PRAGMA wal_checkpoint(TRUNCATE);", nullptr, nullptr, nullptr);
+        sqlite3_close(db);
+    }
+
+    // Schema version 1: clustered, but with TEXT type tags
+    void buildTextTagDatabase(const std::string &path, size_t rows)
+    {
+        removeDatabase(path);
+        sqlite3 *db;
+        sqlite3_open(path.c_str(), &db);
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = OFF; PRAGMA user_version = 1;"
+                         "CREATE TABLE history (timestamp INTEGER NOT NULL, seq INTEGER NOT NULL,"
+                         "type TEXT NOT NULL, value BLOB NOT NULL, PRIMARY KEY (timestamp, seq)) WITHOUT ROWID;"
+                         "CREATE TABLE history_meta (key TEXT PRIMARY KEY, value INTEGER NOT NULL) WITHOUT ROWID;",
+                     nullptr, nullptr, nullptr);
+
+        sqlite3_stmt *stmt;
+        sqlite3_prepare_v2(db, "INSERT INTO history VALUES (?, ?, ?, ?)", -1, &stmt, nullptr);
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            sqlite3_bind_int64(stmt, 1, BASE_TIMESTAMP + static_cast<std::time_t>(i));
+            sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(i + 1));
+            switch (i % 4)
+            {
+            case 0:
+                sqlite3_bind_text(stmt, 3, "double", -1, SQLITE_STATIC);
+                sqlite3_bind_double(stmt, 4, 500.0 + (i % 1000) * 0.125);
+                break;
+            case 1:
+                sqlite3_bind_text(stmt, 3, "int", -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 4, static_cast<int>(i % 1000));
+                break;
+            case 2:
+                sqlite3_bind_text(stmt, 3, "bool", -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 4, static_cast<int>(i / 4 % 2));
+                break;
+            case 3:
+                sqlite3_bind_text(stmt, 3, "string", -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 4, std::string(50, 'a' + (i % 26)).c_str(), -1, SQLITE_TRANSIENT);
+                break;
+            }
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+        }
+        sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+        sqlite3_finalize(stmt);
+
+        std::string meta = "INSERT INTO history_meta VALUES ('next_seq', " + std::to_string(rows + 1) + ")";
+        sqlite3_exec(db, meta.c_str(), nullptr, nullptr, nullptr);
+        sqlite3_close(db);
+    }
+
+    // Decode loop as it was with TEXT type tags
+    size_t readTextTags(const std::string &path)
+    {
+        sqlite3 *db;
+        sqlite3_open(path.c_str(), &db);
+        sqlite3_stmt *stmt;
+        sqlite3_prepare_v2(db, "SELECT timestamp, type, value FROM history", -1, &stmt, nullptr);
+
+        std::vector<std::unique_ptr<HistoryEntry>> results;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            std::time_t timestamp = sqlite3_column_int64(stmt, 0);
+            std::string type = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+            if (type == "double")
+                results.push_back(std::make_unique<TypedHistoryEntry<double>>(timestamp, sqlite3_column_double(stmt, 2)));
+            else if (type == "int")
+                results.push_back(std::make_unique<TypedHistoryEntry<int>>(timestamp, sqlite3_column_int(stmt, 2)));
+            else if (type == "bool")
+                results.push_back(std::make_unique<TypedHistoryEntry<bool>>(timestamp, sqlite3_column_int(stmt, 2) != 0));
+            else if (type == "string")
+                results.push_back(std::make_unique<TypedHistoryEntry<std::string>>(
+                    timestamp, std::string(reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2)))));
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+        return results.size();
+    }
+
+    template <typename Read>
+    void report(const std::string &label, const std::string &path, size_t rows, Read read)
+    {
+        size_t bytes = std::filesystem::file_size(path);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t returned = read();
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        std::cout << std::left << std::setw(12) << label << std::right
+                  << " file: " << std::setw(12) << bytes << " bytes"
+                  << "  bytes/sample: " << std::setw(7) << std::fixed << std::setprecision(2) << double(bytes) / rows
+                  << "  read: " << std::setw(12) << returned / seconds << " samples/second" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t rows = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    const std::string path = "bench_layout.db";
+
+    std::cout << "Building text-tag layout with " << rows << " rows" << std::endl;
+    buildTextTagDatabase(path, rows);
+    vacuum(path);
+    report("text tags", path, rows, [&path]
+           { return readTextTags(path); });
+
+    {
+        SQLiteDiskStorage storage(path);
+        storage.setChunkSize(0);
+        while (!storage.migrateLegacy())
+        {
+        }
+    }
+    vacuum(path);
+
+    {
+        SQLiteDiskStorage storage(path);
+        storage.setChunkSize(0);
+        report("int tags", path, rows, [&storage]
+               { return storage.retrieve(BASE_TIMESTAMP, BASE_TIMESTAMP + 2 * 1000000000LL).size(); });
+    }
+
+    // Same samples flushed into the chunked layout
+    const std::string chunkedPath = "bench_layout_chunked.db";
+    removeDatabase(chunkedPath);
+    {
+        SQLiteDiskStorage storage(chunkedPath);
+        storage.setChunkSize(1000);
+        for (size_t done = 0; done < rows; done += 10000)
+        {
+            std::vector<std::unique_ptr<HistoryEntry>> batch;
+            for (size_t i = done; i < std::min(rows, done + 10000); ++i)
+            {
+                std::time_t ts = BASE_TIMESTAMP + static_cast<std::time_t>(i);
+                switch (i % 4)
+                {
+                case 0:
+                    batch.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, 500.0 + (i % 1000) * 0.125));
+                    break;
+                case 1:
+                    batch.push_back(std::make_unique<TypedHistoryEntry<int>>(ts, static_cast<int>(i % 1000)));
+                    break;
+                case 2:
+                    batch.push_back(std::make_unique<TypedHistoryEntry<bool>>(ts, i / 4 % 2 == 1));
+                    break;
+                case 3:
+                    batch.push_back(std::make_unique<TypedHistoryEntry<std::string>>(ts, std::string(50, 'a' + (i % 26))));
+                    break;
+                }
+            }
+            storage.flush(batch);
+        }
+    }
+    vacuum(chunkedPath);
+
+    SQLiteDiskStorage chunked(chunkedPath);
+    report("chunked", chunkedPath, rows, [&chunked]
+           { return chunked.retrieve(BASE_TIMESTAMP, BASE_TIMESTAMP + 2 * 1000000000LL).size(); });
+    std::cout << "Chunks: " << chunked.getChunkCount() << ", entries: " << chunked.getEntryCount() << std::endl;
+
+    return 0;
+}
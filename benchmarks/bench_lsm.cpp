@@ -0,0 +1,109 @@
+#include "sqlite_disk_storage.hpp"
+#include "lsm_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <string>
+
+// Ingest with late-arriving data, then range queries, on SQLiteDiskStorage
+// and LsmDiskStorage. Every tenth batch comes from a collector that
+// reconnected and uploads samples from up to six hours back.
+// Usage: bench_lsm [entries]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const size_t BATCH_SIZE = 1000;
+    const std::time_t LATE_WINDOW = 6 * 3600;
+
+    std::vector<std::vector<std::unique_ptr<HistoryEntry>>> generateBatches(size_t entries)
+    {
+        std::mt19937 gen(42);
+        std::uniform_real_distribution<> value(0, 1000);
+        std::vector<std::vector<std::unique_ptr<HistoryEntry>>> batches;
+        std::time_t now = BASE_TIMESTAMP + LATE_WINDOW;
+        for (size_t done = 0; done < entries; done += BATCH_SIZE)
+        {
+            bool late = batches.size() % 10 == 9;
+            std::uniform_int_distribution<std::time_t> past(now - LATE_WINDOW, now);
+            std::vector<std::unique_ptr<HistoryEntry>> batch;
+            for (size_t i = 0; i < BATCH_SIZE; ++i)
+            {
+                std::time_t ts = late ? past(gen) : now++;
+                batch.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, value(gen)));
+            }
+            batches.push_back(std::move(batch));
+        }
+        return batches;
+    }
+
+    double seconds(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    template <typename Storage>
+    void run(const std::string &label, Storage &storage,
+             const std::vector<std::vector<std::unique_ptr<HistoryEntry>>> &batches, size_t entries)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const auto &batch : batches)
+            storage.flush(batch);
+        double ingest = seconds(start);
+
+        // Random one-hour windows over the whole history
+        const std::time_t last = BASE_TIMESTAMP + LATE_WINDOW + static_cast<std::time_t>(entries);
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<std::time_t> hour(BASE_TIMESTAMP, last - 3600);
+        const int queries = 50;
+        size_t rows = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < queries; ++i)
+        {
+            std::time_t from = hour(gen);
+            rows += storage.retrieve(from, from + 3599).size();
+        }
+        double query = seconds(start);
+
+        std::cout << std::left << std::setw(8) << label << std::right << std::fixed
+                  << " ingest: " << std::setw(10) << std::setprecision(0) << entries / ingest << " entries/s"
+                  << "  hour query: " << std::setw(8) << std::setprecision(3) << query * 1000 / queries << " ms"
+                  << " (" << rows / queries << " rows)"
+                  << "  disk: " << storage.getDiskUsage() / 1024 << " KiB" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    auto batches = generateBatches(entries);
+
+    {
+        const std::string path = "bench_lsm.db";
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+        SQLiteDiskStorage storage(path);
+        run("sqlite", storage, batches, entries);
+    }
+
+    {
+        const std::string directory = "bench_lsm_data";
+        std::filesystem::remove_all(directory);
+        LsmDiskStorage storage(directory);
+        run("lsm", storage, batches, entries);
+
+        storage.waitForCompactions();
+        auto stats = storage.getStats();
+        std::cout << "lsm write amplification: " << std::setprecision(2) << stats.writeAmplification()
+                  << ", read fan-out: " << stats.readFanOut() << " runs/query"
+                  << ", compactions: " << stats.compactionCount << " (+" << stats.trivialMoveCount << " moves)"
+                  << ", stalls: " << stats.stallCount << ", runs per level:";
+        for (size_t runs : stats.runsPerLevel)
+            std::cout << " " << runs;
+        std::cout << std::endl;
+    }
+    return 0;
+}
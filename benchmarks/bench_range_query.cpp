@@ -0,0 +1,166 @@
+#include "sqlite_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+
+// Narrow time-range query latency on the legacy (unindexed) layout versus the
+// clustered layout, at large row counts. Usage: bench_range_query [rows...]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const std::time_t QUERY_WIDTH = 60; // seconds, i.e. 60 rows per query
+
+    void removeDatabase(const std::string &path)
+    {
+        std::filesystem::remove(path);
+        std::filesystem::remove(path + "-wal");
+        std::filesystem::remove(path + "-shm");
+    }
+
+    // Builds a database with the pre-clustered schema, one row per second
+    void buildLegacyDatabase(const std::string &path, size_t rows)
+    {
+        removeDatabase(path);
+
+        sqlite3 *db;
+        sqlite3_open(path.c_str(), &db);
+        sqlite3_exec(db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = OFF;"
+                         "CREATE TABLE history (id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                         "timestamp INTEGER NOT NULL, type TEXT NOT NULL, value BLOB NOT NULL)",
+                     nullptr, nullptr, nullptr);
+
+        sqlite3_stmt *stmt;
+        sqlite3_prepare_v2(db, "INSERT INTO history (timestamp, type, value) VALUES (?, ?, ?)", -1, &stmt, nullptr);
+        sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            sqlite3_bind_int64(stmt, 1, BASE_TIMESTAMP + static_cast<std::time_t>(i));
+            switch (i % 4)
+            {
+            case 0:
+                sqlite3_bind_text(stmt, 2, "double", -1, SQLITE_STATIC);
+                sqlite3_bind_double(stmt, 3, i * 0.5);
+                break;
+            case 1:
+                sqlite3_bind_text(stmt, 2, "int", -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 3, static_cast<int>(i % 1000));
+                break;
+            case 2:
+                sqlite3_bind_text(stmt, 2, "bool", -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 3, static_cast<int>(i % 2));
+                break;
+            case 3:
+                sqlite3_bind_text(stmt, 2, "string", -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 3, std::string(50, 'a' + (i % 26)).c_str(), -1, SQLITE_TRANSIENT);
+                break;
+            }
+            sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+
+            if ((i + 1) % 1000000 == 0)
+            {
+                sqlite3_exec(db, "COMMIT; BEGIN", nullptr, nullptr, nullptr);
+            }
+        }
+        sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+    }
+
+    // Same query the storage used before the clustered layout
+    size_t legacyRetrieve(sqlite3 *db, std::time_t start, std::time_t end)
+    {
+        sqlite3_stmt *stmt;
+        sqlite3_prepare_v2(db, "SELECT timestamp, type, value FROM history WHERE timestamp BETWEEN ? AND ?", -1, &stmt, nullptr);
+        sqlite3_bind_int64(stmt, 1, start);
+        sqlite3_bind_int64(stmt, 2, end);
+        size_t count = 0;
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+        {
+            count++;
+        }
+        sqlite3_finalize(stmt);
+        return count;
+    }
+
+    template <typename Query>
+    void measureQueries(const std::string &label, size_t rows, size_t queries, Query query)
+    {
+        std::mt19937_64 gen(42);
+        std::uniform_int_distribution<std::time_t> offset(0, static_cast<std::time_t>(rows) - QUERY_WIDTH);
+        std::vector<double> latencies;
+        size_t returned = 0;
+
+        for (size_t i = 0; i < queries; ++i)
+        {
+            std::time_t start = BASE_TIMESTAMP + offset(gen);
+            auto begin = std::chrono::high_resolution_clock::now();
+            returned += query(start, start + QUERY_WIDTH - 1);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        double total = 0;
+        for (double latency : latencies)
+            total += latency;
+
+        std::cout << std::left << std::setw(10) << label << std::right
+                  << " rows: " << std::setw(10) << rows
+                  << "  queries: " << std::setw(5) << queries
+                  << "  avg: " << std::setw(12) << std::fixed << std::setprecision(1) << total / latencies.size() << " us"
+                  << "  p50: " << std::setw(12) << latencies[latencies.size() / 2] << " us"
+                  << "  p99: " << std::setw(12) << latencies[latencies.size() * 99 / 100] << " us"
+                  << "  rows/query: " << returned / queries << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<size_t> rowCounts = {10000000, 100000000};
+    if (argc > 1)
+    {
+        rowCounts.clear();
+        for (int i = 1; i < argc; ++i)
+            rowCounts.push_back(std::stoull(argv[i]));
+    }
+
+    for (size_t rows : rowCounts)
+    {
+        std::string path = "bench_range_query_" + std::to_string(rows) + ".db";
+        std::cout << "Building legacy database with " << rows << " rows" << std::endl;
+        buildLegacyDatabase(path, rows);
+
+        {
+            sqlite3 *db;
+            sqlite3_open(path.c_str(), &db);
+            measureQueries("legacy", rows, 10, [db](std::time_t start, std::time_t end)
+                           { return legacyRetrieve(db, start, end); });
+            sqlite3_close(db);
+        }
+
+        {
+            SQLiteDiskStorage storage(path);
+            auto migrateStart = std::chrono::high_resolution_clock::now();
+            while (!storage.migrateLegacy())
+            {
+            }
+            auto migrateEnd = std::chrono::high_resolution_clock::now();
+            std::cout << "Migrated " << storage.getEntryCount() << " rows in "
+                      << std::chrono::duration<double>(migrateEnd - migrateStart).count() << " s" << std::endl;
+
+            measureQueries("clustered", rows, 1000, [&storage](std::time_t start, std::time_t end)
+                           { return storage.retrieve(start, end).size(); });
+        }
+        removeDatabase(path); // Several GB at 100M rows
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "sqlite_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <ctime>
+
+// Ingest latency with and without rolling retention working through a large
+// expired backlog, compared with expiring the backlog in one statement.
+// Timestamps are relative to the wall clock, since retention is.
+// Usage: bench_retention [expired rows] [flushes] [flush batch size] [partition span]
+
+namespace
+{
+    const std::time_t RETENTION = 30 * 86400;
+
+    // One row per second, ending a day before the retention cutoff
+    void fillExpired(SQLiteDiskStorage &storage, size_t rows)
+    {
+        const std::time_t first = std::time(nullptr) - RETENTION - 86400 - static_cast<std::time_t>(rows);
+        for (size_t done = 0; done < rows; done += 10000)
+        {
+            storage.flush(makeBatch(first + static_cast<std::time_t>(done), std::min<size_t>(10000, rows - done), BatchMix::DoubleInt));
+        }
+    }
+
+    void ingest(const std::string &label, SQLiteDiskStorage &storage, size_t flushes, size_t batchSize)
+    {
+        std::vector<double> latencies;
+        for (size_t i = 0; i < flushes; ++i)
+        {
+            auto batch = makeBatch(std::time(nullptr), batchSize, BatchMix::DoubleInt);
+            auto start = std::chrono::high_resolution_clock::now();
+            storage.flush(batch);
+            auto end = std::chrono::high_resolution_clock::now();
+            latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto usage = storage.getDiskUsageBreakdown();
+        const auto &stats = storage.getRetentionStats();
+        std::cout << std::left << std::setw(20) << label << std::right << std::fixed << std::setprecision(2)
+                  << " flush p50: " << std::setw(6) << latencies[latencies.size() / 2] << " ms"
+                  << "  p99: " << std::setw(6) << latencies[latencies.size() * 99 / 100] << " ms"
+                  << "  max: " << std::setw(7) << latencies.back() << " ms"
+                  << "  deleted rows/chunks/partitions: " << stats.rowsDeleted << "/" << stats.chunksDeleted << "/" << stats.partitionsDropped
+                  << "  reclaimed: " << std::setw(7) << stats.bytesReclaimed / (1024.0 * 1024.0) << " MiB"
+                  << "  live/free: " << usage.liveBytes / (1024.0 * 1024.0) << "/" << usage.freeBytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t expiredRows = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    size_t flushes = argc > 2 ? std::stoull(argv[2]) : 1000;
+    size_t batchSize = argc > 3 ? std::stoull(argv[3]) : 1000;
+    std::time_t partitionSpan = argc > 4 ? std::stoll(argv[4]) : 0;
+
+    const std::string path = "bench_retention.db";
+    for (const auto &file : {path, path + "-wal", path + "-shm"})
+        std::filesystem::remove(file);
+
+    {
+        SQLiteDiskStorage storage(path, partitionSpan);
+        std::cout << "Writing " << expiredRows << " expired rows" << std::endl;
+        fillExpired(storage, expiredRows);
+
+        ingest("no retention", storage, flushes, batchSize);
+        storage.setRetention(RETENTION);
+        ingest("rolling retention", storage, flushes, batchSize);
+    }
+
+    // What ingest would wait for if the whole backlog were expired in one go
+    for (const auto &file : {path, path + "-wal", path + "-shm"})
+        std::filesystem::remove(file);
+    SQLiteDiskStorage storage(path, partitionSpan);
+    fillExpired(storage, expiredRows);
+    auto start = std::chrono::high_resolution_clock::now();
+    storage.dropPartitionsBefore(std::time(nullptr) - RETENTION);
+    storage.expireBefore(std::time(nullptr) - RETENTION, std::numeric_limits<int64_t>::max());
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << std::left << std::setw(20) << "one-shot expiry" << std::right << std::fixed << std::setprecision(2)
+              << " write lock held: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "segment_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+
+// Segment flush throughput and latency: synchronous write + fsync on the
+// flushing thread versus io_uring with several flushes in flight.
+// Latency runs from flushAsync() to the batch being durable.
+// Usage: bench_segment_writer [batches] [batch size]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+
+    std::vector<std::vector<std::unique_ptr<HistoryEntry>>> generateBatches(size_t batches, size_t batchSize)
+    {
+        std::vector<std::vector<std::unique_ptr<HistoryEntry>>> result;
+        std::mt19937 gen(42);
+        for (size_t b = 0; b < batches; ++b)
+        {
+            result.push_back(makeRandomBatch(BASE_TIMESTAMP + static_cast<std::time_t>(b * batchSize), batchSize, gen));
+        }
+        return result;
+    }
+
+    std::vector<std::unique_ptr<HistoryEntry>> cloneBatch(const std::vector<std::unique_ptr<HistoryEntry>> &batch)
+    {
+        std::vector<std::unique_ptr<HistoryEntry>> copy;
+        copy.reserve(batch.size());
+        for (const auto &entry : batch)
+            copy.push_back(entry->clone());
+        return copy;
+    }
+
+    void run(const std::string &label, SegmentWriter::Mode mode, size_t inFlight,
+             const std::vector<std::vector<std::unique_ptr<HistoryEntry>>> &batches)
+    {
+        const std::string directory = "bench_segment_writer_data";
+        std::filesystem::remove_all(directory);
+        SegmentDiskStorage storage(directory, mode);
+
+        using Clock = std::chrono::steady_clock;
+        std::vector<double> latencies;
+        std::deque<std::pair<Clock::time_point, std::future<void>>> pending;
+        auto finishOldest = [&]
+        {
+            pending.front().second.get();
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - pending.front().first).count());
+            pending.pop_front();
+        };
+
+        size_t entries = 0;
+        auto start = Clock::now();
+        for (const auto &batch : batches)
+        {
+            auto copy = cloneBatch(batch);
+            entries += copy.size();
+            auto submitted = Clock::now();
+            pending.emplace_back(submitted, storage.flushAsync(std::move(copy)));
+            if (pending.size() >= inFlight)
+                finishOldest();
+        }
+        while (!pending.empty())
+            finishOldest();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p)
+        { return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))]; };
+        std::cout << std::left << std::setw(18) << label << std::right << std::fixed << std::setprecision(0)
+                  << " throughput: " << std::setw(9) << entries / elapsed << " entries/s"
+                  << std::setprecision(0) << std::setw(7) << batches.size() / elapsed << " flushes/s"
+                  << std::setprecision(3)
+                  << "  latency p50: " << std::setw(7) << percentile(0.50) << " ms"
+                  << "  p99: " << std::setw(7) << percentile(0.99) << " ms"
+                  << "  max: " << std::setw(7) << latencies.back() << " ms" << std::endl;
+        std::filesystem::remove_all(directory);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t batchCount = argc > 1 ? std::stoull(argv[1]) : 2000;
+    size_t batchSize = argc > 2 ? std::stoull(argv[2]) : 1000;
+    auto batches = generateBatches(batchCount, batchSize);
+
+    run("sync", SegmentWriter::Mode::Synchronous, 1, batches);
+    {
+        SegmentWriter probe;
+        if (!probe.usesIoUring())
+        {
+            std::cout << "io_uring unavailable; only the synchronous path was measured" << std::endl;
+            return 0;
+        }
+    }
+    run("io_uring, depth 1", SegmentWriter::Mode::Auto, 1, batches);
+    run("io_uring, depth 4", SegmentWriter::Mode::Auto, 4, batches);
+    run("io_uring, depth 8", SegmentWriter::Mode::Auto, SegmentWriter::QUEUE_DEPTH, batches);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "sharded_disk_storage.hpp"
+#include "sqlite_disk_storage.hpp"
+#include "segment_disk_storage.hpp"
+#include "bench_data.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <algorithm>
+#include <string>
+#include <thread>
+
+// Flush throughput and query latency of ShardedDiskStorage over 1 to 8
+// SQLite or segment shards, with time-slice and hash placement. Several
+// batches are kept in flight so every shard's writer has work.
+// Usage: bench_sharded [entries]
+
+namespace
+{
+    const std::time_t BASE_TIMESTAMP = 1700000000;
+    const size_t BATCH_SIZE = 20000;
+    const size_t IN_FLIGHT = 4;
+    const std::string DIRECTORY = "bench_sharded_data";
+
+    enum class Backend
+    {
+        SQLite,
+        Segment
+    };
+
+    double seconds(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    std::vector<std::vector<std::unique_ptr<HistoryEntry>>> generateBatches(size_t entries)
+    {
+        std::mt19937 gen(42);
+        std::vector<std::vector<std::unique_ptr<HistoryEntry>>> batches;
+        for (size_t done = 0; done < entries; done += BATCH_SIZE)
+        {
+            batches.push_back(makeRandomBatch(BASE_TIMESTAMP + static_cast<std::time_t>(done),
+                                              std::min(BATCH_SIZE, entries - done), gen));
+        }
+        return batches;
+    }
+
+    std::unique_ptr<ShardedDiskStorage> openShards(Backend backend, size_t count, ShardedDiskStorage::Placement placement)
+    {
+        std::filesystem::remove_all(DIRECTORY);
+        std::filesystem::create_directories(DIRECTORY);
+        std::vector<std::unique_ptr<DiskStorage>> shards;
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string path = DIRECTORY + "/shard_" + std::to_string(i);
+            if (backend == Backend::SQLite)
+                shards.push_back(std::make_unique<SQLiteDiskStorage>(path + ".db"));
+            else
+                shards.push_back(std::make_unique<SegmentDiskStorage>(path));
+        }
+        return std::make_unique<ShardedDiskStorage>(std::move(shards), placement);
+    }
+
+    void run(const std::string &label, Backend backend, size_t shardCount, ShardedDiskStorage::Placement placement,
+             const std::vector<std::vector<std::unique_ptr<HistoryEntry>>> &batches, size_t entries)
+    {
+        {
+            auto storage = openShards(backend, shardCount, placement);
+
+            std::vector<std::future<void>> pending;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const auto &batch : batches)
+            {
+                std::vector<std::unique_ptr<HistoryEntry>> copy;
+                copy.reserve(batch.size());
+                for (const auto &entry : batch)
+                    copy.push_back(entry->clone());
+                pending.push_back(storage->flushAsync(std::move(copy)));
+                if (pending.size() >= IN_FLIGHT)
+                {
+                    pending.front().get();
+                    pending.erase(pending.begin());
+                }
+            }
+            for (auto &flush : pending)
+                flush.get();
+            double ingest = seconds(start);
+
+            // Random one-hour windows, then one full scan
+            std::mt19937 gen(7);
+            std::uniform_int_distribution<std::time_t> hour(BASE_TIMESTAMP, BASE_TIMESTAMP + static_cast<std::time_t>(entries) - 3600);
+            const int queries = 50;
+            start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < queries; ++i)
+            {
+                std::time_t from = hour(gen);
+                storage->retrieve(from, from + 3599);
+            }
+            double hourQuery = seconds(start) * 1000 / queries;
+
+            start = std::chrono::high_resolution_clock::now();
+            size_t scanned = storage->retrieve(BASE_TIMESTAMP, BASE_TIMESTAMP + static_cast<std::time_t>(entries)).size();
+            double fullScan = seconds(start);
+
+            std::cout << std::left << std::setw(22) << label << std::right << std::fixed
+                      << " flush: " << std::setw(10) << std::setprecision(0) << entries / ingest << " entries/s"
+                      << "  hour query: " << std::setw(7) << std::setprecision(3) << hourQuery << " ms"
+                      << "  full scan: " << std::setw(10) << std::setprecision(0) << scanned / fullScan << " entries/s" << std::endl;
+        }
+        std::filesystem::remove_all(DIRECTORY);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    auto batches = generateBatches(entries);
+    std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    for (const auto &[backend, backendName] : {std::make_pair(Backend::SQLite, "sqlite"),
+                                               std::make_pair(Backend::Segment, "segment")})
+    {
+        for (const auto &[placement, placementName] : {std::make_pair(ShardedDiskStorage::Placement::TimeSlice, "slice"),
+                                                       std::make_pair(ShardedDiskStorage::Placement::Hash, "hash")})
+        {
+            for (size_t shards : {1, 2, 4, 8})
+            {
+                run(std::string(backendName) + " " + placementName + " x" + std::to_string(shards),
+                    backend, shards, placement, batches, entries);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "sqlite_disk_storage.hpp"
+#include "tiered_disk_storage.hpp"
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <string>
+
+// Ninety days of one sample per second-ish, kept entirely in SQLite versus
+// tiered with everything older than a week migrated to the archive. Reports
+// migration throughput, disk usage and query latency on both tiers.
+// Usage: bench_tiered [entries]
+
+namespace
+{
+    const size_t BATCH_SIZE = 10000;
+    const std::time_t HISTORY_SPAN = 90 * 24 * 3600;
+    const std::time_t MIGRATION_AGE = 7 * 24 * 3600;
+
+    double seconds(std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    std::vector<std::vector<std::unique_ptr<HistoryEntry>>> generateBatches(size_t entries, std::time_t first)
+    {
+        // A slowly drifting sensor with small noise
+        std::mt19937 gen(42);
+        std::normal_distribution<> noise(0, 0.05);
+        std::vector<std::vector<std::unique_ptr<HistoryEntry>>> batches;
+        double value = 20.0;
+        for (size_t done = 0; done < entries; done += BATCH_SIZE)
+        {
+            std::vector<std::unique_ptr<HistoryEntry>> batch;
+            for (size_t i = done; i < std::min(entries, done + BATCH_SIZE); ++i)
+            {
+                std::time_t ts = first + static_cast<std::time_t>(i * static_cast<double>(HISTORY_SPAN) / entries);
+                value += noise(gen);
+                batch.push_back(std::make_unique<TypedHistoryEntry<double>>(ts, std::round(value * 100) / 100));
+            }
+            batches.push_back(std::move(batch));
+        }
+        return batches;
+    }
+
+    void removeDatabase(const std::string &path)
+    {
+        for (const auto &file : {path, path + "-wal", path + "-shm"})
+            std::filesystem::remove(file);
+    }
+
+    // Average latency of random windows of the given width inside [from, to]
+    template <typename Storage>
+    double queryMillis(Storage &storage, std::time_t from, std::time_t to, std::time_t width, size_t &rows)
+    {
+        std::mt19937 gen(7);
+        std::uniform_int_distribution<std::time_t> startAt(from, to - width);
+        const int queries = 50;
+        rows = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < queries; ++i)
+        {
+            std::time_t windowStart = startAt(gen);
+            rows += storage.retrieve(windowStart, windowStart + width - 1).size();
+        }
+        rows /= queries;
+        return seconds(start) * 1000 / queries;
+    }
+
+    // SQLite's WAL is reported apart: it is bounded by the checkpointer, not by the data kept
+    void printUsage(const std::string &label, const SQLiteDiskStorage::DiskUsage &usage, size_t archiveBytes)
+    {
+        std::cout << label << " disk: sqlite " << (usage.liveBytes + usage.freeBytes) / 1024 << " KiB + wal "
+                  << usage.walBytes / 1024 << " KiB, archive " << archiveBytes / 1024 << " KiB" << std::endl;
+    }
+
+    template <typename Storage>
+    void report(Storage &storage, std::time_t first, std::time_t now)
+    {
+        struct Window
+        {
+            const char *name;
+            std::time_t from;
+            std::time_t to;
+            std::time_t width;
+        };
+        for (const Window &window : {Window{"recent hour", now - MIGRATION_AGE, now, 3600},
+                                     Window{"old hour", first, now - MIGRATION_AGE, 3600},
+                                     Window{"old day", first, now - MIGRATION_AGE, 24 * 3600},
+                                     Window{"spanning 2 weeks", now - 3 * MIGRATION_AGE, now, 14 * 24 * 3600}})
+        {
+            size_t rows = 0;
+            double millis = queryMillis(storage, window.from, window.to, window.width, rows);
+            std::cout << "  " << std::left << std::setw(18) << window.name << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(9) << millis << " ms (" << rows << " rows)" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    const std::time_t now = std::time(nullptr);
+    const std::time_t first = now - HISTORY_SPAN;
+    auto batches = generateBatches(entries, first);
+
+    {
+        const std::string path = "bench_tiered_sqlite.db";
+        removeDatabase(path);
+        SQLiteDiskStorage storage(path);
+        for (const auto &batch : batches)
+            storage.flush(batch);
+        printUsage("sqlite only", storage.getDiskUsageBreakdown(), 0);
+        report(storage, first, now);
+        removeDatabase(path);
+    }
+
+    {
+        const std::string path = "bench_tiered_hot.db";
+        const std::string directory = "bench_tiered_archive";
+        removeDatabase(path);
+        std::filesystem::remove_all(directory);
+        {
+            TieredDiskStorage storage(path, directory);
+            storage.setMigrationAge(0); // Load first, then migrate in the foreground to time it
+            for (const auto &batch : batches)
+                storage.flush(batch);
+            printUsage("tiered, before migration", storage.getHotStorage().getDiskUsageBreakdown(), storage.getArchiveSize());
+
+            storage.setMigrationAge(MIGRATION_AGE);
+            auto start = std::chrono::high_resolution_clock::now();
+            while (!storage.migrate())
+            {
+            }
+            double elapsed = seconds(start);
+            auto stats = storage.getMigrationStats();
+            std::cout << "migrated " << stats.samplesMigrated << " samples in " << std::setprecision(2) << elapsed << " s ("
+                      << std::setprecision(0) << stats.samplesMigrated / elapsed << " samples/s) into "
+                      << storage.getArchiveFileCount() << " archive files, " << std::setprecision(2)
+                      << static_cast<double>(storage.getArchiveSize()) / std::max<size_t>(1, stats.samplesMigrated)
+                      << " bytes/sample" << std::endl;
+            printUsage("tiered", storage.getHotStorage().getDiskUsageBreakdown(), storage.getArchiveSize());
+            report(storage, first, now);
+        }
+        removeDatabase(path);
+        std::filesystem::remove_all(directory);
+    }
+    return 0;
+}
@@ -1,5 +1,8 @@
 #include "benchmarker.hpp"
 #include "sqlite_disk_storage.hpp"
+#include "segment_disk_storage.hpp"
+#include "memory_disk_storage.hpp"
+#include "bench_data.hpp"
 #include <iostream>
 #include <vector>
 #include <random>
@@ -8,69 +11,83 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <functional>
 
-std::vector<std::unique_ptr<HistoryEntry>> generateTestData(size_t count)
+enum class Backend
 {
-    std::vector<std::unique_ptr<HistoryEntry>> entries;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis_double(0, 1000);
-    std::uniform_int_distribution<> dis_int(0, 1000);
-    std::uniform_int_distribution<> dis_bool(0, 1);
-
-    auto now = std::time(nullptr);
-    for (size_t i = 0; i < count; ++i)
+    SQLite,
+    Segment,
+    Memory // No I/O: only the injected latency
+};
+
+// Opens an empty store for one run; entryCount reports the rows it holds
+std::unique_ptr<DiskStorage> openBackend(Backend backend, const std::string &configName, std::function<size_t()> &entryCount,
+                                         const MemoryDiskStorage::LatencyProfile &latency)
+{
+    if (backend == Backend::Memory)
     {
-        switch (i % 4)
-        {
-        case 0:
-            entries.push_back(std::make_unique<TypedHistoryEntry<double>>(now + i, dis_double(gen)));
-            break;
-        case 1:
-            entries.push_back(std::make_unique<TypedHistoryEntry<int>>(now + i, dis_int(gen)));
-            break;
-        case 2:
-            entries.push_back(std::make_unique<TypedHistoryEntry<bool>>(now + i, dis_bool(gen)));
-            break;
-        case 3:
-            entries.push_back(std::make_unique<TypedHistoryEntry<std::string>>(now + i, std::string(50, 'a' + (i % 26))));
-            break;
-        }
+        auto storage = std::make_unique<MemoryDiskStorage>(latency);
+        entryCount = [raw = storage.get()]
+        { return raw->getEntryCount(); };
+        return storage;
+    }
+    if (backend == Backend::Segment)
+    {
+        auto storage = std::make_unique<SegmentDiskStorage>("benchmark_" + configName + "_segments");
+        storage->clear();
+        entryCount = [raw = storage.get()]
+        { return raw->getEntryCount(); };
+        return storage;
     }
-    return entries;
+    auto storage = std::make_unique<SQLiteDiskStorage>("benchmark_" + configName + ".db");
+    storage->clear();
+    entryCount = [raw = storage.get()]
+    { return raw->getEntryCount(); };
+    return storage;
 }
 
 void runBenchmark(size_t ramCapacity, std::chrono::seconds flushInterval,
                   const std::vector<std::unique_ptr<HistoryEntry>> &testData, const std::string &configName,
-                  std::ofstream &reportFile, double highWatermark, double lowWatermark)
+                  std::ofstream &reportFile, double highWatermark, double lowWatermark, size_t maxRamCapacity = 0,
+                  Backend backend = Backend::SQLite,
+                  const MemoryDiskStorage::LatencyProfile &latency = MemoryDiskStorage::LatencyProfile::none())
 {
     std::cout << "Running benchmark for " << configName << " configuration" << std::endl;
-    std::cout << "RAM Capacity: " << ramCapacity << ", Flush Interval: " << flushInterval.count()
+    std::cout << "RAM Capacity: " << ramCapacity << " (max " << std::max(ramCapacity, maxRamCapacity)
+              << "), Flush Interval: " << flushInterval.count()
               << "s, High Watermark: " << highWatermark << ", Low Watermark: " << lowWatermark << std::endl;
 
-    std::string dbName = "benchmark_" + configName + ".db";
     std::stringstream benchmarkOutput;
 
     try
     {
-        auto diskStorage = std::make_unique<SQLiteDiskStorage>(dbName);
-        diskStorage->clear();
-        auto storage = std::make_unique<ConcreteHistoryStorage>(ramCapacity, diskStorage.get(), flushInterval, highWatermark, lowWatermark);
+        std::function<size_t()> diskEntryCount;
+        auto diskStorage = openBackend(backend, configName, diskEntryCount, latency);
+        auto storage = std::make_unique<ConcreteHistoryStorage>(ramCapacity, diskStorage.get(), flushInterval, highWatermark, lowWatermark, maxRamCapacity);
 
         size_t storedInRam = 0;
         size_t storedInDb = 0;
         size_t totalStored = 0;
         size_t flushCount = 0;
+        size_t rejectedCount = 0; // store() throws when the ring is full and the disk keeps failing
 
         auto startWrite = std::chrono::high_resolution_clock::now();
         for (const auto &entry : testData)
         {
-            storage->store(entry->clone());
+            try
+            {
+                storage->store(entry->clone());
+            }
+            catch (const std::exception &)
+            {
+                rejectedCount++;
+            }
             totalStored++;
 
             if (totalStored % 1000 == 0)
             {
-                storedInDb = diskStorage->getEntryCount();
+                storedInDb = diskEntryCount();
                 storedInRam = storage->getInRamCount();
                 flushCount = storage->getFlushCount();
                 benchmarkOutput << "Stored " << totalStored << " entries (RAM: " << storedInRam
@@ -81,7 +98,7 @@ void runBenchmark(size_t ramCapacity, std::chrono::seconds flushInterval,
         double writeDuration = std::chrono::duration<double>(endWrite - startWrite).count();
         double writeSpeed = totalStored / writeDuration;
 
-        storedInDb = diskStorage->getEntryCount();
+        storedInDb = diskEntryCount();
         storedInRam = storage->getInRamCount();
         flushCount = storage->getFlushCount();
 
@@ -94,17 +111,22 @@ void runBenchmark(size_t ramCapacity, std::chrono::seconds flushInterval,
         std::cout << "Benchmark completed for " << configName << " configuration" << std::endl;
         std::cout << "Total entries stored: " << totalStored << " (RAM: " << storedInRam << ", DB: " << storedInDb << ")" << std::endl;
         std::cout << "Total flushes: " << flushCount << std::endl;
+        if (rejectedCount > 0)
+            std::cout << "Rejected writes: " << rejectedCount << std::endl;
         std::cout << "Write Speed: " << std::fixed << std::setprecision(2) << writeSpeed << " entries/second" << std::endl;
         std::cout << "Read Speed: " << std::fixed << std::setprecision(2) << readSpeed << " entries/second" << std::endl;
         std::cout << std::endl;
 
         // Write detailed results to the report file
         reportFile << "=== Benchmark Results for " << configName << " configuration ===" << std::endl;
-        reportFile << "RAM Capacity: " << ramCapacity << ", Flush Interval: " << flushInterval.count()
+        reportFile << "RAM Capacity: " << ramCapacity << " (max " << std::max(ramCapacity, maxRamCapacity)
+                   << "), Flush Interval: " << flushInterval.count()
                    << "s, High Watermark: " << highWatermark << ", Low Watermark: " << lowWatermark << std::endl;
         reportFile << benchmarkOutput.str();
         reportFile << "Total entries stored: " << totalStored << " (RAM: " << storedInRam << ", DB: " << storedInDb << ")" << std::endl;
-        reportFile << "Total flushes: " << flushCount << std::endl;
+        reportFile << "Total flushes: " << flushCount << " (failed: " << storage->getFailedFlushCount() << ")" << std::endl;
+        reportFile << "Rejected writes: " << rejectedCount << std::endl;
+        reportFile << "Evicted entries: " << storage->getEvictedCount() << " (spilled: " << storage->getSpilledCount() << ")" << std::endl;
         reportFile << "Write Speed: " << std::fixed << std::setprecision(2) << writeSpeed << " entries/second" << std::endl;
         reportFile << "Read Speed: " << std::fixed << std::setprecision(2) << readSpeed << " entries/second" << std::endl;
         reportFile << "Final Memory Usage: " << storage->getMemoryUsage() << " bytes" << std::endl;
@@ -132,7 +154,7 @@ int main()
     for (size_t dataSize : dataSizes)
     {
         std::cout << "Generating " << dataSize << " test entries." << std::endl;
-        auto testData = generateTestData(dataSize);
+        auto testData = generateTestData(dataSize, std::time(nullptr), std::random_device{}());
 
         std::ofstream reportFile("benchmark_report_" + std::to_string(dataSize) + ".txt");
 
@@ -141,18 +163,44 @@ int main()
             std::string watermarkConfig = "H" + std::to_string(int(highWatermark * 100)) +
                                           "L" + std::to_string(int(lowWatermark * 100));
 
-            // Run benchmarks for different configurations
-            runBenchmark(2000, std::chrono::seconds(60), testData,
-                         "small_" + watermarkConfig + "_" + std::to_string(dataSize),
-                         reportFile, highWatermark, lowWatermark);
+            // Every configuration runs against each backend; memory is the engine's ceiling
+            for (const auto &[backend, backendName] : {std::make_pair(Backend::SQLite, "sqlite_"),
+                                                       std::make_pair(Backend::Segment, "segment_"),
+                                                       std::make_pair(Backend::Memory, "memory_")})
+            {
+                std::string suffix = watermarkConfig + "_" + std::to_string(dataSize);
 
-            runBenchmark(5000, std::chrono::seconds(120), testData,
-                         "medium_" + watermarkConfig + "_" + std::to_string(dataSize),
-                         reportFile, highWatermark, lowWatermark);
+                runBenchmark(2000, std::chrono::seconds(60), testData,
+                             backendName + ("small_" + suffix),
+                             reportFile, highWatermark, lowWatermark, 0, backend);
+
+                // Same RAM budget as small, but allowed to grow to 4x during ingest bursts
+                runBenchmark(2000, std::chrono::seconds(60), testData,
+                             backendName + ("small_elastic_" + suffix),
+                             reportFile, highWatermark, lowWatermark, 8000, backend);
 
-            runBenchmark(10000, std::chrono::seconds(300), testData,
-                         "large_" + watermarkConfig + "_" + std::to_string(dataSize),
-                         reportFile, highWatermark, lowWatermark);
+                runBenchmark(5000, std::chrono::seconds(120), testData,
+                             backendName + ("medium_" + suffix),
+                             reportFile, highWatermark, lowWatermark, 0, backend);
+
+                runBenchmark(10000, std::chrono::seconds(300), testData,
+                             backendName + ("large_" + suffix),
+                             reportFile, highWatermark, lowWatermark, 0, backend);
+            }
+        }
+
+        // Sensitivity to the disk: the medium configuration over simulated devices
+        std::vector<std::pair<std::string, MemoryDiskStorage::LatencyProfile>> devices = {
+            {"ssd", MemoryDiskStorage::LatencyProfile::ssd()},
+            {"hdd", MemoryDiskStorage::LatencyProfile::hdd()}};
+        auto failing = MemoryDiskStorage::LatencyProfile::hdd();
+        failing.flushFailureRate = 0.05;
+        devices.emplace_back("hdd_failing", failing);
+        for (const auto &[deviceName, latency] : devices)
+        {
+            runBenchmark(5000, std::chrono::seconds(120), testData,
+                         "memory_" + deviceName + "_medium_H98L85_" + std::to_string(dataSize),
+                         reportFile, 0.98, 0.85, 0, Backend::Memory, latency);
         }
 
         std::cout << "Benchmarks completed for data size " << dataSize
@@ -0,0 +1,42 @@
+#pragma once
+#include "history_entry.hpp"
+#include <cstddef>
+#include <limits>
+
+enum class AggregateOp
+{
+    Count,
+    Sum,
+    Min,
+    Max,
+    Avg
+};
+
+// Partial aggregate over numeric samples (double, int and bool as 0/1;
+// strings are skipped). Partials from the RAM tier, rows and chunks merge
+// into one result.
+struct Aggregate
+{
+    size_t count = 0;
+    double sum = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void add(double value)
+    {
+        count++;
+        sum += value;
+        if (value < min)
+            min = value;
+        if (value > max)
+            max = value;
+    }
+
+    void merge(const Aggregate &other);
+
+    // Adds entry if it is numeric; no allocation
+    void add(const HistoryEntry &entry);
+
+    // NaN for Min, Max and Avg over no samples
+    double value(AggregateOp op) const;
+};
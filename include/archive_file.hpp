@@ -0,0 +1,69 @@
+#pragma once
+#include "history_cursor.hpp"
+#include "block_codec.hpp"
+#include "mapped_file.hpp"
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <ctime>
+#include <cstdint>
+
+// One immutable file of BlockCodec payloads, each a column block of up to
+// BLOCK_SAMPLES samples of a single entry type in timestamp order, followed
+// by a footer index holding each block's type, offset and min/max timestamp
+// and a trailer with the file's counts and bounds. The trailer also records
+// archivedThrough: once the file is in place, every sample at or before that
+// time is in the archive. Files are written once under a temporary name,
+// synced and renamed; readers map them read-only.
+class ArchiveFile
+{
+public:
+    static constexpr size_t BLOCK_SAMPLES = 1024;
+
+private:
+    struct BlockIndex;
+    class Cursor;
+
+    std::string path;
+    MappedFile mapping;
+    const BlockIndex *blocks; // Footer, inside the mapping
+    uint32_t blockCount;
+    uint64_t entryCount;
+    std::time_t minTimestamp;
+    std::time_t maxTimestamp;
+    std::time_t archivedThrough;
+    std::array<std::vector<uint32_t>, 5> typeBlocks; // Block numbers per EntryType, in timestamp order
+
+public:
+    // Maps an existing archive; throws if the file is not a valid one
+    explicit ArchiveFile(const std::string &path);
+
+    ArchiveFile(const ArchiveFile &) = delete;
+    ArchiveFile &operator=(const ArchiveFile &) = delete;
+
+    // File contents for entries already in timestamp order
+    static std::vector<uint8_t> encode(const std::vector<const HistoryEntry *> &sorted, std::time_t archivedThrough);
+
+    // Streams the entries in [start, end]; the cursor keeps the file mapped.
+    // Only blocks overlapping the range are decoded.
+    static std::unique_ptr<HistoryCursor> openCursor(std::shared_ptr<const ArchiveFile> archive,
+                                                     std::time_t start, std::time_t end);
+
+    // Straight from the decoded columns; string blocks are never decoded
+    void aggregate(std::time_t start, std::time_t end, Aggregate &result) const;
+
+    // Removes the file; see MappedFile for open cursors
+    void retire() const;
+
+    const std::string &getPath() const { return path; }
+    size_t getSize() const { return mapping.size(); }
+    size_t getEntryCount() const { return entryCount; }
+    std::time_t getMinTimestamp() const { return minTimestamp; }
+    std::time_t getMaxTimestamp() const { return maxTimestamp; }
+    std::time_t getArchivedThrough() const { return archivedThrough; }
+    bool overlaps(std::time_t start, std::time_t end) const { return minTimestamp <= end && maxTimestamp >= start; }
+
+private:
+    ColumnBlock decodeBlock(uint32_t block) const;
+};
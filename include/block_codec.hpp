@@ -0,0 +1,40 @@
+#pragma once
+#include "history_entry.hpp"
+#include "aggregate.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+// Column-oriented samples of a single entry type, in timestamp order
+struct ColumnBlock
+{
+    EntryType type;
+    std::vector<int64_t> timestamps;
+    std::vector<double> doubles;      // EntryType::Double
+    std::vector<int64_t> integers;    // EntryType::Int and EntryType::Bool
+    std::vector<std::string> strings; // EntryType::String
+
+    explicit ColumnBlock(EntryType type = EntryType::Double) : type(type) {}
+
+    size_t size() const { return timestamps.size(); }
+    bool empty() const { return timestamps.empty(); }
+    void append(const HistoryEntry *entry);
+    std::unique_ptr<HistoryEntry> makeEntry(size_t index) const;
+    void aggregate(size_t from, size_t to, Aggregate &result) const; // Samples [from, to), straight from the columns
+    void clear();
+};
+
+// Serializes a ColumnBlock into a compact payload. The first byte is a format
+// version so payloads written by older encoders stay readable. Version 2 is
+// Gorilla-style: delta-of-delta timestamps and XOR-compressed doubles in bit
+// streams, zigzag varint int deltas, bit-packed bools and dictionary strings.
+// The codec knows nothing about storage, so any DiskStorage can embed it.
+class BlockCodec
+{
+public:
+    static constexpr uint8_t CURRENT_VERSION = 2;
+
+    static void encode(const ColumnBlock &block, std::vector<uint8_t> &out, uint8_t version = CURRENT_VERSION);
+    static ColumnBlock decode(const uint8_t *data, size_t size);
+};
@@ -1,55 +1,131 @@
 #pragma once
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <stdexcept>
 #include <memory>
 #include "history_entry.hpp"
 
+// Ring built from a chain of fixed-size segments. It normally holds up to
+// `capacity` items, but grow() lets it take extra segments up to
+// `maxCapacity` to absorb a burst. Drained segments are released again as
+// the ring shrinks back, so peak memory is not reserved permanently.
 template <typename T>
 class CircularBuffer
 {
 private:
-    std::vector<std::unique_ptr<T>> buffer;
-    size_t head = 0, tail = 0, size = 0;
+    using Segment = std::unique_ptr<std::unique_ptr<T>[]>;
+
+    std::deque<Segment> segments;
+    std::vector<Segment> spareSegments;
+    size_t head = 0, size = 0; // head is the offset of the oldest item in segments.front()
     size_t capacity;
+    size_t maxCapacity;
+    size_t segmentSize;
+    size_t limit; // current capacity, between capacity and maxCapacity
 
 public:
-    CircularBuffer(size_t cap) : capacity(cap), buffer(cap) {}
+    CircularBuffer(size_t cap) : CircularBuffer(cap, cap, cap) {}
+
+    CircularBuffer(size_t cap, size_t maxCap, size_t segSize)
+        : capacity(cap), maxCapacity(std::max(cap, maxCap)), segmentSize(segSize), limit(cap)
+    {
+        if (cap == 0 || segSize == 0)
+            throw std::invalid_argument("Buffer capacity and segment size must be positive");
+    }
 
-    void push(std::unique_ptr<T> item)
+    // Returns the oldest item if the ring was full and it had to make room, nullptr otherwise
+    std::unique_ptr<T> push(std::unique_ptr<T> item)
     {
-        if (size == capacity)
+        std::unique_ptr<T> evicted;
+        if (size == limit)
         {
-            buffer[head] = std::move(item);
-            head = (head + 1) % capacity;
-            tail = (tail + 1) % capacity;
+            evicted = pop();
         }
-        else
+
+        size_t pos = head + size;
+        if (pos / segmentSize == segments.size())
         {
-            buffer[tail] = std::move(item);
-            tail = (tail + 1) % capacity;
-            size++;
+            segments.push_back(acquireSegment());
         }
+        segments[pos / segmentSize][pos % segmentSize] = std::move(item);
+        size++;
+        return evicted;
     }
 
     std::unique_ptr<T> pop()
     {
         if (size == 0)
             throw std::runtime_error("Buffer is empty");
-        std::unique_ptr<T> item = std::move(buffer[head]);
-        head = (head + 1) % capacity;
+        std::unique_ptr<T> item = std::move(segments.front()[head]);
+        head++;
         size--;
+
+        if (head == segmentSize || size == 0)
+        {
+            // Front segment is drained; the next item (if any) starts the next segment
+            if (head == segmentSize)
+            {
+                releaseSegment(std::move(segments.front()));
+                segments.pop_front();
+            }
+            head = size == 0 ? 0 : head % segmentSize;
+        }
+
+        // Shrink back once the ring has drained below the extra segments,
+        // never down to the current size, so a pop always leaves room
+        while (limit > capacity && size + segmentSize < limit)
+        {
+            limit = std::max(capacity, limit - segmentSize);
+        }
         return item;
     }
 
+    // Allows the ring to hold one more segment worth of items, up to maxCapacity.
+    bool grow()
+    {
+        if (limit >= maxCapacity)
+            return false;
+        limit = std::min(maxCapacity, limit + segmentSize);
+        return true;
+    }
+
     const T &at(size_t index) const
     {
         if (index >= size)
             throw std::out_of_range("Index out of range");
-        return *buffer[(head + index) % capacity];
+        size_t pos = head + index;
+        return *segments[pos / segmentSize][pos % segmentSize];
     }
 
     size_t getSize() const { return size; }
-    size_t getCapacity() const { return capacity; }
+    size_t getCapacity() const { return limit; }
+    size_t getNominalCapacity() const { return capacity; }
+    size_t getMaxCapacity() const { return maxCapacity; }
+    size_t getSegmentSize() const { return segmentSize; }
+    size_t getAllocatedSegments() const { return segments.size() + spareSegments.size(); }
     bool isEmpty() const { return size == 0; }
-    bool isFull() const { return size == capacity; }
-};
\ No newline at end of file
+    bool isFull() const { return size == limit; }
+
+private:
+    Segment acquireSegment()
+    {
+        if (!spareSegments.empty())
+        {
+            Segment segment = std::move(spareSegments.back());
+            spareSegments.pop_back();
+            return segment;
+        }
+        return Segment(new std::unique_ptr<T>[segmentSize]);
+    }
+
+    void releaseSegment(Segment segment)
+    {
+        // Keep enough segments around for the nominal capacity, free the burst ones
+        size_t nominalSegments = (capacity + segmentSize - 1) / segmentSize + 1;
+        if (segments.size() + spareSegments.size() <= nominalSegments)
+        {
+            spareSegments.push_back(std::move(segment));
+        }
+    }
+};
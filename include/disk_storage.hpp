@@ -1,7 +1,23 @@
 #pragma once
 #include "history_entry.hpp"
+#include "history_cursor.hpp"
+#include "aggregate.hpp"
 #include <vector>
 #include <memory>
+#include <future>
+
+// Entries that are not on disk yet, such as a RAM ring in front of a DiskStorage
+class HotTier
+{
+public:
+    virtual ~HotTier() = default;
+
+    // Called before a query takes its disk snapshot
+    virtual void prepareHotScan() {}
+
+    // Entries in [start, end] in timestamp order
+    virtual std::vector<std::unique_ptr<HistoryEntry>> scanHot(std::time_t start, std::time_t end) const = 0;
+};
 
 class DiskStorage
 {
@@ -9,5 +25,62 @@ public:
     virtual ~DiskStorage() = default;
     virtual void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) = 0;
     virtual std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) = 0;
+
+    // The future is ready once the batch is durable (or failed). The default
+    // flushes on the calling thread and returns a ready future.
+    virtual std::future<void> flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries)
+    {
+        std::promise<void> done;
+        try
+        {
+            flush(entries);
+            done.set_value();
+        }
+        catch (...)
+        {
+            done.set_exception(std::current_exception());
+        }
+        return done.get_future();
+    }
+
+    // Unordered, like retrieve(); the default runs on the calling thread
+    virtual std::future<std::vector<std::unique_ptr<HistoryEntry>>> retrieveAsync(std::time_t start, std::time_t end)
+    {
+        std::promise<std::vector<std::unique_ptr<HistoryEntry>>> result;
+        try
+        {
+            result.set_value(retrieve(start, end));
+        }
+        catch (...)
+        {
+            result.set_exception(std::current_exception());
+        }
+        return result.get_future();
+    }
+
+    // Entries in [start, end] in timestamp order; the default materializes retrieve()
+    virtual std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end)
+    {
+        return std::make_unique<VectorCursor>(retrieve(start, end));
+    }
+
+    // Numeric aggregate over [start, end]; the default streams openCursor()
+    virtual Aggregate aggregate(std::time_t start, std::time_t end)
+    {
+        Aggregate result;
+        auto cursor = openCursor(start, end);
+        while (auto entry = cursor->next())
+        {
+            result.add(*entry);
+        }
+        return result;
+    }
     virtual size_t getDiskUsage() const = 0;
+
+    // Backends with a query language can include the tier in their queries;
+    // the tier must outlive its registration
+    virtual void setHotTier(HotTier *) {}
+
+    // True when retrieve() and getDiskUsage() may run on other threads while flush() is in progress
+    virtual bool supportsConcurrentRetrieve() const { return false; }
 };
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+#include "history_entry.hpp"
+#include <vector>
+#include <memory>
+
+// Forward-only stream of entries in timestamp order. A cursor holds whatever
+// it reads from (statements, snapshots, connections) until it is destroyed,
+// so callers can stop early by simply dropping it.
+class HistoryCursor
+{
+public:
+    virtual ~HistoryCursor() = default;
+
+    // Returns nullptr once exhausted
+    virtual std::unique_ptr<HistoryEntry> next() = 0;
+
+    // Appends up to maxEntries entries to batch; returns false once nothing is left
+    bool nextBatch(std::vector<std::unique_ptr<HistoryEntry>> &batch, size_t maxEntries);
+};
+
+// Cursor over entries that are already in memory; sorts them on construction
+class VectorCursor : public HistoryCursor
+{
+private:
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    size_t position;
+
+public:
+    explicit VectorCursor(std::vector<std::unique_ptr<HistoryEntry>> entries);
+
+    std::unique_ptr<HistoryEntry> next() override;
+};
+
+// K-way merge of cursors by timestamp, holding one entry per input
+class MergeCursor : public HistoryCursor
+{
+private:
+    struct Head
+    {
+        std::unique_ptr<HistoryEntry> entry;
+        size_t input;
+    };
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    std::vector<Head> heads; // Min-heap on timestamp
+
+public:
+    explicit MergeCursor(std::vector<std::unique_ptr<HistoryCursor>> inputs);
+
+    std::unique_ptr<HistoryEntry> next() override;
+};
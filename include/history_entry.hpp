@@ -2,6 +2,16 @@
 #include <ctime>
 #include <string>
 #include <memory>
+#include <cstdint>
+
+// Compact type tag used by the on-disk formats
+enum class EntryType : uint8_t
+{
+    Double = 1,
+    Int = 2,
+    Bool = 3,
+    String = 4
+};
 
 class HistoryEntry
 {
@@ -78,4 +88,6 @@ public:
 extern template class TypedHistoryEntry<double>;
 extern template class TypedHistoryEntry<int>;
 extern template class TypedHistoryEntry<bool>;
-extern template class TypedHistoryEntry<std::string>;
\ No newline at end of file
+extern template class TypedHistoryEntry<std::string>;
+
+EntryType getEntryType(const HistoryEntry *entry);
@@ -2,27 +2,41 @@
 #include "history_entry.hpp"
 #include "circular_buffer.hpp"
 #include "disk_storage.hpp"
+#include "spill_file.hpp"
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <string>
 
 class HistoryStorage
 {
 public:
     virtual ~HistoryStorage() = default;
-    virtual void store(std::unique_ptr<HistoryEntry> entry) = 0;
+    // Takes ownership of entry only once it is stored; if store() throws,
+    // entry is left with the caller so the sample can be retried
+    virtual void store(std::unique_ptr<HistoryEntry> &&entry) = 0;
     virtual std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) = 0;
+    virtual std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) = 0;
+    virtual double aggregate(std::time_t start, std::time_t end, AggregateOp op) = 0;
     virtual void flush() = 0;
     virtual size_t getMemoryUsage() const = 0;
     virtual size_t getDiskUsage() const = 0;
 };
 
-class ConcreteHistoryStorage : public HistoryStorage
+// Registers itself as diskStorage's hot tier, so SQL run on the disk side
+// also sees the ring and entries waiting in the spill file
+class ConcreteHistoryStorage : public HistoryStorage, private HotTier
 {
 private:
     CircularBuffer<HistoryEntry> ramBuffer;
     DiskStorage *diskStorage;
     std::chrono::steady_clock::time_point lastFlushTime;
+    std::chrono::steady_clock::time_point lastWatermarkFlushTime;
     size_t entriesSinceLastFlush;
     const std::chrono::seconds FLUSH_INTERVAL;
     size_t totalFlushCount;
@@ -30,24 +44,92 @@ private:
     const double HIGH_WATERMARK; // % of RAM capacity
     const double LOW_WATERMARK;  // % of RAM capacity
 
+    // Watermark hits closer together than this count as a burst and grow the ring instead of flushing
+    static constexpr std::chrono::milliseconds BURST_WINDOW{1000};
+
+    // Overflow path for entries evicted from a full ring, merged into diskStorage in the background
+    std::unique_ptr<SpillFile> spillFile;
+    std::thread spillMerger;
+    std::mutex spillMutex;
+    std::condition_variable spillCondition;
+    bool stopSpillMerger;
+    mutable std::mutex diskMutex; // Serializes diskStorage writes between ingest and the spill merger
+    std::atomic<size_t> evictedCount;
+    std::atomic<size_t> mergedCount;
+    static constexpr size_t SPILL_MERGE_BATCH = 10000;
+
+    // One batch at a time is written in the background. Its entries stay in
+    // the ring until the batch is committed; a failed batch is written again
+    // from the ring after a backoff.
+    std::future<void> pendingFlush;
+    size_t pendingFlushCount; // Oldest ring entries covered by pendingFlush
+    size_t failedFlushAttempts; // In a row, reset by a successful flush
+    size_t totalFailedFlushCount;
+    std::chrono::steady_clock::time_point nextFlushAttempt;
+    static constexpr std::chrono::milliseconds FLUSH_RETRY_DELAY{100};
+    static constexpr std::chrono::milliseconds MAX_FLUSH_RETRY_DELAY{10000};
+    static constexpr size_t MAX_FLUSH_ATTEMPTS = 5; // Before flush() gives up and throws
+
 public:
     ConcreteHistoryStorage(size_t ramCapacity, DiskStorage *disk,
-                           std::chrono::seconds flushInterval, double highWatermark, double lowWatermark);
+                           std::chrono::seconds flushInterval, double highWatermark, double lowWatermark,
+                           size_t maxRamCapacity = 0);
+    ~ConcreteHistoryStorage();
 
-    void store(std::unique_ptr<HistoryEntry> entry) override;
+    // Route entries evicted from a full ring to an append-only overflow file instead of a synchronous flush
+    void enableSpill(const std::string &spillPath);
+
+    // Never waits for a background flush unless the ring is full. A full ring
+    // first waits for the pending flush, then evicts its oldest segment: into
+    // the spill file when enabled, otherwise by a synchronous diskStorage
+    // flush on the calling thread. If that flush fails, store() throws and
+    // the caller keeps entry.
+    void store(std::unique_ptr<HistoryEntry> &&entry) override;
     std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+
+    // RAM entries in range are copied up front; disk entries are streamed
+    // and merged in timestamp order
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+
+    // Numeric samples only; NaN for Min, Max and Avg when nothing matched
+    double aggregate(std::time_t start, std::time_t end, AggregateOp op) override;
+
+    // Writes the entries above the low watermark and waits until they are
+    // durable. Throws after MAX_FLUSH_ATTEMPTS failed attempts in a row; the
+    // entries stay in RAM and later flushes retry them.
     void flush() override;
     size_t getMemoryUsage() const override;
     size_t getDiskUsage() const override;
 
     size_t getInRamCount() const;
     size_t getFlushCount() const;
+    size_t getFailedFlushCount() const;
+    size_t getRamCapacity() const;
+    size_t getEvictedCount() const;
+    size_t getSpilledCount() const;
+    size_t getMergedCount() const;
 
 private:
     bool isRamBufferNearlyFull() const
     {
-        // Consider the buffer nearly full when it's at HIGH_WATERMARK% capacity
+        // Consider the buffer nearly full when it's at HIGH_WATERMARK% of its current capacity
         return ramBuffer.getSize() >= (ramBuffer.getCapacity() * HIGH_WATERMARK);
     }
+    bool isBurst() const
+    {
+        return std::chrono::steady_clock::now() - lastWatermarkFlushTime < BURST_WINDOW;
+    }
+    bool isFlushPending() const
+    {
+        return pendingFlush.valid() || std::chrono::steady_clock::now() < nextFlushAttempt;
+    }
+    void startFlush();
+    void completeFlush(bool wait);
+    void awaitFlush() { completeFlush(true); }
     std::vector<std::unique_ptr<HistoryEntry>> retrieveFromRAM(std::time_t start, std::time_t end) const;
+    void prepareHotScan() override;
+    std::vector<std::unique_ptr<HistoryEntry>> scanHot(std::time_t start, std::time_t end) const override;
+    void evictOldestSegment();
+    void mergeSpill();
+    void runSpillMerger();
 };
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "segment_file.hpp"
+#include "spill_file.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// LSM-tree backend for out-of-order and late-arriving data. Flushed batches
+// are appended to a write-ahead log and inserted into a sorted memtable; a
+// full memtable is frozen and written by a background thread as a level-0
+// run (a SegmentFile), so late data never rewrites what is already on disk.
+// The same thread compacts levels: level 0 runs may overlap each other,
+// deeper levels hold non-overlapping runs and grow LEVEL_SIZE_RATIO times per
+// level. Every run carries its time range, so queries only open the runs
+// that overlap the requested range. A MANIFEST file lists the live runs.
+// With Caching::Direct runs are written and read around the page cache, so
+// compactions don't evict the data queries are using.
+class LsmDiskStorage : public DiskStorage
+{
+public:
+    struct Stats
+    {
+        size_t userBytes = 0;       // Entry bytes handed to flush()
+        size_t walBytes = 0;        // Written to write-ahead logs of retired memtables
+        size_t flushedBytes = 0;    // Level-0 runs written from memtables
+        size_t compactedBytes = 0;  // Runs written by compactions
+        size_t compactionCount = 0;
+        size_t trivialMoveCount = 0; // Compactions that relinked runs without rewriting them
+        size_t stallCount = 0;      // Flushes that waited for a memtable to reach disk
+        size_t queryCount = 0;
+        size_t runsProbed = 0;      // Runs opened by queries
+        size_t lastFanOut = 0;
+        std::vector<size_t> runsPerLevel;
+
+        // Bytes written to disk per byte of user data
+        double writeAmplification() const;
+        // Runs opened per query
+        double readFanOut() const;
+    };
+
+    static constexpr size_t DEFAULT_MEMTABLE_BYTES = 4 * 1024 * 1024;
+    static constexpr size_t MAX_IMMUTABLE_MEMTABLES = 2;
+    static constexpr size_t L0_COMPACTION_TRIGGER = 4;
+    static constexpr size_t LEVEL_SIZE_RATIO = 10;
+    static constexpr size_t MAX_LEVELS = 7;
+
+private:
+    using Run = std::shared_ptr<const SegmentFile>;
+
+    struct Memtable
+    {
+        uint64_t id;
+        std::multimap<std::time_t, std::unique_ptr<HistoryEntry>> entries;
+        std::shared_ptr<SpillFile> wal; // Shared so flush() can sync it after unlocking
+        std::string walPath;
+        size_t bytes = 0;
+    };
+
+    struct Compaction
+    {
+        size_t level = 0;
+        std::vector<Run> inputs; // From level
+        std::vector<Run> overlapping; // From level + 1
+        bool trivialMove = false; // Nothing to merge: inputs move down as they are
+    };
+
+    std::string directory;
+    size_t memtableBytes;
+    SegmentWriter::Caching caching;
+
+    // Guards the memtables, levels and stats; files are written outside it
+    mutable std::mutex mutex;
+    std::unique_ptr<Memtable> memtable;
+    std::deque<std::shared_ptr<Memtable>> immutables; // Oldest first; entries are read-only once frozen
+    std::vector<std::vector<Run>> levels; // Level 0 in creation order, deeper levels by time
+    uint64_t nextFileId;
+    mutable Stats stats;
+    std::atomic<size_t> diskUsage;
+    std::atomic<size_t> entryCount;
+    std::string backgroundError;
+
+    std::mutex jobMutex; // Held by each background job and by clear()
+    std::thread worker;
+    std::condition_variable wake;
+    std::condition_variable drained; // A frozen memtable reached disk
+    bool stopping;
+
+    static constexpr std::chrono::milliseconds ERROR_RETRY_DELAY{1000};
+
+public:
+    explicit LsmDiskStorage(const std::string &directory, size_t memtableBytes = DEFAULT_MEMTABLE_BYTES,
+                            SegmentWriter::Caching caching = SegmentWriter::Caching::Buffered);
+    ~LsmDiskStorage();
+
+    LsmDiskStorage(const LsmDiskStorage &) = delete;
+    LsmDiskStorage &operator=(const LsmDiskStorage &) = delete;
+
+    void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+    size_t getDiskUsage() const override { return diskUsage; }
+    bool supportsConcurrentRetrieve() const override { return true; }
+
+    size_t getEntryCount() const { return entryCount; }
+    Stats getStats() const;
+    // Blocks until every frozen memtable is on disk and no compaction is due
+    void waitForCompactions();
+    void clear();
+
+private:
+    std::string filePath(const std::string &prefix, uint64_t id, const std::string &extension) const;
+    std::unique_ptr<Memtable> newMemtable();
+    void recover();
+    void run();
+    bool needsWork() const;
+    void flushMemtable(const std::shared_ptr<Memtable> &frozen);
+    bool pickCompaction(Compaction &job) const;
+    void compact(const Compaction &job);
+    void installRuns(size_t level, const std::vector<Run> &runs);
+    // Clones the memtables' entries in range and returns the runs to read
+    std::vector<Run> collectSources(std::time_t start, std::time_t end,
+                                    std::vector<std::unique_ptr<HistoryEntry>> &inMemory) const;
+    std::string manifestText() const;
+    void writeManifest(const std::string &text) const;
+    size_t levelBytes(size_t level) const;
+    size_t levelLimit(size_t level) const;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// A whole file mapped read-only; without mmap (Windows) it is read into
+// memory instead. The mapping outlives the file name, so a mapped file can
+// be unlinked while cursors are still reading it.
+class MappedFile
+{
+private:
+    const uint8_t *bytes;
+    size_t length;
+#ifdef _WIN32
+    std::vector<uint8_t> buffer;
+#endif
+
+public:
+    MappedFile() : bytes(nullptr), length(0) {}
+    // kind names the file in error messages, e.g. "segment"
+    MappedFile(const std::string &path, const std::string &kind);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+    // Tells the kernel [offset, offset + count) is about to be read; only a hint
+    void adviseWillNeed(size_t offset, size_t count) const;
+
+private:
+    void unmap();
+};
+
+// Fields that end both segment and archive files; a format may append more
+struct FileTrailer
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t blockCount;
+    uint64_t entryCount;
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+};
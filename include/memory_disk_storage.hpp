@@ -0,0 +1,114 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "worker_pool.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+
+// DiskStorage that keeps entries in a map and only pretends to do I/O: each
+// operation sleeps for a delay drawn from a LatencyProfile and may fail on
+// purpose. With the default profile it costs nothing, which makes it the
+// ceiling for the engine in front of it; slower profiles show how sensitive
+// the engine is to the disk. flushAsync() runs flushes in order on a writer
+// thread, like SQLiteDiskStorage.
+class MemoryDiskStorage : public DiskStorage
+{
+public:
+    struct Latency
+    {
+        enum class Distribution
+        {
+            Constant,
+            Uniform,     // mean +/- spread
+            Exponential, // spread is ignored
+            LogNormal    // spread is the standard deviation
+        };
+        Distribution distribution = Distribution::Constant;
+        std::chrono::nanoseconds mean{0};
+        std::chrono::nanoseconds spread{0};
+    };
+
+    struct LatencyProfile
+    {
+        Latency perFlush;
+        Latency perRowWritten;
+        Latency perRetrieve; // retrieve(), openCursor() and aggregate()
+        Latency perRowRead;
+        // Jitter: an operation also waits `stall` with this probability,
+        // like an fsync stuck behind a checkpoint
+        double stallProbability = 0;
+        Latency stall;
+        // A failed flush waits out its delay, stores nothing and throws
+        double flushFailureRate = 0;
+        double retrieveFailureRate = 0;
+
+        // Rough shapes of real devices, for sweeps
+        static LatencyProfile none() { return {}; }
+        static LatencyProfile ssd();
+        static LatencyProfile hdd();
+    };
+
+    struct Stats
+    {
+        size_t flushes = 0;
+        size_t failedFlushes = 0;
+        size_t rowsWritten = 0;
+        size_t retrieves = 0;
+        size_t failedRetrieves = 0;
+        size_t rowsRead = 0;
+        size_t stalls = 0;
+        std::chrono::nanoseconds injectedDelay{0};
+    };
+
+private:
+    enum class Operation
+    {
+        Flush,
+        Retrieve
+    };
+
+    std::multimap<std::time_t, std::unique_ptr<HistoryEntry>> entries;
+    mutable std::shared_mutex entriesMutex;
+    std::atomic<size_t> diskUsage;
+
+    LatencyProfile profile;
+    std::mt19937_64 random;
+    Stats stats;
+    mutable std::mutex modelMutex; // Guards profile, random and stats
+
+    std::unique_ptr<WorkerPool> writer; // Last: queued flushes finish before the rest is destroyed
+
+public:
+    explicit MemoryDiskStorage(const LatencyProfile &profile = LatencyProfile::none(), uint64_t seed = 42);
+    ~MemoryDiskStorage();
+
+    MemoryDiskStorage(const MemoryDiskStorage &) = delete;
+    MemoryDiskStorage &operator=(const MemoryDiskStorage &) = delete;
+
+    void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    std::future<void> flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries) override;
+    std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+    Aggregate aggregate(std::time_t start, std::time_t end) override;
+    size_t getDiskUsage() const override { return diskUsage; }
+    bool supportsConcurrentRetrieve() const override { return true; }
+
+    void setLatencyProfile(const LatencyProfile &profile);
+    LatencyProfile getLatencyProfile() const;
+    Stats getStats() const;
+    size_t getEntryCount() const;
+    void clear();
+
+private:
+    // Draws the delay and the outcome of one operation and sleeps through the
+    // delay; returns false if the operation is to fail
+    bool simulate(Operation operation, size_t rows);
+    // Total for `count` independent draws; large counts use the normal approximation
+    std::chrono::nanoseconds draw(const Latency &latency, size_t count = 1);
+    std::vector<std::unique_ptr<HistoryEntry>> collect(std::time_t start, std::time_t end) const;
+};
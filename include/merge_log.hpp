@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Crash safety for merges that replace input files with one output. The
+// log lists the inputs next to the output and is written before the output
+// goes in place; it is removed once the inputs are gone. On open, a log
+// whose output exists finishes removing its inputs, and one without output
+// is dropped, so both never remain on disk.
+class MergeLog
+{
+public:
+    // Durable once it returns; inputs are paths in the output's directory
+    static void write(const std::string &output, const std::vector<std::string> &inputs);
+    // After the inputs are removed, or when the merge is abandoned
+    static void finish(const std::string &output);
+    // Completes or drops the logs in directory for outputs with outputExtension
+    static void recover(const std::string &directory, const std::string &outputExtension);
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include "history_entry.hpp"
+#include <vector>
+#include <memory>
+#include <ctime>
+#include <cstring>
+#include <cstdint>
+
+// Reads a T stored at any alignment
+template <typename T>
+T loadValue(const uint8_t *in)
+{
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// One entry as a self-describing record, as stored in segment and spill
+// files: type (1 byte), timestamp (8 bytes), value (8, 4, 1 or 4 + N bytes),
+// in host byte order
+class RecordCodec
+{
+public:
+    static constexpr size_t HEADER_SIZE = 1 + 8;
+
+    // Returns the record's size
+    static size_t append(const HistoryEntry *entry, std::vector<uint8_t> &out);
+    // What append() would add for entry
+    static size_t encodedSize(const HistoryEntry *entry);
+
+    // Size of the record at `record`, of which `available` bytes are readable;
+    // 0 when more of it is needed to tell. Throws on an unknown type.
+    static size_t size(const uint8_t *record, size_t available);
+    static std::time_t timestamp(const uint8_t *record) { return loadValue<int64_t>(record + 1); }
+    // The record must be complete
+    static std::unique_ptr<HistoryEntry> decode(const uint8_t *record);
+};
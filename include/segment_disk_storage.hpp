@@ -0,0 +1,80 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "segment_file.hpp"
+#include "segment_writer.hpp"
+#include "worker_pool.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <cstdint>
+
+// Append-only backend: every flush writes one immutable SegmentFile of
+// timestamp-sorted records packed into fixed-size blocks, followed by a
+// footer index holding each block's min/max timestamp. Segments are read
+// through mmap; a range read binary searches the footer and scans the
+// matching blocks contiguously. Files go out through a SegmentWriter
+// (io_uring where available), so several flushes can be in flight. With
+// Caching::Direct segments are written and read around the page cache.
+//
+// Each segment stays mapped, so their number is kept down: a background
+// thread merges MERGE_FANIN segments of the same size tier (tiers grow by
+// MERGE_FANIN) into one. A merge holds its inputs' entries in memory, so
+// it reads at most MAX_MERGE_BYTES; larger segments are not merged again.
+// The count stays near MERGE_FANIN per tier plus data / MAX_MERGE_BYTES.
+class SegmentDiskStorage : public DiskStorage
+{
+public:
+    static constexpr size_t MERGE_FANIN = 8;
+    static constexpr size_t MERGE_BASE_BYTES = 1 << 20;    // Upper bound of the smallest tier
+    static constexpr size_t MAX_MERGE_BYTES = 64 << 20;
+
+private:
+    std::string directory;
+    std::vector<std::shared_ptr<const SegmentFile>> segments; // In completion order
+    mutable std::shared_mutex segmentsMutex; // Readers copy the list; flush appends to it
+    std::mutex writeMutex; // Guards segment id allocation and clear()
+    uint64_t nextSegmentId;
+    std::atomic<size_t> diskUsage;
+    std::atomic<size_t> entryCount;
+    SegmentWriter::Caching caching;
+    std::atomic<bool> merging; // A merge job is queued or running
+    std::atomic<bool> stopping;
+    std::unique_ptr<WorkerPool> merger; // Outlives writer, whose callbacks queue merges
+    std::unique_ptr<SegmentWriter> writer; // Last: in-flight writes finish before the rest is destroyed
+
+public:
+    explicit SegmentDiskStorage(const std::string &directory, SegmentWriter::Mode mode = SegmentWriter::Mode::Auto,
+                                SegmentWriter::Caching caching = SegmentWriter::Caching::Buffered);
+    ~SegmentDiskStorage();
+
+    SegmentDiskStorage(const SegmentDiskStorage &) = delete;
+    SegmentDiskStorage &operator=(const SegmentDiskStorage &) = delete;
+
+    void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    // Encodes on the calling thread; several writes can be in flight
+    std::future<void> flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries) override;
+    std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+
+    // Merges per-segment scans; each segment is already sorted
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+    size_t getDiskUsage() const override { return diskUsage; }
+    bool supportsConcurrentRetrieve() const override { return true; }
+
+    size_t getEntryCount() const { return entryCount; }
+    size_t getSegmentCount() const;
+    bool usesIoUring() const { return writer->usesIoUring(); }
+    void clear();
+
+private:
+    std::vector<std::shared_ptr<const SegmentFile>> snapshot() const;
+    std::string segmentPath(uint64_t id) const;
+    std::future<void> submit(const std::vector<std::unique_ptr<HistoryEntry>> &entries);
+    void scheduleMerge();
+    void mergeSegments();
+    // Up to MERGE_FANIN segments of the fullest tier, if it has that many
+    std::vector<std::shared_ptr<const SegmentFile>> pickMerge() const;
+    void merge(const std::vector<std::shared_ptr<const SegmentFile>> &inputs);
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include "history_cursor.hpp"
+#include "segment_writer.hpp"
+#include "mapped_file.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <ctime>
+#include <cstdint>
+
+// One immutable file of timestamp-sorted records packed into fixed-size
+// blocks (a larger record takes several), followed by a footer index holding each block's min/max timestamp
+// and a trailer with the file's counts and bounds. Files are written once
+// under a temporary name, synced and renamed; readers map them read-only.
+//
+// With Caching::Direct the file is not mapped: the footer is read once at
+// open and cursors read READAHEAD_BLOCKS blocks at a time with O_DIRECT
+// into their own aligned buffer, so scans leave the page cache alone. Each
+// read opens the file for itself; no descriptor is held between reads.
+// Mapped cursors instead advise the kernel of the blocks they are about
+// to scan.
+class SegmentFile
+{
+public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t READAHEAD_BLOCKS = 16;
+    // Records over BLOCK_SIZE get a block of their own spanning several slots
+    static constexpr size_t MAX_RECORD_SIZE = UINT32_MAX;
+
+private:
+    struct BlockIndex;
+    class Cursor;
+
+    std::string path;
+    SegmentWriter::Caching caching; // As granted by the file system
+    size_t size;
+    MappedFile mapping; // Empty for direct reads
+    AlignedBuffer tail; // Direct reads: the file from tailOffset to the end
+    size_t tailOffset;
+    const BlockIndex *blocks; // Footer, inside the mapping or tail
+    uint32_t blockCount;
+    uint64_t entryCount;
+    std::time_t minTimestamp;
+    std::time_t maxTimestamp;
+    mutable std::atomic<bool> retired; // Unlink once the last reference is gone
+
+public:
+    // Maps an existing segment, or opens it for direct reads; throws if the
+    // file is not a valid one
+    explicit SegmentFile(const std::string &path, SegmentWriter::Caching caching = SegmentWriter::Caching::Buffered);
+    ~SegmentFile();
+
+    SegmentFile(const SegmentFile &) = delete;
+    SegmentFile &operator=(const SegmentFile &) = delete;
+
+    // File contents for entries already in timestamp order
+    static std::vector<uint8_t> encode(const std::vector<const HistoryEntry *> &sorted);
+    // Writes them as a durable segment at path, on the calling thread
+    static void write(const std::string &path, const std::vector<const HistoryEntry *> &sorted,
+                      SegmentWriter::Caching caching = SegmentWriter::Caching::Buffered);
+
+    // Streams the entries in [start, end]; the cursor keeps the file open
+    static std::unique_ptr<HistoryCursor> openCursor(std::shared_ptr<const SegmentFile> segment,
+                                                     std::time_t start, std::time_t end);
+
+    const std::string &getPath() const { return path; }
+    size_t getSize() const { return size; }
+    SegmentWriter::Caching getCaching() const { return caching; }
+    size_t getEntryCount() const { return entryCount; }
+    std::time_t getMinTimestamp() const { return minTimestamp; }
+    std::time_t getMaxTimestamp() const { return maxTimestamp; }
+    bool overlaps(std::time_t start, std::time_t end) const { return minTimestamp <= end && maxTimestamp >= start; }
+
+    // Deletes the file without breaking cursors that are still reading it
+    void retire() const;
+
+private:
+    size_t firstBlock(std::time_t start) const;
+    // One past the last block that can hold entries <= end
+    size_t endBlock(std::time_t end) const;
+    // BLOCK_SIZE slots taken by the block starting at slot block
+    size_t spanOf(size_t block) const;
+    // File contents at offset, reading the rest of the file in for direct reads
+    const uint8_t *tailAt(size_t offset, int file);
+    void readBlocks(size_t first, size_t count, uint8_t *out) const;
+};
@@ -0,0 +1,103 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <cstdint>
+
+// Writes whole files durably: each file goes to a temporary name, is synced
+// and then renamed into place. On Linux the write and the fsync are
+// submitted to io_uring as linked SQEs, from registered buffers when the
+// file fits one, and up to QUEUE_DEPTH files are in flight while a
+// completion thread finishes them. Without io_uring (other platforms, old
+// kernels, seccomp) or in Synchronous mode, files are written with pwrite
+// and fsync on the calling thread, as are all files once the completion
+// thread has given up on a failing ring. The directory is synced after
+// every rename.
+//
+// With Caching::Direct files are written with O_DIRECT (F_NOCACHE on macOS)
+// so freshly written segments don't push hot pages out of the page cache:
+// data is staged in DIRECT_ALIGNMENT-aligned buffers, written in whole
+// aligned blocks and the file is truncated to its real size before the
+// sync. File systems that refuse O_DIRECT (tmpfs) get buffered writes.
+class SegmentWriter
+{
+public:
+    enum class Mode
+    {
+        Auto,
+        Synchronous
+    };
+
+    enum class Caching
+    {
+        Buffered,
+        Direct
+    };
+
+    static constexpr unsigned QUEUE_DEPTH = 8;
+    static constexpr size_t BUFFER_SIZE = 1024 * 1024; // Per registered buffer
+    static constexpr size_t DIRECT_ALIGNMENT = 4096; // Offsets, lengths and addresses of direct transfers
+
+private:
+    struct Ring;
+    std::unique_ptr<Ring> ring; // nullptr when writing synchronously
+    std::thread completer;
+    Caching caching;
+
+public:
+    explicit SegmentWriter(Mode mode = Mode::Auto, Caching caching = Caching::Buffered);
+    ~SegmentWriter(); // Waits for the files in flight
+
+    SegmentWriter(const SegmentWriter &) = delete;
+    SegmentWriter &operator=(const SegmentWriter &) = delete;
+
+    // Blocks only while QUEUE_DEPTH files are in flight. onDurable runs once
+    // the file is in place, before the future is ready; if it throws, the
+    // future fails.
+    std::future<void> write(const std::string &path, std::vector<uint8_t> data,
+                            std::function<void()> onDurable = nullptr);
+
+    bool usesIoUring() const { return ring != nullptr; }
+    Caching getCaching() const { return caching; }
+
+    // The synchronous path
+    static void writeFile(const std::string &path, const std::vector<uint8_t> &data,
+                          Caching caching = Caching::Buffered);
+    // Makes renames and removals in the file's directory durable
+    static void syncDirectory(const std::string &path);
+#ifndef _WIN32
+    // open(2) that bypasses the page cache when caching is Direct and the file
+    // system allows it; caching is set to what was granted
+    static int openFile(const std::string &path, int flags, Caching &caching);
+#endif
+
+private:
+    std::future<void> writeNow(const std::string &path, std::vector<uint8_t> data, std::function<void()> onDurable);
+    std::future<void> submit(const std::string &path, std::vector<uint8_t> data, std::function<void()> onDurable);
+    void complete(); // Completion thread: reaps CQEs and finishes files
+};
+
+// Heap memory aligned for direct transfers; move-only
+class AlignedBuffer
+{
+private:
+    uint8_t *bytes;
+    size_t length;
+
+public:
+    AlignedBuffer() : bytes(nullptr), length(0) {}
+    explicit AlignedBuffer(size_t size);
+    ~AlignedBuffer();
+
+    AlignedBuffer(AlignedBuffer &&other) noexcept;
+    AlignedBuffer &operator=(AlignedBuffer &&other) noexcept;
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    uint8_t *data() { return bytes; }
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "worker_pool.hpp"
+#include <vector>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <ctime>
+
+// Spreads entries across independent DiskStorages (one SQLite file or
+// segment directory each), so flushes are not capped by a single writer.
+// A batch is split by shard and each part is flushed on that shard's own
+// thread. Reads fan out to the shards in parallel; retrieve() and
+// openCursor() k-way merge the per-shard streams by timestamp.
+//
+// Entries carry no series identity, so placement is by timestamp: either
+// contiguous time slices dealt round-robin (range queries touch few shards)
+// or a hash of the timestamp (even load, every query touches every shard).
+class ShardedDiskStorage : public DiskStorage
+{
+public:
+    enum class Placement
+    {
+        TimeSlice,
+        Hash
+    };
+
+    static constexpr std::time_t DEFAULT_SLICE_SECONDS = 600;
+
+private:
+    struct PendingFlush;
+
+    std::vector<std::unique_ptr<DiskStorage>> shards;
+    Placement placement;
+    std::time_t sliceSeconds;
+    bool concurrentRetrieve; // Every shard supports it
+    // Per shard, encoded entries that a failed batch did store. The next batch
+    // to reach the shard is taken as the retry: it skips each of them once, and
+    // whatever it didn't match is dropped.
+    std::vector<std::multiset<std::vector<uint8_t>>> stored;
+    std::mutex storedMutex;
+    std::unique_ptr<WorkerPool> readers; // Shards that can't read during a flush read on their writer instead
+    std::vector<std::unique_ptr<WorkerPool>> writers; // Last: one thread per shard, drained before the shards go
+
+public:
+    ShardedDiskStorage(std::vector<std::unique_ptr<DiskStorage>> shards, Placement placement = Placement::TimeSlice,
+                       std::time_t sliceSeconds = DEFAULT_SLICE_SECONDS);
+    ~ShardedDiskStorage();
+
+    ShardedDiskStorage(const ShardedDiskStorage &) = delete;
+    ShardedDiskStorage &operator=(const ShardedDiskStorage &) = delete;
+
+    // Waits for every shard. When some shards fail, the parts the others
+    // committed are remembered and skipped when the batch is retried; the
+    // retry must be the next flush, as later ones no longer skip anything.
+    void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    std::future<void> flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries) override;
+    // In timestamp order, unlike most backends
+    std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+    Aggregate aggregate(std::time_t start, std::time_t end) override;
+    size_t getDiskUsage() const override;
+    bool supportsConcurrentRetrieve() const override { return concurrentRetrieve; }
+
+    size_t getShardCount() const { return shards.size(); }
+    DiskStorage &getShard(size_t shard) { return *shards[shard]; }
+    size_t shardFor(std::time_t timestamp) const;
+
+private:
+    // Shards that can hold entries in [start, end]
+    std::vector<size_t> shardsInRange(std::time_t start, std::time_t end) const;
+    // Runs task(shard) for each shard on their threads and rethrows the first failure
+    void forEachShard(const std::vector<size_t> &targets, const std::function<void(size_t)> &task, bool write);
+    // Drops entries a failed batch already stored on the shard and forgets the rest
+    void skipStored(size_t shard, std::vector<std::unique_ptr<HistoryEntry>> &entries,
+                    std::vector<std::vector<uint8_t>> &skipped);
+    void finishFlush(PendingFlush &pending);
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include "history_entry.hpp"
+#include <cstdio>
+#include <ios>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+
+// Append-only overflow file for entries evicted from a full RAM ring.
+// The ingest path appends to it; a merger later peeks batches, writes them
+// to DiskStorage and releases them. The file is truncated once fully drained.
+// Appends are fsynced, so spilled entries survive a host crash as well.
+class SpillFile
+{
+private:
+    std::string path;
+    std::FILE *out;
+    std::streamoff readOffset;
+    std::streamoff writeOffset;
+    size_t pendingCount;
+    size_t spilledCount;
+    mutable std::mutex mutex;
+
+public:
+    SpillFile(const std::string &path);
+    ~SpillFile();
+
+    // Durable once it returns. With sync false the entries are only handed
+    // to the OS and a later sync() makes them durable.
+    void append(const std::vector<std::unique_ptr<HistoryEntry>> &entries, bool sync = true);
+    // Syncs everything appended so far; concurrent appends don't wait for it
+    void sync();
+
+    // Reads up to maxEntries unreleased entries; nextOffset receives the position after them
+    std::vector<std::unique_ptr<HistoryEntry>> peek(size_t maxEntries, std::streamoff &nextOffset) const;
+    void release(std::streamoff nextOffset, size_t count);
+
+    size_t getPendingCount() const;
+    size_t getSpilledCount() const;
+
+private:
+    void openForAppend(bool truncate);
+};
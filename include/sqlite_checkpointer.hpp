@@ -0,0 +1,74 @@
+#pragma once
+#include "sqlite3.h"
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+// Checkpoints a WAL database from its own connection and thread, so flushes
+// never pay for a checkpoint. The writer connection reports WAL growth through
+// a wal_hook; checkpoints are PASSIVE unless the WAL outgrows walSizeLimit,
+// in which case they escalate to RESTART (readers are pinning frames) or
+// TRUNCATE (the file itself is over the limit). Escalations don't wait for
+// readers, since the writer is blocked meanwhile, unless the WAL has grown
+// to twice the limit.
+class SQLiteCheckpointer
+{
+public:
+    struct Stats
+    {
+        size_t passiveCount = 0;
+        size_t restartCount = 0;
+        size_t truncateCount = 0;
+        size_t busyCount = 0; // Escalations that found readers in the way
+        int lastWalFrames = 0;
+        std::chrono::microseconds lastDuration{0};
+        std::chrono::microseconds maxDuration{0};
+    };
+
+private:
+    std::string dbPath;
+    sqlite3 *db;
+    size_t pageSize;
+    std::atomic<size_t> walSizeLimit;
+    std::atomic<int> walPages; // Frames in the WAL as of the last commit, less those checkpointed since
+    std::atomic<size_t> commitCount;
+    std::atomic<size_t> walBytes; // WAL file size: its high-water mark until a TRUNCATE
+    std::chrono::steady_clock::time_point lastEscalation;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    Stats stats;
+
+    // Same threshold SQLite's autocheckpoint uses
+    static constexpr int CHECKPOINT_PAGES = 1000;
+    static constexpr std::chrono::milliseconds CHECKPOINT_INTERVAL{1000};
+    static constexpr std::chrono::milliseconds ESCALATION_INTERVAL{250};
+    static constexpr int ESCALATION_BUSY_TIMEOUT_MS = 100;
+    static constexpr size_t WAL_HEADER_SIZE = 32;
+    static constexpr size_t WAL_FRAME_HEADER_SIZE = 24;
+
+public:
+    SQLiteCheckpointer(const std::string &dbPath, size_t walSizeLimit);
+    ~SQLiteCheckpointer();
+
+    SQLiteCheckpointer(const SQLiteCheckpointer &) = delete;
+    SQLiteCheckpointer &operator=(const SQLiteCheckpointer &) = delete;
+
+    // sqlite3_wal_hook callback for the writer connection
+    static int onWalCommit(void *checkpointer, sqlite3 *db, const char *dbName, int pages);
+
+    void setWalSizeLimit(size_t bytes) { walSizeLimit = bytes; }
+    size_t getWalSizeLimit() const { return walSizeLimit; }
+    // Tracked from commits and checkpoints, without touching the file system
+    size_t getWalSize() const { return walBytes; }
+    Stats getStats();
+
+private:
+    void run();
+    void checkpoint();
+};
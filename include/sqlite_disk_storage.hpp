@@ -1,27 +1,331 @@
 #pragma once
 #include "disk_storage.hpp"
+#include "block_codec.hpp"
+#include "sqlite_reader_pool.hpp"
+#include "sqlite_checkpointer.hpp"
+#include "sqlite_history_modules.hpp"
+#include "worker_pool.hpp"
 #include "sqlite3.h"
 #include <string>
+#include <array>
+#include <map>
+#include <limits>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <vector>
 
 class SQLiteDiskStorage : public DiskStorage
 {
+public:
+    struct DiskUsage
+    {
+        size_t liveBytes = 0; // Pages holding tables and indexes
+        size_t freeBytes = 0; // Freelist pages, reclaimable by compaction
+        size_t walBytes = 0;
+
+        size_t total() const { return liveBytes + freeBytes + walBytes; }
+    };
+
+    class BulkLoader;
+
+    struct RetentionStats
+    {
+        size_t rowsDeleted = 0;
+        size_t chunksDeleted = 0; // Chunks rows, not samples
+        size_t partitionsDropped = 0;
+        size_t bytesReclaimed = 0; // Returned to the file system by incremental vacuum
+    };
+
 private:
-    sqlite3 *db;
-    sqlite3_stmt *insertStmt;
+    // One time window of history: a rows table, a chunks table and the
+    // statements that write them. The base partition (history and
+    // history_chunks) covers all time and is the only one when partitioning
+    // is disabled.
+    struct Partition
+    {
+        std::time_t start;
+        std::time_t end; // inclusive
+        std::string rowsTable;
+        std::string chunksTable;
+        std::unordered_map<size_t, sqlite3_stmt *> insertStmts; // Multi-row INSERTs keyed by row count
+        sqlite3_stmt *selectUnsealedStmt = nullptr;
+        sqlite3_stmt *insertChunkStmt = nullptr;
+        sqlite3_stmt *deleteSealedStmt = nullptr;
+        sqlite3_stmt *selectExpiredStmt = nullptr;
+        sqlite3_stmt *deleteExpiredStmt = nullptr;
+        sqlite3_stmt *deleteExpiredChunksStmt = nullptr;
+        sqlite3_stmt *selectExpiredSpanStmt = nullptr;
+        std::array<size_t, 5> unsealedCounts{}; // Rows per EntryType not yet sealed into chunks
+        int64_t maxChunkSpan = 0; // Widest end_ts - start_ts of its chunks, bounds the chunk seek
+
+        Partition(std::time_t start, std::time_t end, const std::string &rowsTable, const std::string &chunksTable)
+            : start(start), end(end), rowsTable(rowsTable), chunksTable(chunksTable) {}
+        ~Partition();
+
+        bool contains(std::time_t timestamp) const { return timestamp >= start && timestamp <= end; }
+    };
+
+    sqlite3 *db; // Writer connection: the writer thread, and maintenance calls under writerMutex
+    sqlite3_stmt *updateMetaStmt;
     std::string dbPath;
+    int64_t nextSeq; // Tie-breaker for entries sharing a timestamp
+
+    // Table in an older layout whose rows are still waiting to be migrated
+    struct LegacyTable
+    {
+        std::string name;
+        std::string keyColumns; // Migration order
+        std::string seqColumn;
+        std::string typeColumn; // Expression yielding the EntryType code
+    };
+    std::vector<LegacyTable> legacyTables;
+    mutable std::shared_mutex legacyMutex; // Held exclusively while a legacy table is dropped
+
+    // 1: clustered on (timestamp, seq); 2: integer type codes
+    static constexpr int SCHEMA_VERSION = 2;
+    static constexpr size_t MIGRATION_BATCH = 50000;
+
+    size_t insertBatchWidth; // Rows per INSERT statement
+    size_t maxInsertBatchWidth;
+    static constexpr int PARAMS_PER_ROW = 4;
+    static constexpr size_t DEFAULT_INSERT_BATCH_WIDTH = 256;
+
+    // Once a type has chunkSize rows in a partition, its oldest rows are
+    // sealed into one chunks row holding a BlockCodec payload
+    size_t chunkSize;
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 1000;
+    static constexpr size_t MAX_SEALS_PER_FLUSH = 16;
+
+    // Time partitions keyed by start; retention drops whole partitions
+    std::time_t partitionSpan; // 0 disables partitioning
+    std::unique_ptr<Partition> basePartition;
+    std::map<std::time_t, std::unique_ptr<Partition>> partitions;
+
+    // retrieve() runs on pooled read-only connections, so queries proceed
+    // alongside flushes on their own WAL snapshots
+    SQLiteReaderPool readerPool;
+    static constexpr size_t DEFAULT_READER_POOL_SIZE = 4;
+
+    // Checkpoints run on a background thread instead of inside flush()
+    std::unique_ptr<SQLiteCheckpointer> checkpointer;
+    size_t walSizeLimit;
+    static constexpr size_t DEFAULT_WAL_SIZE_LIMIT = 64 * 1024 * 1024;
+
+    // Page statistics refreshed by the writer after each commit, so reporting
+    // disk usage is a few atomic loads rather than file system calls
+    sqlite3_stmt *pageStatsStmt;
+    size_t pageSize;
+    std::atomic<size_t> pageCount;
+    std::atomic<size_t> freelistCount;
+    std::atomic<size_t> walBytes; // Only used without the checkpointer, which tracks its own
+
+    // Rolling retention deletes in small batches, one step per flush, and
+    // hands freed pages back through paced incremental vacuums
+    std::time_t retentionPeriod; // 0 keeps everything
+    bool incrementalVacuum; // auto_vacuum = INCREMENTAL; older files need a VACUUM to convert
+    RetentionStats retentionStats;
+    static constexpr size_t RETENTION_BATCH = 5000;
+    static constexpr int VACUUM_PAGES_PER_STEP = 256;
+
+    std::atomic<BulkLoader *> bulkLoader; // Active bulk load, which owns the open write transaction
+
+    // Flushes are queued to a writer thread that owns the writer connection.
+    // Batches that queue up behind a running commit go into one transaction.
+    struct WriteRequest
+    {
+        std::vector<std::unique_ptr<HistoryEntry>> owned; // flushAsync() takes the batch
+        const std::vector<std::unique_ptr<HistoryEntry>> *entries; // flush() lends it while it waits
+        std::promise<void> done;
+    };
+    std::deque<std::unique_ptr<WriteRequest>> writeQueue;
+    std::mutex writeQueueMutex;
+    std::condition_variable writeQueueCondition;
+    bool stoppingWriter;
+    std::thread writerThread;
+    mutable std::recursive_mutex writerMutex; // Held for each write transaction; maintenance calls nest
+    std::atomic<size_t> writeTransactionCount;
+    static constexpr size_t MAX_COALESCED_ENTRIES = 100000;
+
+    // retrieveAsync() runs on these, one per pooled reader connection
+    std::unique_ptr<WorkerPool> retrieveWorkers;
+    std::once_flag retrieveWorkersStarted;
+
+    // Entries still in front of this storage, exposed to query() as history_ram
+    std::atomic<HotTier *> hotTier;
+    static constexpr size_t MAX_UNION_BRANCHES = 256; // Below SQLite's compound SELECT limit
 
 public:
-    SQLiteDiskStorage(const std::string &dbPath);
+    // partitionSpan (seconds) applies when the file is created; an existing file keeps its own
+    SQLiteDiskStorage(const std::string &dbPath, std::time_t partitionSpan = 0);
     ~SQLiteDiskStorage();
 
+    // Waits for the writer thread to commit the batch
     void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    std::future<void> flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries) override;
     std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+    std::future<std::vector<std::unique_ptr<HistoryEntry>>> retrieveAsync(std::time_t start, std::time_t end) override;
+
+    // Streams from one snapshot without materializing the result. The cursor
+    // holds a pooled reader until it is destroyed.
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+
+    // Pushed down into SQL over rows and into per-chunk pre-aggregates
+    Aggregate aggregate(std::time_t start, std::time_t end) override;
     size_t getDiskUsage() const override;
+    DiskUsage getDiskUsageBreakdown() const;
+    bool supportsConcurrentRetrieve() const override { return true; }
     size_t getEntryCount() const;
+    void setHotTier(HotTier *tier) override { hotTier = tier; }
+
+    // Runs one read-only statement in a single snapshot and calls onRow for
+    // each result row. The statement can use the view
+    // history_all(timestamp, type, value), which is the hot tier, the rows
+    // tables and the decoded chunks together. Call it from the thread that
+    // feeds the hot tier; the tier is read while the statement runs.
+    size_t query(const std::string &sql, const std::function<void(sqlite3_stmt *)> &onRow);
+    size_t getWriteTransactionCount() const { return writeTransactionCount; }
     void clear();
 
+    // Moves up to batchSize rows from an older-layout table into the current
+    // layout. Runs in its own short transaction so it can be interleaved with
+    // flushes and queries; returns true once nothing is left.
+    bool migrateLegacy(size_t batchSize = MIGRATION_BATCH);
+    bool isMigrating() const;
+
+    void setInsertBatchWidth(size_t width);
+    size_t getInsertBatchWidth() const { return insertBatchWidth; }
+
+    // 0 keeps one row per sample
+    void setChunkSize(size_t samples) { chunkSize = samples; }
+    size_t getChunkSize() const { return chunkSize; }
+    size_t getChunkCount() const;
+
+    // Drops every partition that ends before cutoff: a table drop, no row
+    // deletes and no VACUUM. Returns the number of partitions dropped.
+    size_t dropPartitionsBefore(std::time_t cutoff);
+    std::time_t getPartitionSpan() const { return partitionSpan; }
+    size_t getPartitionCount() const;
+
+    void setReaderPoolSize(size_t readers) { readerPool.setMaxReaders(readers); }
+    size_t getReaderPoolSize() const { return readerPool.getMaxReaders(); }
+
+    // false restores SQLite's autocheckpoint inside the committing flush
+    void setBackgroundCheckpointing(bool enabled);
+    bool isBackgroundCheckpointing() const { return checkpointer != nullptr; }
+    void setWalSizeLimit(size_t bytes);
+    size_t getWalSizeLimit() const { return walSizeLimit; }
+    size_t getWalSize() const;
+    SQLiteCheckpointer::Stats getCheckpointStats() const;
+
+    // Keeps the last `seconds` of history by wall clock; every flush then runs
+    // one expireBefore() step. 0 disables retention.
+    void setRetention(std::time_t seconds) { retentionPeriod = seconds; }
+    std::time_t getRetention() const { return retentionPeriod; }
+
+    // One bounded retention step: drops at most one partition ending before
+    // cutoff, deletes up to batchSize older rows and chunks, then vacuums up to
+    // VACUUM_PAGES_PER_STEP free pages. Chunks straddling cutoff are kept.
+    // Returns true once nothing older than cutoff and no free page is left.
+    bool expireBefore(std::time_t cutoff, size_t batchSize = RETENTION_BATCH);
+    const RetentionStats &getRetentionStats() const { return retentionStats; }
+
+    // Starts loading a timestamp-ordered stream straight into chunks, in one
+    // transaction with synchronous = OFF. Nothing is visible until commit();
+    // a loader destroyed without it rolls back. Other writes throw meanwhile.
+    std::unique_ptr<BulkLoader> beginBulkLoad();
+
 private:
+    void execute(const char *sql);
+    int64_t queryInt(const char *sql, int64_t defaultValue) const;
+    void loadLegacyTables();
+    void loadPartitions();
+    void loadUnsealedCounts(Partition &partition);
+    // Reads the partition's chunk span, or computes and stores it when the key is missing
+    void loadChunkSpan(Partition &partition);
+    void recomputeChunkSpan(Partition &partition);
+    void setMeta(const char *key, int64_t value);
     void createTable();
+    void createPartitionTables(const std::string &rowsTable, const std::string &chunksTable);
+    void preparePartition(Partition &partition);
     void prepareStatements();
+    Partition &partitionFor(std::time_t timestamp);
+    std::vector<Partition *> partitionsInRange(std::time_t start, std::time_t end) const;
+    sqlite3_stmt *getInsertStatement(Partition &partition, size_t rows);
+    void bindEntry(Partition &partition, sqlite3_stmt *stmt, int offset, const HistoryEntry *entry);
+    void submitWrite(std::unique_ptr<WriteRequest> request);
+    void runWriter();
+    void writeBatches(std::vector<std::unique_ptr<WriteRequest>> &requests);
+    // Writes requests [first, last) in one transaction; rolls back and rethrows on failure
+    void commitRequests(const std::vector<std::unique_ptr<WriteRequest>> &requests, size_t first, size_t last);
+    void writeEntries(const std::vector<std::unique_ptr<HistoryEntry>> &entries);
+    void insertRows(Partition &partition, const std::vector<std::unique_ptr<HistoryEntry>> &entries, size_t begin, size_t end);
+    void sealChunks();
+    void sealChunk(Partition &partition, EntryType type);
+    void insertChunk(Partition &partition, const ColumnBlock &block, int64_t firstSeq);
+    void createSummaryIndex(const std::string &chunksTable);
+    void dropSummaryIndex(const std::string &chunksTable);
+    void checkWritable(const char *operation) const;
+    static std::string rowsTableName(std::time_t partitionStart);
+    static std::string chunksTableName(std::time_t partitionStart);
+    void openSnapshot(SQLiteReader &reader, std::vector<LegacyTable> &legacy);
+    std::vector<std::time_t> partitionsInSnapshot(SQLiteReader &reader, std::time_t start, std::time_t end);
+    void retrieveRows(SQLiteReader &reader, const std::string &sql, std::time_t start, std::time_t end,
+                      std::vector<std::unique_ptr<HistoryEntry>> &results);
+    void aggregateRows(SQLiteReader &reader, const std::string &sql, std::time_t start, std::time_t end, Aggregate &result);
+    void aggregateTables(SQLiteReader &reader, const std::string &rowsTable, const std::string &chunksTable,
+                         std::time_t start, std::time_t end, Aggregate &result);
+    void retrieveChunks(SQLiteReader &reader, const std::string &chunksTable, std::time_t start, std::time_t end,
+                        std::vector<std::unique_ptr<HistoryEntry>> &results);
+    void updateUnifiedView(SQLiteReader &reader, const std::vector<LegacyTable> &legacy);
     void optimizeConnection();
-};
\ No newline at end of file
+    void refreshDiskUsage();
+    size_t expireRows(Partition &partition, std::time_t cutoff, size_t batchSize);
+    size_t expireChunks(Partition &partition, std::time_t cutoff, size_t batchSize);
+};
+
+// Writes samples as sealed chunks without going through HistoryEntry objects
+// or the rows table. Input must be in timestamp order; summary indexes on
+// tables that start out empty are built once at commit.
+class SQLiteDiskStorage::BulkLoader
+{
+private:
+    SQLiteDiskStorage &storage;
+    std::unique_lock<std::recursive_mutex> writerLock; // Queued flushes wait for the load to finish
+    Partition *partition;
+    std::array<ColumnBlock, 5> blocks; // Indexed by EntryType
+    std::array<int64_t, 5> firstSeqs{};
+    std::vector<std::string> deferredIndexes;
+    std::time_t lastTimestamp;
+    size_t chunkSize;
+    size_t loadedCount;
+    bool active;
+
+public:
+    explicit BulkLoader(SQLiteDiskStorage &storage);
+    ~BulkLoader();
+
+    BulkLoader(const BulkLoader &) = delete;
+    BulkLoader &operator=(const BulkLoader &) = delete;
+
+    void append(std::time_t timestamp, double value);
+    void append(std::time_t timestamp, int value);
+    void append(std::time_t timestamp, bool value);
+    void append(std::time_t timestamp, const std::string &value);
+    void append(const HistoryEntry &entry);
+
+    // Seals the partial chunks, builds deferred indexes and commits atomically
+    void commit();
+    void rollback();
+    size_t getLoadedCount() const { return loadedCount; }
+
+private:
+    ColumnBlock &blockFor(std::time_t timestamp, EntryType type);
+    void sealBlocks();
+    void finish();
+};
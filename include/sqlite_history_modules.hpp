@@ -0,0 +1,15 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "sqlite3.h"
+#include <atomic>
+
+// Eponymous virtual tables that make history SQLite cannot read on its own
+// visible to SQL. Both take timestamp range constraints.
+//   history_ram(timestamp, type, value): the hot tier, in timestamp order
+//   history_chunk_scan(table)(timestamp, type, value): decoded samples of one chunks table
+class SQLiteHistoryModules
+{
+public:
+    // hotTier is read on every scan of history_ram and may be null
+    static void registerModules(sqlite3 *db, const std::atomic<HotTier *> *hotTier);
+};
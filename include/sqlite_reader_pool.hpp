@@ -0,0 +1,83 @@
+#pragma once
+#include "sqlite3.h"
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Read-only connection to a WAL database with its own statement cache.
+// Queries run inside a snapshot so every statement sees the same commit.
+class SQLiteReader
+{
+private:
+    sqlite3 *db;
+    std::unordered_map<std::string, sqlite3_stmt *> statements;
+    static constexpr size_t MAX_CACHED_STATEMENTS = 256;
+
+public:
+    explicit SQLiteReader(const std::string &dbPath);
+    ~SQLiteReader();
+
+    SQLiteReader(const SQLiteReader &) = delete;
+    SQLiteReader &operator=(const SQLiteReader &) = delete;
+
+    void beginSnapshot();
+    void endSnapshot();
+
+    // Cached statement for sql; callers reset it when done
+    sqlite3_stmt *prepare(const std::string &sql);
+    int64_t queryInt(const std::string &sql, int64_t defaultValue);
+    sqlite3 *getHandle() const { return db; }
+
+private:
+    void finalizeStatements();
+};
+
+// Hands out SQLiteReader connections, opening them lazily up to maxReaders.
+// acquire() blocks while every connection is leased.
+class SQLiteReaderPool
+{
+public:
+    class Lease
+    {
+    private:
+        SQLiteReaderPool *pool;
+        std::unique_ptr<SQLiteReader> reader;
+
+    public:
+        Lease(SQLiteReaderPool *pool, std::unique_ptr<SQLiteReader> reader) : pool(pool), reader(std::move(reader)) {}
+        Lease(Lease &&other) = default;
+        Lease &operator=(Lease &&other) = delete;
+        ~Lease();
+
+        SQLiteReader *operator->() const { return reader.get(); }
+        SQLiteReader &operator*() const { return *reader; }
+    };
+
+private:
+    std::string dbPath;
+    size_t maxReaders;
+    size_t openReaders;
+    std::vector<std::unique_ptr<SQLiteReader>> idle;
+    mutable std::mutex mutex;
+    std::condition_variable available;
+    std::function<void(sqlite3 *)> connectionSetup;
+
+public:
+    SQLiteReaderPool(const std::string &dbPath, size_t maxReaders);
+
+    // Runs on each connection as it is opened; set before the first acquire()
+    void setConnectionSetup(std::function<void(sqlite3 *)> setup) { connectionSetup = std::move(setup); }
+
+    Lease acquire();
+
+    void setMaxReaders(size_t readers);
+    size_t getMaxReaders() const;
+    size_t getOpenReaders();
+
+private:
+    void release(std::unique_ptr<SQLiteReader> reader);
+};
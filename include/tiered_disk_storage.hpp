@@ -0,0 +1,132 @@
+#pragma once
+#include "disk_storage.hpp"
+#include "sqlite_disk_storage.hpp"
+#include "archive_file.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Hot/cold composite: recent samples live in a SQLiteDiskStorage, and a
+// background thread moves samples older than the migration age into
+// immutable ArchiveFiles of compressed column blocks. Everything at or
+// before the archive watermark is read from the archive and everything after
+// it from SQLite, so the tiers never overlap; archived rows are then expired
+// from SQLite in bounded retention steps. Late samples at or before the
+// watermark are flushed straight into an archive file of their own; once
+// ARCHIVE_MERGE_FANIN such small files pile up, a migration step merges them.
+class TieredDiskStorage : public DiskStorage
+{
+public:
+    struct MigrationStats
+    {
+        size_t samplesMigrated = 0;
+        size_t samplesLate = 0; // Flushed at or before the watermark
+        size_t archiveFilesWritten = 0;
+        size_t bytesRead = 0;    // Sample bytes read back from SQLite
+        size_t bytesWritten = 0; // Archive bytes
+        size_t migrationSteps = 0;
+    };
+
+    static constexpr std::time_t DEFAULT_MIGRATION_AGE = 7 * 24 * 3600;
+    static constexpr size_t DEFAULT_MIGRATION_BATCH = 100000;
+    static constexpr std::chrono::milliseconds MIGRATION_POLL_INTERVAL{1000};
+    // Archives under a quarter of the migration batch are small
+    static constexpr size_t ARCHIVE_MERGE_FANIN = 8;
+
+private:
+    SQLiteDiskStorage hot;
+    std::string archiveDirectory;
+
+    // Exclusive while the watermark moves or archives are added; flushes and
+    // reads hold it shared, readers until their SQLite snapshot is pinned
+    mutable std::shared_mutex tierMutex;
+    std::vector<std::shared_ptr<const ArchiveFile>> archives; // In creation order
+    std::time_t watermark; // Newest timestamp served by the archive
+    std::atomic<uint64_t> nextArchiveId;
+    MigrationStats stats;
+
+    // Range a migration step is archiving without the lock; flushes that add
+    // rows inside it set windowTouched so the step looks for them
+    bool windowOpen;
+    std::time_t windowStart;
+    std::time_t windowEnd;
+    std::atomic<bool> windowTouched;
+    std::atomic<size_t> archiveBytes;
+    std::atomic<size_t> archivedEntryCount;
+
+    std::atomic<std::time_t> migrationAge; // Seconds, by wall clock; 0 disables migration
+    std::atomic<size_t> migrationBatchSize;
+    std::atomic<size_t> migrationRate; // Bytes per second read plus written; 0 is unpaced
+
+    std::mutex migrateMutex; // One migration step at a time
+    std::thread migrator;
+    std::mutex migratorMutex;
+    std::condition_variable migratorWake;
+    bool stopping;
+
+public:
+    TieredDiskStorage(const std::string &dbPath, const std::string &archiveDirectory);
+    ~TieredDiskStorage();
+
+    TieredDiskStorage(const TieredDiskStorage &) = delete;
+    TieredDiskStorage &operator=(const TieredDiskStorage &) = delete;
+
+    void flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries) override;
+    // Reads the archive on the calling thread while SQLite is read on its pool
+    std::vector<std::unique_ptr<HistoryEntry>> retrieve(std::time_t start, std::time_t end) override;
+    std::unique_ptr<HistoryCursor> openCursor(std::time_t start, std::time_t end) override;
+    Aggregate aggregate(std::time_t start, std::time_t end) override;
+    size_t getDiskUsage() const override { return hot.getDiskUsage() + archiveBytes; }
+    void setHotTier(HotTier *tier) override { hot.setHotTier(tier); }
+    bool supportsConcurrentRetrieve() const override { return true; }
+
+    // Samples older than `seconds` by wall clock move to the archive
+    void setMigrationAge(std::time_t seconds) { migrationAge = seconds; }
+    std::time_t getMigrationAge() const { return migrationAge; }
+    // Samples per archive file written by one step
+    void setMigrationBatchSize(size_t samples);
+    size_t getMigrationBatchSize() const { return migrationBatchSize; }
+    // Paces the background thread; foreground flushes are never throttled
+    void setMigrationRate(size_t bytesPerSecond) { migrationRate = bytesPerSecond; }
+    size_t getMigrationRate() const { return migrationRate; }
+
+    // One bounded step: archives up to the batch size of samples older than
+    // the migration age, then runs one expireBefore() step on SQLite for the
+    // archived rows. Returns true once nothing is left to move or expire.
+    bool migrate();
+
+    std::time_t getWatermark() const;
+    size_t getArchiveFileCount() const;
+    size_t getArchivedEntryCount() const { return archivedEntryCount; }
+    size_t getArchiveSize() const { return archiveBytes; }
+    MigrationStats getMigrationStats() const;
+    SQLiteDiskStorage &getHotStorage() { return hot; }
+    void clear();
+
+private:
+    std::string archivePath(uint64_t id) const;
+    bool migrateStep(size_t &bytesMoved);
+    // Writes sorted entries as a durable archive file; needs no lock
+    std::shared_ptr<const ArchiveFile> writeArchive(const std::vector<const HistoryEntry *> &sorted,
+                                                    std::time_t archivedThrough);
+    // Makes an archive visible and moves the watermark; tierMutex held exclusively
+    void installArchive(const std::shared_ptr<const ArchiveFile> &archive);
+    // First ARCHIVE_MERGE_FANIN small archives, if there are that many
+    std::vector<std::shared_ptr<const ArchiveFile>> pickArchiveMerge() const;
+    // Replaces them with one archive; migrateMutex held
+    void mergeArchives(const std::vector<std::shared_ptr<const ArchiveFile>> &inputs, size_t &bytesMoved);
+    // Tier lock held, shared or exclusive
+    void noteWindowRows(const std::vector<std::unique_ptr<HistoryEntry>> &entries);
+    // Rows in (from, through] that SQLite holds beyond the ones already read
+    std::vector<std::unique_ptr<HistoryEntry>> findArrivals(std::time_t from, std::time_t through,
+                                                            const std::vector<std::unique_ptr<HistoryEntry>> &read);
+    std::vector<std::shared_ptr<const ArchiveFile>> archivesInRange(std::time_t start, std::time_t end) const;
+    void runMigrator();
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+// Fixed set of threads running submitted tasks in FIFO order. The destructor
+// runs whatever is still queued before joining.
+class WorkerPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+public:
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Tasks report their own results and errors, e.g. through a packaged_task
+    void submit(std::function<void()> task);
+
+private:
+    void run();
+};
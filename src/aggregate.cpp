@@ -0,0 +1,47 @@
+#include "aggregate.hpp"
+#include <cmath>
+#include <algorithm>
+
+void Aggregate::merge(const Aggregate &other)
+{
+    count += other.count;
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+}
+
+void Aggregate::add(const HistoryEntry &entry)
+{
+    switch (getEntryType(&entry))
+    {
+    case EntryType::Double:
+        add(static_cast<const TypedHistoryEntry<double> &>(entry).getValue());
+        break;
+    case EntryType::Int:
+        add(static_cast<const TypedHistoryEntry<int> &>(entry).getValue());
+        break;
+    case EntryType::Bool:
+        add(static_cast<const TypedHistoryEntry<bool> &>(entry).getValue() ? 1.0 : 0.0);
+        break;
+    case EntryType::String:
+        break;
+    }
+}
+
+double Aggregate::value(AggregateOp op) const
+{
+    switch (op)
+    {
+    case AggregateOp::Count:
+        return static_cast<double>(count);
+    case AggregateOp::Sum:
+        return sum;
+    case AggregateOp::Min:
+        return count > 0 ? min : NAN;
+    case AggregateOp::Max:
+        return count > 0 ? max : NAN;
+    case AggregateOp::Avg:
+        return count > 0 ? sum / count : NAN;
+    }
+    return NAN;
+}
@@ -0,0 +1,226 @@
+#include "archive_file.hpp"
+#include "record_codec.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+// Footer entry per block. A type's blocks appear in timestamp order, but
+// blocks of different types interleave.
+struct ArchiveFile::BlockIndex
+{
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t count;
+    uint32_t type;
+    uint32_t reserved;
+};
+
+namespace
+{
+    const uint64_t ARCHIVE_MAGIC = 0x3143524154534948; // "HISTARC1"
+    const uint32_t ARCHIVE_VERSION = 1;
+
+    // Last bytes of an archive file
+    struct Trailer
+    {
+        FileTrailer common;
+        int64_t archivedThrough;
+    };
+
+    template <typename T>
+    void append(std::vector<uint8_t> &out, const T &value)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(value));
+    }
+}
+
+// Streams one archive's entries in [start, end] in timestamp order. Each
+// entry type is a lane holding one decoded block; next() takes the lane
+// with the earliest head.
+class ArchiveFile::Cursor : public HistoryCursor
+{
+private:
+    struct Lane
+    {
+        const std::vector<uint32_t> *blocks;
+        size_t nextBlock = 0;
+        ColumnBlock block;
+        size_t position = 0;
+        bool done = false;
+    };
+
+    std::shared_ptr<const ArchiveFile> archive;
+    std::time_t start;
+    std::time_t end;
+    std::vector<Lane> lanes;
+
+public:
+    Cursor(std::shared_ptr<const ArchiveFile> archive, std::time_t start, std::time_t end)
+        : archive(std::move(archive)), start(start), end(end)
+    {
+        for (const auto &blocks : this->archive->typeBlocks)
+        {
+            if (blocks.empty())
+                continue;
+            Lane lane;
+            lane.blocks = &blocks;
+            lane.nextBlock = std::partition_point(blocks.begin(), blocks.end(), [this](uint32_t block)
+                                                  { return this->archive->blocks[block].maxTimestamp < this->start; }) -
+                             blocks.begin();
+            lanes.push_back(std::move(lane));
+        }
+        for (auto &lane : lanes)
+        {
+            advance(lane);
+        }
+    }
+
+    std::unique_ptr<HistoryEntry> next() override
+    {
+        Lane *earliest = nullptr;
+        for (auto &lane : lanes)
+        {
+            if (!lane.done && (!earliest || lane.block.timestamps[lane.position] < earliest->block.timestamps[earliest->position]))
+                earliest = &lane;
+        }
+        if (!earliest)
+            return nullptr;
+
+        auto entry = earliest->block.makeEntry(earliest->position++);
+        advance(*earliest);
+        return entry;
+    }
+
+private:
+    // Moves the lane to its next sample in range, decoding blocks as needed
+    void advance(Lane &lane)
+    {
+        while (!lane.done && lane.position >= lane.block.size())
+        {
+            if (lane.nextBlock >= lane.blocks->size() || archive->blocks[(*lane.blocks)[lane.nextBlock]].minTimestamp > end)
+            {
+                lane.done = true;
+                break;
+            }
+            lane.block = archive->decodeBlock((*lane.blocks)[lane.nextBlock++]);
+            const auto &timestamps = lane.block.timestamps;
+            lane.position = std::lower_bound(timestamps.begin(), timestamps.end(), static_cast<int64_t>(start)) - timestamps.begin();
+        }
+        if (!lane.done && lane.block.timestamps[lane.position] > end)
+            lane.done = true;
+    }
+};
+
+ArchiveFile::ArchiveFile(const std::string &path)
+    : path(path), mapping(path, "archive"), blocks(nullptr), blockCount(0), entryCount(0),
+      minTimestamp(0), maxTimestamp(0), archivedThrough(0)
+{
+    // The footer sits right before the trailer and is 8-byte aligned
+    const size_t size = mapping.size();
+    Trailer trailer{};
+    if (size >= sizeof(Trailer))
+        trailer = loadValue<Trailer>(mapping.data() + size - sizeof(Trailer));
+    const FileTrailer &common = trailer.common;
+    size_t footerBytes = static_cast<size_t>(common.blockCount) * sizeof(BlockIndex);
+    if (size < sizeof(Trailer) || common.magic != ARCHIVE_MAGIC || common.version != ARCHIVE_VERSION ||
+        size - sizeof(Trailer) < footerBytes || (size - sizeof(Trailer) - footerBytes) % alignof(BlockIndex) != 0)
+        throw std::runtime_error("Not a valid archive file: " + path);
+    size_t payloadBytes = size - sizeof(Trailer) - footerBytes;
+    blocks = reinterpret_cast<const BlockIndex *>(mapping.data() + payloadBytes);
+    for (uint32_t i = 0; i < common.blockCount; ++i)
+    {
+        const BlockIndex &block = blocks[i];
+        if (block.offset > payloadBytes || block.bytes > payloadBytes - block.offset ||
+            block.type < static_cast<uint32_t>(EntryType::Double) || block.type > static_cast<uint32_t>(EntryType::String))
+            throw std::runtime_error("Corrupt block index in archive " + path);
+        typeBlocks[block.type].push_back(i);
+    }
+    blockCount = common.blockCount;
+    entryCount = common.entryCount;
+    minTimestamp = common.minTimestamp;
+    maxTimestamp = common.maxTimestamp;
+    archivedThrough = trailer.archivedThrough;
+}
+
+void ArchiveFile::retire() const
+{
+    std::filesystem::remove(path);
+}
+
+std::vector<uint8_t> ArchiveFile::encode(const std::vector<const HistoryEntry *> &sorted, std::time_t archivedThrough)
+{
+    if (sorted.empty())
+        throw std::runtime_error("Can't write an empty archive");
+
+    // Each type fills its own block; a full block is encoded right away
+    std::vector<uint8_t> file;
+    std::vector<BlockIndex> index;
+    std::array<ColumnBlock, 5> pending;
+    auto sealBlock = [&](ColumnBlock &block)
+    {
+        BlockIndex entry{};
+        entry.minTimestamp = block.timestamps.front();
+        entry.maxTimestamp = block.timestamps.back();
+        entry.offset = file.size();
+        entry.count = static_cast<uint32_t>(block.size());
+        entry.type = static_cast<uint32_t>(block.type);
+        BlockCodec::encode(block, file);
+        entry.bytes = static_cast<uint32_t>(file.size() - entry.offset);
+        index.push_back(entry);
+        block.clear();
+    };
+    for (const HistoryEntry *entry : sorted)
+    {
+        EntryType type = getEntryType(entry);
+        ColumnBlock &block = pending[static_cast<size_t>(type)];
+        block.type = type;
+        block.append(entry);
+        if (block.size() >= BLOCK_SAMPLES)
+            sealBlock(block);
+    }
+    for (auto &block : pending)
+    {
+        if (!block.empty())
+            sealBlock(block);
+    }
+
+    file.resize((file.size() + alignof(BlockIndex) - 1) / alignof(BlockIndex) * alignof(BlockIndex), 0);
+    for (const auto &entry : index)
+    {
+        append(file, entry);
+    }
+    Trailer trailer{{ARCHIVE_MAGIC, ARCHIVE_VERSION, static_cast<uint32_t>(index.size()), sorted.size(),
+                     static_cast<int64_t>(sorted.front()->getTimestamp()), static_cast<int64_t>(sorted.back()->getTimestamp())},
+                    static_cast<int64_t>(archivedThrough)};
+    append(file, trailer);
+    return file;
+}
+
+std::unique_ptr<HistoryCursor> ArchiveFile::openCursor(std::shared_ptr<const ArchiveFile> archive,
+                                                       std::time_t start, std::time_t end)
+{
+    return std::make_unique<Cursor>(std::move(archive), start, end);
+}
+
+ColumnBlock ArchiveFile::decodeBlock(uint32_t block) const
+{
+    return BlockCodec::decode(mapping.data() + blocks[block].offset, blocks[block].bytes);
+}
+
+void ArchiveFile::aggregate(std::time_t start, std::time_t end, Aggregate &result) const
+{
+    for (uint32_t i = 0; i < blockCount; ++i)
+    {
+        const BlockIndex &index = blocks[i];
+        if (index.type == static_cast<uint32_t>(EntryType::String) || index.minTimestamp > end || index.maxTimestamp < start)
+            continue;
+        ColumnBlock block = decodeBlock(i);
+        const auto &timestamps = block.timestamps;
+        size_t from = std::lower_bound(timestamps.begin(), timestamps.end(), static_cast<int64_t>(start)) - timestamps.begin();
+        size_t to = std::upper_bound(timestamps.begin(), timestamps.end(), static_cast<int64_t>(end)) - timestamps.begin();
+        block.aggregate(from, to, result);
+    }
+}
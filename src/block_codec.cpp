@@ -0,0 +1,643 @@
+#include "block_codec.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+namespace
+{
+    uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    void putVarint(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    class Reader
+    {
+    private:
+        const uint8_t *data;
+        size_t size;
+        size_t pos = 0;
+
+    public:
+        Reader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+        uint8_t byte()
+        {
+            if (pos >= size)
+                throw std::runtime_error("Truncated block payload");
+            return data[pos++];
+        }
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t b = byte();
+                value |= static_cast<uint64_t>(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return value;
+            }
+            throw std::runtime_error("Malformed varint in block payload");
+        }
+
+        const uint8_t *bytes(size_t count)
+        {
+            if (count > size - pos)
+                throw std::runtime_error("Truncated block payload");
+            const uint8_t *start = data + pos;
+            pos += count;
+            return start;
+        }
+
+        size_t remaining() const { return size - pos; }
+    };
+
+    int countLeadingZeros(uint64_t value)
+    {
+#if defined(__GNUC__)
+        return value == 0 ? 64 : __builtin_clzll(value);
+#else
+        int count = 0;
+        for (uint64_t bit = uint64_t(1) << 63; bit && !(value & bit); bit >>= 1)
+            count++;
+        return count;
+#endif
+    }
+
+    int countTrailingZeros(uint64_t value)
+    {
+#if defined(__GNUC__)
+        return value == 0 ? 64 : __builtin_ctzll(value);
+#else
+        int count = 0;
+        for (uint64_t bit = 1; bit && !(value & bit); bit <<= 1)
+            count++;
+        return count;
+#endif
+    }
+
+    // MSB-first bit stream, flushed a byte at a time
+    class BitWriter
+    {
+    private:
+        std::vector<uint8_t> &out;
+        uint64_t buffer = 0;
+        int pending = 0; // Bits in buffer not yet written, always < 8 between calls
+
+    public:
+        explicit BitWriter(std::vector<uint8_t> &out) : out(out) {}
+
+        void write(uint64_t value, int bits)
+        {
+            if (bits > 32)
+            {
+                write(value >> 32, bits - 32);
+                write(value & 0xffffffffu, 32);
+                return;
+            }
+            buffer = (buffer << bits) | (value & ((uint64_t(1) << bits) - 1));
+            pending += bits;
+            while (pending >= 8)
+            {
+                pending -= 8;
+                out.push_back(static_cast<uint8_t>(buffer >> pending));
+            }
+        }
+
+        void finish()
+        {
+            if (pending > 0)
+                out.push_back(static_cast<uint8_t>(buffer << (8 - pending)));
+            pending = 0;
+        }
+    };
+
+    class BitReader
+    {
+    private:
+        const uint8_t *data;
+        size_t size;
+        size_t pos = 0; // In bits
+
+    public:
+        BitReader(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+        uint64_t read(int bits)
+        {
+            uint64_t value = 0;
+            while (bits > 0)
+            {
+                if (pos >= size * 8)
+                    throw std::runtime_error("Truncated block payload");
+                int available = 8 - static_cast<int>(pos & 7);
+                int take = std::min(available, bits);
+                uint64_t chunk = (data[pos >> 3] >> (available - take)) & ((1u << take) - 1);
+                value = (value << take) | chunk;
+                pos += take;
+                bits -= take;
+            }
+            return value;
+        }
+
+        bool bit() { return read(1) != 0; }
+    };
+
+    // Version 1: zigzag varint deltas, raw doubles, zigzag varint ints,
+    // bit-packed bools and length-prefixed strings
+    void encodeV1(const ColumnBlock &block, std::vector<uint8_t> &out)
+    {
+        int64_t previous = 0;
+        for (int64_t timestamp : block.timestamps)
+        {
+            putVarint(out, zigzag(timestamp - previous));
+            previous = timestamp;
+        }
+
+        switch (block.type)
+        {
+        case EntryType::Double:
+            for (double value : block.doubles)
+            {
+                uint8_t raw[sizeof(double)];
+                std::memcpy(raw, &value, sizeof(double));
+                out.insert(out.end(), raw, raw + sizeof(double));
+            }
+            break;
+        case EntryType::Int:
+            for (int64_t value : block.integers)
+                putVarint(out, zigzag(value));
+            break;
+        case EntryType::Bool:
+            for (size_t i = 0; i < block.integers.size(); i += 8)
+            {
+                uint8_t bits = 0;
+                for (size_t bit = 0; bit < 8 && i + bit < block.integers.size(); ++bit)
+                {
+                    if (block.integers[i + bit])
+                        bits |= static_cast<uint8_t>(1u << bit);
+                }
+                out.push_back(bits);
+            }
+            break;
+        case EntryType::String:
+            for (const auto &value : block.strings)
+            {
+                putVarint(out, value.size());
+                out.insert(out.end(), value.begin(), value.end());
+            }
+            break;
+        }
+    }
+
+    void decodeV1(Reader &reader, size_t count, ColumnBlock &block)
+    {
+        int64_t previous = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            previous += unzigzag(reader.varint());
+            block.timestamps.push_back(previous);
+        }
+
+        switch (block.type)
+        {
+        case EntryType::Double:
+            block.doubles.resize(count);
+            if (count > 0)
+                std::memcpy(block.doubles.data(), reader.bytes(count * sizeof(double)), count * sizeof(double));
+            break;
+        case EntryType::Int:
+            block.integers.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+                block.integers.push_back(unzigzag(reader.varint()));
+            break;
+        case EntryType::Bool:
+        {
+            const uint8_t *bits = reader.bytes((count + 7) / 8);
+            block.integers.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+                block.integers.push_back((bits[i / 8] >> (i % 8)) & 1);
+            break;
+        }
+        case EntryType::String:
+            block.strings.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t length = reader.varint();
+                const uint8_t *bytes = reader.bytes(length);
+                block.strings.emplace_back(reinterpret_cast<const char *>(bytes), length);
+            }
+            break;
+        default:
+            throw std::runtime_error("Unknown type in block payload");
+        }
+    }
+
+    // Bit streams are stored behind their byte length
+    template <typename Encode>
+    void putBitStream(std::vector<uint8_t> &out, Encode encode)
+    {
+        std::vector<uint8_t> stream;
+        BitWriter writer(stream);
+        encode(writer);
+        writer.finish();
+        putVarint(out, stream.size());
+        out.insert(out.end(), stream.begin(), stream.end());
+    }
+
+    BitReader getBitStream(Reader &reader)
+    {
+        size_t length = reader.varint();
+        return BitReader(reader.bytes(length), length);
+    }
+
+    // Delta-of-delta timestamps: '0' for a repeated interval, otherwise a
+    // prefix selecting a 7, 9, 12 or 64-bit zigzag field
+    void encodeTimestamps(const std::vector<int64_t> &timestamps, BitWriter &writer)
+    {
+        uint64_t previous = 0;
+        uint64_t previousDelta = 0;
+        for (size_t i = 0; i < timestamps.size(); ++i)
+        {
+            uint64_t timestamp = static_cast<uint64_t>(timestamps[i]);
+            if (i == 0)
+            {
+                writer.write(timestamp, 64);
+                previous = timestamp;
+                continue;
+            }
+            uint64_t delta = timestamp - previous;
+            uint64_t value = zigzag(static_cast<int64_t>(delta - previousDelta));
+            if (value == 0)
+                writer.write(0, 1);
+            else if (value < (1u << 7))
+                writer.write((0b10u << 7) | value, 9);
+            else if (value < (1u << 9))
+                writer.write((0b110u << 9) | value, 12);
+            else if (value < (1u << 12))
+                writer.write((0b1110u << 12) | value, 16);
+            else
+            {
+                writer.write(0b1111, 4);
+                writer.write(value, 64);
+            }
+            previous = timestamp;
+            previousDelta = delta;
+        }
+    }
+
+    void decodeTimestamps(BitReader &reader, size_t count, std::vector<int64_t> &timestamps)
+    {
+        uint64_t previous = 0;
+        uint64_t previousDelta = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i == 0)
+            {
+                previous = reader.read(64);
+                timestamps.push_back(static_cast<int64_t>(previous));
+                continue;
+            }
+            uint64_t value = 0;
+            if (reader.bit())
+            {
+                if (!reader.bit())
+                    value = reader.read(7);
+                else if (!reader.bit())
+                    value = reader.read(9);
+                else if (!reader.bit())
+                    value = reader.read(12);
+                else
+                    value = reader.read(64);
+            }
+            previousDelta += static_cast<uint64_t>(unzigzag(value));
+            previous += previousDelta;
+            timestamps.push_back(static_cast<int64_t>(previous));
+        }
+    }
+
+    // Gorilla XOR doubles: '0' repeats the previous value, '10' reuses the
+    // previous window of meaningful bits, '11' opens a new window
+    // (5 bits of leading zeros, 6 bits of length, 64 stored as 0)
+    void encodeDoubles(const std::vector<double> &doubles, BitWriter &writer)
+    {
+        uint64_t previous = 0;
+        int leading = -1;
+        int trailing = 0;
+        for (size_t i = 0; i < doubles.size(); ++i)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &doubles[i], sizeof(bits));
+            if (i == 0)
+            {
+                writer.write(bits, 64);
+                previous = bits;
+                continue;
+            }
+            uint64_t xored = bits ^ previous;
+            previous = bits;
+            if (xored == 0)
+            {
+                writer.write(0, 1);
+                continue;
+            }
+            int newLeading = std::min(countLeadingZeros(xored), 31);
+            int newTrailing = countTrailingZeros(xored);
+            if (leading >= 0 && newLeading >= leading && newTrailing >= trailing)
+            {
+                writer.write(0b10, 2);
+                writer.write(xored >> trailing, 64 - leading - trailing);
+            }
+            else
+            {
+                leading = newLeading;
+                trailing = newTrailing;
+                int length = 64 - leading - trailing;
+                writer.write(0b11, 2);
+                writer.write(static_cast<uint64_t>(leading), 5);
+                writer.write(static_cast<uint64_t>(length & 63), 6);
+                writer.write(xored >> trailing, length);
+            }
+        }
+    }
+
+    void decodeDoubles(BitReader &reader, size_t count, std::vector<double> &doubles)
+    {
+        uint64_t previous = 0;
+        int leading = 0;
+        int trailing = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i == 0)
+                previous = reader.read(64);
+            else if (reader.bit())
+            {
+                if (reader.bit())
+                {
+                    leading = static_cast<int>(reader.read(5));
+                    int length = static_cast<int>(reader.read(6));
+                    trailing = 64 - leading - (length == 0 ? 64 : length);
+                    if (trailing < 0)
+                        throw std::runtime_error("Malformed double in block payload");
+                }
+                previous ^= reader.read(64 - leading - trailing) << trailing;
+            }
+            double value;
+            std::memcpy(&value, &previous, sizeof(value));
+            doubles.push_back(value);
+        }
+    }
+
+    const uint8_t STRINGS_PLAIN = 0;
+    const uint8_t STRINGS_DICTIONARY = 1;
+
+    void encodeV2(const ColumnBlock &block, std::vector<uint8_t> &out)
+    {
+        putBitStream(out, [&](BitWriter &writer)
+                     { encodeTimestamps(block.timestamps, writer); });
+
+        switch (block.type)
+        {
+        case EntryType::Double:
+            putBitStream(out, [&](BitWriter &writer)
+                         { encodeDoubles(block.doubles, writer); });
+            break;
+        case EntryType::Int:
+        {
+            int64_t previous = 0;
+            for (int64_t value : block.integers)
+            {
+                putVarint(out, zigzag(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(previous))));
+                previous = value;
+            }
+            break;
+        }
+        case EntryType::Bool:
+            putBitStream(out, [&](BitWriter &writer)
+                         {
+                for (int64_t value : block.integers)
+                    writer.write(value ? 1 : 0, 1); });
+            break;
+        case EntryType::String:
+        {
+            // Dictionary when values repeat enough to pay for it
+            std::unordered_map<std::string, size_t> codes;
+            std::vector<const std::string *> dictionary;
+            for (const auto &value : block.strings)
+            {
+                if (codes.emplace(value, dictionary.size()).second)
+                    dictionary.push_back(&value);
+            }
+            if (dictionary.size() * 2 <= block.strings.size())
+            {
+                out.push_back(STRINGS_DICTIONARY);
+                putVarint(out, dictionary.size());
+                for (const std::string *value : dictionary)
+                {
+                    putVarint(out, value->size());
+                    out.insert(out.end(), value->begin(), value->end());
+                }
+                for (const auto &value : block.strings)
+                    putVarint(out, codes[value]);
+            }
+            else
+            {
+                out.push_back(STRINGS_PLAIN);
+                for (const auto &value : block.strings)
+                {
+                    putVarint(out, value.size());
+                    out.insert(out.end(), value.begin(), value.end());
+                }
+            }
+            break;
+        }
+        }
+    }
+
+    void decodeV2(Reader &reader, size_t count, ColumnBlock &block)
+    {
+        BitReader timestamps = getBitStream(reader);
+        decodeTimestamps(timestamps, count, block.timestamps);
+
+        switch (block.type)
+        {
+        case EntryType::Double:
+        {
+            BitReader doubles = getBitStream(reader);
+            block.doubles.reserve(count);
+            decodeDoubles(doubles, count, block.doubles);
+            break;
+        }
+        case EntryType::Int:
+        {
+            int64_t previous = 0;
+            block.integers.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                previous = static_cast<int64_t>(static_cast<uint64_t>(previous) + static_cast<uint64_t>(unzigzag(reader.varint())));
+                block.integers.push_back(previous);
+            }
+            break;
+        }
+        case EntryType::Bool:
+        {
+            BitReader bits = getBitStream(reader);
+            block.integers.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+                block.integers.push_back(bits.bit() ? 1 : 0);
+            break;
+        }
+        case EntryType::String:
+        {
+            block.strings.reserve(count);
+            uint8_t mode = reader.byte();
+            std::vector<std::string> dictionary;
+            if (mode == STRINGS_DICTIONARY)
+            {
+                size_t size = reader.varint();
+                for (size_t i = 0; i < size; ++i)
+                {
+                    size_t length = reader.varint();
+                    const uint8_t *bytes = reader.bytes(length);
+                    dictionary.emplace_back(reinterpret_cast<const char *>(bytes), length);
+                }
+            }
+            else if (mode != STRINGS_PLAIN)
+                throw std::runtime_error("Unknown string encoding in block payload");
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (mode == STRINGS_DICTIONARY)
+                {
+                    size_t code = reader.varint();
+                    if (code >= dictionary.size())
+                        throw std::runtime_error("Malformed string in block payload");
+                    block.strings.push_back(dictionary[code]);
+                    continue;
+                }
+                size_t length = reader.varint();
+                const uint8_t *bytes = reader.bytes(length);
+                block.strings.emplace_back(reinterpret_cast<const char *>(bytes), length);
+            }
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown type in block payload");
+        }
+    }
+}
+
+void ColumnBlock::append(const HistoryEntry *entry)
+{
+    timestamps.push_back(entry->getTimestamp());
+    switch (type)
+    {
+    case EntryType::Double:
+        doubles.push_back(static_cast<const TypedHistoryEntry<double> *>(entry)->getValue());
+        break;
+    case EntryType::Int:
+        integers.push_back(static_cast<const TypedHistoryEntry<int> *>(entry)->getValue());
+        break;
+    case EntryType::Bool:
+        integers.push_back(static_cast<const TypedHistoryEntry<bool> *>(entry)->getValue() ? 1 : 0);
+        break;
+    case EntryType::String:
+        strings.push_back(static_cast<const TypedHistoryEntry<std::string> *>(entry)->getValue());
+        break;
+    }
+}
+
+std::unique_ptr<HistoryEntry> ColumnBlock::makeEntry(size_t index) const
+{
+    switch (type)
+    {
+    case EntryType::Double:
+        return std::make_unique<TypedHistoryEntry<double>>(timestamps[index], doubles[index]);
+    case EntryType::Int:
+        return std::make_unique<TypedHistoryEntry<int>>(timestamps[index], static_cast<int>(integers[index]));
+    case EntryType::Bool:
+        return std::make_unique<TypedHistoryEntry<bool>>(timestamps[index], integers[index] != 0);
+    case EntryType::String:
+        return std::make_unique<TypedHistoryEntry<std::string>>(timestamps[index], strings[index]);
+    }
+    throw std::runtime_error("Unknown type in block");
+}
+
+void ColumnBlock::aggregate(size_t from, size_t to, Aggregate &result) const
+{
+    switch (type)
+    {
+    case EntryType::Double:
+        for (size_t i = from; i < to; ++i)
+            result.add(doubles[i]);
+        break;
+    case EntryType::Int:
+    case EntryType::Bool:
+        for (size_t i = from; i < to; ++i)
+            result.add(static_cast<double>(integers[i]));
+        break;
+    case EntryType::String:
+        break;
+    }
+}
+
+void ColumnBlock::clear()
+{
+    timestamps.clear();
+    doubles.clear();
+    integers.clear();
+    strings.clear();
+}
+
+// Layout: version, type, count, then the version's column encodings
+void BlockCodec::encode(const ColumnBlock &block, std::vector<uint8_t> &out, uint8_t version)
+{
+    if (version != 1 && version != 2)
+        throw std::runtime_error("Unsupported block format version");
+    out.push_back(version);
+    out.push_back(static_cast<uint8_t>(block.type));
+    putVarint(out, block.size());
+
+    if (version == 1)
+        encodeV1(block, out);
+    else
+        encodeV2(block, out);
+}
+
+ColumnBlock BlockCodec::decode(const uint8_t *data, size_t size)
+{
+    Reader reader(data, size);
+    uint8_t version = reader.byte();
+    if (version != 1 && version != 2)
+        throw std::runtime_error("Unsupported block format version");
+
+    ColumnBlock block(static_cast<EntryType>(reader.byte()));
+    size_t count = reader.varint();
+    // Every entry takes at least a byte (version 1) or a bit (version 2) of
+    // its timestamp, so a corrupt count can't make us reserve unbounded memory
+    size_t limit = version == 1 ? reader.remaining() : reader.remaining() * 8;
+    if (count > limit)
+        throw std::runtime_error("Block entry count exceeds its payload");
+    block.timestamps.reserve(count);
+
+    if (version == 1)
+        decodeV1(reader, count, block);
+    else
+        decodeV2(reader, count, block);
+    return block;
+}
@@ -0,0 +1,76 @@
+#include "history_cursor.hpp"
+#include <algorithm>
+
+bool HistoryCursor::nextBatch(std::vector<std::unique_ptr<HistoryEntry>> &batch, size_t maxEntries)
+{
+    size_t appended = 0;
+    while (appended < maxEntries)
+    {
+        auto entry = next();
+        if (!entry)
+            break;
+        batch.push_back(std::move(entry));
+        appended++;
+    }
+    return appended > 0;
+}
+
+VectorCursor::VectorCursor(std::vector<std::unique_ptr<HistoryEntry>> entries)
+    : entries(std::move(entries)), position(0)
+{
+    std::stable_sort(this->entries.begin(), this->entries.end(),
+                     [](const std::unique_ptr<HistoryEntry> &a, const std::unique_ptr<HistoryEntry> &b)
+                     {
+                         return a->getTimestamp() < b->getTimestamp();
+                     });
+}
+
+std::unique_ptr<HistoryEntry> VectorCursor::next()
+{
+    if (position >= entries.size())
+        return nullptr;
+    return std::move(entries[position++]);
+}
+
+namespace
+{
+    // std::push_heap builds a max-heap, so order by the later timestamp
+    struct LaterHead
+    {
+        template <typename Head>
+        bool operator()(const Head &a, const Head &b) const
+        {
+            return a.entry->getTimestamp() > b.entry->getTimestamp();
+        }
+    };
+}
+
+MergeCursor::MergeCursor(std::vector<std::unique_ptr<HistoryCursor>> inputs)
+    : inputs(std::move(inputs))
+{
+    for (size_t i = 0; i < this->inputs.size(); ++i)
+    {
+        auto entry = this->inputs[i]->next();
+        if (entry)
+            heads.push_back({std::move(entry), i});
+    }
+    std::make_heap(heads.begin(), heads.end(), LaterHead());
+}
+
+std::unique_ptr<HistoryEntry> MergeCursor::next()
+{
+    if (heads.empty())
+        return nullptr;
+
+    std::pop_heap(heads.begin(), heads.end(), LaterHead());
+    Head &earliest = heads.back();
+    std::unique_ptr<HistoryEntry> result = std::move(earliest.entry);
+
+    earliest.entry = inputs[earliest.input]->next();
+    if (earliest.entry)
+        std::push_heap(heads.begin(), heads.end(), LaterHead());
+    else
+        heads.pop_back();
+
+    return result;
+}
@@ -1,4 +1,5 @@
 #include "history_entry.hpp"
+#include <stdexcept>
 
 template class TypedHistoryEntry<double>;
 template class TypedHistoryEntry<int>;
@@ -16,4 +17,17 @@ std::string getEntryTypeName(const HistoryEntry *entry)
     if (dynamic_cast<const TypedHistoryEntry<std::string> *>(entry))
         return "string";
     return "Unknown";
-}
\ No newline at end of file
+}
+
+EntryType getEntryType(const HistoryEntry *entry)
+{
+    if (dynamic_cast<const TypedHistoryEntry<double> *>(entry))
+        return EntryType::Double;
+    if (dynamic_cast<const TypedHistoryEntry<int> *>(entry))
+        return EntryType::Int;
+    if (dynamic_cast<const TypedHistoryEntry<bool> *>(entry))
+        return EntryType::Bool;
+    if (dynamic_cast<const TypedHistoryEntry<std::string> *>(entry))
+        return EntryType::String;
+    throw std::runtime_error("Unknown entry type");
+}
@@ -1,26 +1,82 @@
 #include "history_storage.hpp"
 #include <algorithm>
+#include <iterator>
 #include <stdexcept>
 #include <iostream>
 
 ConcreteHistoryStorage::ConcreteHistoryStorage(size_t ramCapacity, DiskStorage *disk,
-                                               std::chrono::seconds flushInterval, double highWatermark, double lowWatermark)
-    : ramBuffer(ramCapacity),
+                                               std::chrono::seconds flushInterval, double highWatermark, double lowWatermark,
+                                               size_t maxRamCapacity)
+    : ramBuffer(ramCapacity, std::max(ramCapacity, maxRamCapacity), std::max<size_t>(1, ramCapacity / 8)),
       diskStorage(disk),
       lastFlushTime(std::chrono::steady_clock::now()),
+      lastWatermarkFlushTime(lastFlushTime),
       entriesSinceLastFlush(0),
       FLUSH_INTERVAL(flushInterval),
       totalFlushCount(0),
       HIGH_WATERMARK(highWatermark),
-      LOW_WATERMARK(lowWatermark)
+      LOW_WATERMARK(lowWatermark),
+      stopSpillMerger(false),
+      evictedCount(0),
+      mergedCount(0),
+      pendingFlushCount(0),
+      failedFlushAttempts(0),
+      totalFailedFlushCount(0)
 {
+    diskStorage->setHotTier(this);
 }
 
-void ConcreteHistoryStorage::store(std::unique_ptr<HistoryEntry> entry)
+ConcreteHistoryStorage::~ConcreteHistoryStorage()
 {
-    if (isRamBufferNearlyFull())
+    diskStorage->setHotTier(nullptr);
+    awaitFlush();
+    if (spillMerger.joinable())
     {
-        flush();
+        {
+            std::lock_guard<std::mutex> lock(spillMutex);
+            stopSpillMerger = true;
+        }
+        spillCondition.notify_all();
+        spillMerger.join();
+
+        try
+        {
+            mergeSpill();
+        }
+        catch (const std::exception &e)
+        {
+            // Entries stay in the spill file and are recovered on the next start
+            std::cerr << "Final spill merge failed: " << e.what() << std::endl;
+        }
+    }
+}
+
+void ConcreteHistoryStorage::enableSpill(const std::string &spillPath)
+{
+    if (spillFile)
+        throw std::runtime_error("Spill path already enabled");
+
+    spillFile = std::make_unique<SpillFile>(spillPath);
+    spillMerger = std::thread(&ConcreteHistoryStorage::runSpillMerger, this);
+}
+
+void ConcreteHistoryStorage::store(std::unique_ptr<HistoryEntry> &&entry)
+{
+    completeFlush(false);
+    if (isRamBufferNearlyFull() && !isFlushPending())
+    {
+        // While a burst lasts, take another segment so the eventual flush is one large batch
+        if (!(isBurst() && ramBuffer.grow()))
+        {
+            startFlush();
+            lastWatermarkFlushTime = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Make room before taking entry, so a failed eviction leaves it with the caller
+    if (ramBuffer.isFull())
+    {
+        evictOldestSegment();
     }
 
     ramBuffer.push(std::move(entry));
@@ -29,7 +85,7 @@ void ConcreteHistoryStorage::store(std::unique_ptr<HistoryEntry> entry)
     auto now = std::chrono::steady_clock::now();
     if (now - lastFlushTime >= FLUSH_INTERVAL)
     {
-        flush();
+        startFlush();
         lastFlushTime = now;
         entriesSinceLastFlush = 0;
     }
@@ -37,59 +93,188 @@ void ConcreteHistoryStorage::store(std::unique_ptr<HistoryEntry> entry)
     if (entriesSinceLastFlush % 100 == 0) // Print basic info every 100 entries
     {
         std::cout << "Stored " << entriesSinceLastFlush << " entries (RAM fill ratio: "
-                  << static_cast<double>(ramBuffer.getSize()) / ramBuffer.getCapacity()
+                  << static_cast<double>(ramBuffer.getSize()) / ramBuffer.getNominalCapacity()
                   << ")" << std::endl;
     }
 }
 
 std::vector<std::unique_ptr<HistoryEntry>> ConcreteHistoryStorage::retrieve(std::time_t start, std::time_t end)
 {
+    auto byTimestamp = [](const std::unique_ptr<HistoryEntry> &a, const std::unique_ptr<HistoryEntry> &b)
+    {
+        return a->getTimestamp() < b->getTimestamp();
+    };
+
+    awaitFlush(); // An entry must not be in the ring and on disk at once
     auto ramEntries = retrieveFromRAM(start, end);
-    auto diskEntries = diskStorage->retrieve(start, end);
+    if (spillFile && spillFile->getPendingCount() > 0)
+    {
+        mergeSpill(); // Spilled entries must be visible to the query
+    }
+    std::vector<std::unique_ptr<HistoryEntry>> diskEntries;
+    if (diskStorage->supportsConcurrentRetrieve())
+    {
+        // Sort the RAM entries while the disk query runs
+        auto pending = diskStorage->retrieveAsync(start, end);
+        std::sort(ramEntries.begin(), ramEntries.end(), byTimestamp);
+        diskEntries = pending.get();
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock(diskMutex);
+            diskEntries = diskStorage->retrieve(start, end);
+        }
+        std::sort(ramEntries.begin(), ramEntries.end(), byTimestamp);
+    }
+    std::sort(diskEntries.begin(), diskEntries.end(), byTimestamp);
 
     std::vector<std::unique_ptr<HistoryEntry>> allEntries;
     allEntries.reserve(ramEntries.size() + diskEntries.size());
+    std::merge(std::make_move_iterator(ramEntries.begin()), std::make_move_iterator(ramEntries.end()),
+               std::make_move_iterator(diskEntries.begin()), std::make_move_iterator(diskEntries.end()),
+               std::back_inserter(allEntries), byTimestamp);
+
+    return allEntries;
+}
+
+std::unique_ptr<HistoryCursor> ConcreteHistoryStorage::openCursor(std::time_t start, std::time_t end)
+{
+    awaitFlush();
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    inputs.push_back(std::make_unique<VectorCursor>(retrieveFromRAM(start, end)));
+    if (spillFile && spillFile->getPendingCount() > 0)
+    {
+        mergeSpill();
+    }
 
-    for (auto &entry : ramEntries)
+    // Backends that cannot read alongside flushes materialize in openCursor,
+    // so the lock only needs to cover the call
+    if (diskStorage->supportsConcurrentRetrieve())
     {
-        allEntries.push_back(std::move(entry));
+        inputs.push_back(diskStorage->openCursor(start, end));
     }
-    for (auto &entry : diskEntries)
+    else
     {
-        allEntries.push_back(std::move(entry));
+        std::lock_guard<std::mutex> lock(diskMutex);
+        inputs.push_back(diskStorage->openCursor(start, end));
     }
 
-    std::sort(allEntries.begin(), allEntries.end(),
-              [](const std::unique_ptr<HistoryEntry> &a, const std::unique_ptr<HistoryEntry> &b)
-              {
-                  return a->getTimestamp() < b->getTimestamp();
-              });
+    return std::make_unique<MergeCursor>(std::move(inputs));
+}
 
-    return allEntries;
+double ConcreteHistoryStorage::aggregate(std::time_t start, std::time_t end, AggregateOp op)
+{
+    awaitFlush();
+    Aggregate result;
+    for (size_t i = 0; i < ramBuffer.getSize(); ++i)
+    {
+        const auto &entry = ramBuffer.at(i);
+        if (entry.getTimestamp() >= start && entry.getTimestamp() <= end)
+        {
+            result.add(entry);
+        }
+    }
+
+    if (spillFile && spillFile->getPendingCount() > 0)
+    {
+        mergeSpill();
+    }
+    if (diskStorage->supportsConcurrentRetrieve())
+    {
+        result.merge(diskStorage->aggregate(start, end));
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(diskMutex);
+        result.merge(diskStorage->aggregate(start, end));
+    }
+
+    return result.value(op);
 }
 
 void ConcreteHistoryStorage::flush()
 {
+    // A batch already in flight may cover only part of what is above the watermark now
+    awaitFlush();
+    nextFlushAttempt = {};
+    for (size_t attempt = 1;; ++attempt)
+    {
+        startFlush();
+        if (!pendingFlush.valid())
+            return;
+        awaitFlush();
+        if (failedFlushAttempts == 0)
+            return;
+        if (attempt >= MAX_FLUSH_ATTEMPTS)
+            throw std::runtime_error("Flush failed " + std::to_string(attempt) + " times; entries stay in RAM");
+        std::this_thread::sleep_until(nextFlushAttempt);
+    }
+}
+
+void ConcreteHistoryStorage::startFlush()
+{
+    completeFlush(false);
+    if (isFlushPending())
+        return;
+
     size_t currentSize = ramBuffer.getSize();
-    size_t capacity = ramBuffer.getCapacity();
-    size_t lowWatermarkSize = static_cast<size_t>(capacity * LOW_WATERMARK);
-    size_t entriesaboutToFlush = currentSize > lowWatermarkSize ? currentSize - lowWatermarkSize : 0;
+    size_t lowWatermarkSize = static_cast<size_t>(ramBuffer.getNominalCapacity() * LOW_WATERMARK);
+    size_t count = currentSize > lowWatermarkSize ? currentSize - lowWatermarkSize : 0;
+    if (count == 0)
+        return;
 
-    std::vector<std::unique_ptr<HistoryEntry>> entriesToFlush;
-    for (size_t i = 0; i < entriesaboutToFlush && !ramBuffer.isEmpty(); ++i)
+    // Copies: the ring keeps the entries until the batch is committed
+    std::vector<std::unique_ptr<HistoryEntry>> batch;
+    batch.reserve(count);
+    for (size_t i = 0; i < count; ++i)
     {
-        entriesToFlush.push_back(ramBuffer.pop());
+        batch.push_back(ramBuffer.at(i).clone());
     }
 
-    if (!entriesToFlush.empty())
+    // Backends without a writer thread flush inside flushAsync()
+    std::lock_guard<std::mutex> lock(diskMutex);
+    pendingFlush = diskStorage->flushAsync(std::move(batch));
+    pendingFlushCount = count;
+}
+
+void ConcreteHistoryStorage::completeFlush(bool wait)
+{
+    if (!pendingFlush.valid())
+        return;
+    if (!wait && pendingFlush.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+
+    size_t count = pendingFlushCount;
+    pendingFlushCount = 0;
+    try
     {
-        diskStorage->flush(entriesToFlush);
-        totalFlushCount++;
-        std::cout << "Flushed " << entriesToFlush.size() << " entries (RAM fill ratio before flush: "
-                  << static_cast<double>(currentSize) / capacity
-                  << ", after flush: " << static_cast<double>(ramBuffer.getSize()) / capacity
-                  << ")" << std::endl;
+        pendingFlush.get();
+    }
+    catch (const std::exception &e)
+    {
+        failedFlushAttempts++;
+        totalFailedFlushCount++;
+        auto delay = std::min(MAX_FLUSH_RETRY_DELAY, FLUSH_RETRY_DELAY * (1 << std::min<size_t>(failedFlushAttempts - 1, 10)));
+        nextFlushAttempt = std::chrono::steady_clock::now() + delay;
+        std::cerr << "Flush of " << count << " entries failed (attempt " << failedFlushAttempts
+                  << "), retrying in " << delay.count() << " ms: " << e.what() << std::endl;
+        return;
+    }
+
+    size_t capacity = ramBuffer.getNominalCapacity();
+    size_t sizeBefore = ramBuffer.getSize();
+    for (size_t i = 0; i < count; ++i)
+    {
+        ramBuffer.pop();
     }
+    failedFlushAttempts = 0;
+    nextFlushAttempt = {};
+    totalFlushCount++;
+    std::cout << "Flushed " << count << " entries (RAM fill ratio before release: "
+              << static_cast<double>(sizeBefore) / capacity
+              << ", after release: " << static_cast<double>(ramBuffer.getSize()) / capacity
+              << ")" << std::endl;
 }
 
 size_t ConcreteHistoryStorage::getMemoryUsage() const
@@ -104,6 +289,11 @@ size_t ConcreteHistoryStorage::getMemoryUsage() const
 
 size_t ConcreteHistoryStorage::getDiskUsage() const
 {
+    if (diskStorage->supportsConcurrentRetrieve())
+    {
+        return diskStorage->getDiskUsage();
+    }
+    std::lock_guard<std::mutex> lock(diskMutex);
     return diskStorage->getDiskUsage();
 }
 
@@ -121,6 +311,28 @@ std::vector<std::unique_ptr<HistoryEntry>> ConcreteHistoryStorage::retrieveFromR
     return result;
 }
 
+void ConcreteHistoryStorage::prepareHotScan()
+{
+    // Spilled entries are in neither the ring nor the disk snapshot until
+    // merged, and in-flight ones could be in both
+    awaitFlush();
+    if (spillFile && spillFile->getPendingCount() > 0)
+    {
+        mergeSpill();
+    }
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> ConcreteHistoryStorage::scanHot(std::time_t start, std::time_t end) const
+{
+    auto entries = retrieveFromRAM(start, end);
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::unique_ptr<HistoryEntry> &a, const std::unique_ptr<HistoryEntry> &b)
+                     {
+                         return a->getTimestamp() < b->getTimestamp();
+                     });
+    return entries;
+}
+
 size_t ConcreteHistoryStorage::getInRamCount() const
 {
     return ramBuffer.getSize();
@@ -129,4 +341,99 @@ size_t ConcreteHistoryStorage::getInRamCount() const
 size_t ConcreteHistoryStorage::getFlushCount() const
 {
     return totalFlushCount;
-}
\ No newline at end of file
+}
+
+size_t ConcreteHistoryStorage::getFailedFlushCount() const
+{
+    return totalFailedFlushCount;
+}
+
+size_t ConcreteHistoryStorage::getRamCapacity() const
+{
+    return ramBuffer.getCapacity();
+}
+
+size_t ConcreteHistoryStorage::getEvictedCount() const
+{
+    return evictedCount;
+}
+
+size_t ConcreteHistoryStorage::getSpilledCount() const
+{
+    return spillFile ? spillFile->getSpilledCount() : 0;
+}
+
+size_t ConcreteHistoryStorage::getMergedCount() const
+{
+    return mergedCount;
+}
+
+void ConcreteHistoryStorage::evictOldestSegment()
+{
+    // The in-flight batch covers the oldest entries, and committing it may make room
+    awaitFlush();
+    if (!ramBuffer.isFull())
+        return;
+
+    std::vector<std::unique_ptr<HistoryEntry>> evicted;
+    size_t count = std::min(ramBuffer.getSegmentSize(), ramBuffer.getSize());
+    for (size_t i = 0; i < count; ++i)
+    {
+        evicted.push_back(ramBuffer.at(i).clone());
+    }
+
+    if (spillFile)
+    {
+        spillFile->append(evicted);
+        spillCondition.notify_one();
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(diskMutex);
+        diskStorage->flush(evicted);
+    }
+
+    // Released only once the segment is in the spill file or on disk
+    for (size_t i = 0; i < count; ++i)
+    {
+        ramBuffer.pop();
+    }
+    evictedCount += count;
+}
+
+void ConcreteHistoryStorage::mergeSpill()
+{
+    std::lock_guard<std::mutex> lock(diskMutex);
+    while (true)
+    {
+        std::streamoff nextOffset;
+        auto batch = spillFile->peek(SPILL_MERGE_BATCH, nextOffset);
+        if (batch.empty())
+            break;
+
+        diskStorage->flush(batch);
+        spillFile->release(nextOffset, batch.size());
+        mergedCount += batch.size();
+    }
+}
+
+void ConcreteHistoryStorage::runSpillMerger()
+{
+    std::unique_lock<std::mutex> lock(spillMutex);
+    while (!stopSpillMerger)
+    {
+        spillCondition.wait_for(lock, std::chrono::milliseconds(100),
+                                [this]
+                                { return stopSpillMerger || spillFile->getPendingCount() > 0; });
+        lock.unlock();
+        try
+        {
+            mergeSpill();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Spill merge failed, will retry: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,694 @@
+#include "lsm_disk_storage.hpp"
+#include "record_codec.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    const std::string RUN_PREFIX = "run_";
+    const std::string RUN_EXTENSION = ".seg";
+    const std::string WAL_PREFIX = "wal_";
+    const std::string WAL_EXTENSION = ".log";
+    const std::string MANIFEST_NAME = "MANIFEST";
+    const std::string MANIFEST_HEADER = "lsm 1";
+
+    const std::time_t MIN_TIMESTAMP = std::numeric_limits<std::time_t>::min();
+    const std::time_t MAX_TIMESTAMP = std::numeric_limits<std::time_t>::max();
+
+    // Id from a "<prefix><digits><extension>" file name, or 0 if it is not one
+    uint64_t fileId(const std::filesystem::path &path, const std::string &prefix, const std::string &extension)
+    {
+        std::string name = path.filename().string();
+        if (name.rfind(prefix, 0) != 0 || path.extension() != extension)
+            return 0;
+        try
+        {
+            return std::stoull(name.substr(prefix.size()));
+        }
+        catch (const std::exception &)
+        {
+            return 0;
+        }
+    }
+
+    bool byMinTimestamp(const std::shared_ptr<const SegmentFile> &a, const std::shared_ptr<const SegmentFile> &b)
+    {
+        return a->getMinTimestamp() < b->getMinTimestamp();
+    }
+}
+
+double LsmDiskStorage::Stats::writeAmplification() const
+{
+    return userBytes > 0 ? static_cast<double>(walBytes + flushedBytes + compactedBytes) / userBytes : 0.0;
+}
+
+double LsmDiskStorage::Stats::readFanOut() const
+{
+    return queryCount > 0 ? static_cast<double>(runsProbed) / queryCount : 0.0;
+}
+
+LsmDiskStorage::LsmDiskStorage(const std::string &directory, size_t memtableBytes, SegmentWriter::Caching caching)
+    : directory(directory), memtableBytes(memtableBytes), caching(caching), levels(MAX_LEVELS), nextFileId(1),
+      diskUsage(0), entryCount(0), stopping(false)
+{
+    recover();
+    worker = std::thread(&LsmDiskStorage::run, this);
+}
+
+LsmDiskStorage::~LsmDiskStorage()
+{
+    // Frozen and active memtables stay in their logs and are replayed on open
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+std::string LsmDiskStorage::filePath(const std::string &prefix, uint64_t id, const std::string &extension) const
+{
+    std::string number = std::to_string(id);
+    return (std::filesystem::path(directory) /
+            (prefix + std::string(number.size() < 12 ? 12 - number.size() : 0, '0') + number + extension))
+        .string();
+}
+
+std::unique_ptr<LsmDiskStorage::Memtable> LsmDiskStorage::newMemtable()
+{
+    auto table = std::make_unique<Memtable>();
+    table->id = nextFileId++;
+    table->walPath = filePath(WAL_PREFIX, table->id, WAL_EXTENSION);
+    table->wal = std::make_shared<SpillFile>(table->walPath);
+    return table;
+}
+
+void LsmDiskStorage::recover()
+{
+    std::filesystem::create_directories(directory);
+
+    // The manifest names the live runs and the oldest log not yet in a run
+    std::map<std::string, size_t> manifest;
+    uint64_t oldestLog = 0;
+    std::ifstream in((std::filesystem::path(directory) / MANIFEST_NAME).string());
+    std::string line;
+    if (in && std::getline(in, line) && line == MANIFEST_HEADER)
+    {
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string key, name;
+            fields >> key;
+            if (key == "wal")
+                fields >> oldestLog;
+            else if (fields >> name)
+                manifest[name] = std::stoul(key);
+        }
+    }
+    in.close();
+
+    std::vector<std::pair<uint64_t, std::string>> logs;
+    for (const auto &file : std::filesystem::directory_iterator(directory))
+    {
+        const auto &path = file.path();
+        if (path.extension() == ".tmp")
+        {
+            std::filesystem::remove(path); // A run or manifest that was never completed
+            continue;
+        }
+        if (uint64_t id = fileId(path, RUN_PREFIX, RUN_EXTENSION))
+        {
+            nextFileId = std::max(nextFileId, id + 1);
+            auto live = manifest.find(path.filename().string());
+            if (live == manifest.end() || live->second >= MAX_LEVELS)
+            {
+                std::filesystem::remove(path); // Compaction output or input the manifest no longer lists
+                continue;
+            }
+            try
+            {
+                auto run = std::make_shared<const SegmentFile>(path.string(), caching);
+                diskUsage += run->getSize();
+                entryCount += run->getEntryCount();
+                levels[live->second].push_back(std::move(run));
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Skipping run: " << e.what() << std::endl;
+            }
+        }
+        else if (uint64_t id = fileId(path, WAL_PREFIX, WAL_EXTENSION))
+        {
+            nextFileId = std::max(nextFileId, id + 1);
+            if (id < oldestLog)
+                std::filesystem::remove(path); // Already in a run
+            else
+                logs.emplace_back(id, path.string());
+        }
+    }
+    std::sort(levels[0].begin(), levels[0].end(), [](const Run &a, const Run &b)
+              { return a->getPath() < b->getPath(); });
+    for (size_t level = 1; level < MAX_LEVELS; ++level)
+    {
+        std::sort(levels[level].begin(), levels[level].end(), byMinTimestamp);
+    }
+
+    // Memtables that never reached disk are replayed from their logs into one level-0 run
+    std::sort(logs.begin(), logs.end());
+    std::vector<std::unique_ptr<HistoryEntry>> recovered;
+    for (const auto &[id, path] : logs)
+    {
+        SpillFile log(path);
+        std::streamoff end;
+        for (auto &entry : log.peek(std::numeric_limits<size_t>::max(), end))
+        {
+            recovered.push_back(std::move(entry));
+        }
+    }
+    if (!recovered.empty())
+    {
+        std::stable_sort(recovered.begin(), recovered.end(), [](const auto &a, const auto &b)
+                         { return a->getTimestamp() < b->getTimestamp(); });
+        std::vector<const HistoryEntry *> sorted;
+        for (const auto &entry : recovered)
+        {
+            sorted.push_back(entry.get());
+        }
+        std::string path = filePath(RUN_PREFIX, nextFileId++, RUN_EXTENSION);
+        SegmentFile::write(path, sorted, caching);
+        auto run = std::make_shared<const SegmentFile>(path, caching);
+        diskUsage += run->getSize();
+        entryCount += run->getEntryCount();
+        levels[0].push_back(std::move(run));
+    }
+
+    memtable = newMemtable();
+    writeManifest(manifestText());
+    for (const auto &[id, path] : logs)
+    {
+        std::filesystem::remove(path);
+    }
+
+    if (entryCount > 0)
+    {
+        std::cout << "Opened LSM store with " << entryCount << " entries in " << directory << std::endl;
+    }
+}
+
+void LsmDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (entries.empty())
+        return;
+    // Once in the WAL an entry must reach a run, or the store can't drain or reopen
+    for (const auto &entry : entries)
+    {
+        if (RecordCodec::encodedSize(entry.get()) > SegmentFile::MAX_RECORD_SIZE)
+            throw std::runtime_error("Entry too large for an LSM run");
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (memtable->bytes >= memtableBytes)
+    {
+        // The background thread is behind: wait for it before accepting more
+        if (immutables.size() >= MAX_IMMUTABLE_MEMTABLES)
+        {
+            stats.stallCount++;
+            drained.wait(lock, [this]
+                         { return immutables.size() < MAX_IMMUTABLE_MEMTABLES || !backgroundError.empty(); });
+            if (immutables.size() >= MAX_IMMUTABLE_MEMTABLES)
+                throw std::runtime_error("Can't write memtable: " + backgroundError);
+        }
+        immutables.push_back(std::move(memtable));
+        memtable = newMemtable();
+        wake.notify_one();
+    }
+
+    memtable->wal->append(entries, false);
+    for (const auto &entry : entries)
+    {
+        memtable->bytes += entry->getSize();
+        stats.userBytes += entry->getSize();
+        memtable->entries.emplace(entry->getTimestamp(), entry->clone());
+    }
+    entryCount += entries.size();
+
+    // Readers and other writers don't wait for the disk
+    std::shared_ptr<SpillFile> wal = memtable->wal;
+    lock.unlock();
+    wal->sync();
+}
+
+std::vector<LsmDiskStorage::Run> LsmDiskStorage::collectSources(std::time_t start, std::time_t end,
+                                                                std::vector<std::unique_ptr<HistoryEntry>> &inMemory) const
+{
+    std::vector<std::shared_ptr<Memtable>> frozen;
+    std::vector<Run> runs;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto first = memtable->entries.lower_bound(start);
+        auto last = memtable->entries.upper_bound(end);
+        for (auto it = first; it != last; ++it)
+        {
+            inMemory.push_back(it->second->clone());
+        }
+        frozen.assign(immutables.begin(), immutables.end());
+
+        for (const auto &run : levels[0])
+        {
+            if (run->overlaps(start, end))
+                runs.push_back(run);
+        }
+        // Deeper levels are sorted and disjoint
+        for (size_t level = 1; level < MAX_LEVELS; ++level)
+        {
+            auto it = std::partition_point(levels[level].begin(), levels[level].end(), [start](const Run &run)
+                                           { return run->getMaxTimestamp() < start; });
+            for (; it != levels[level].end() && (*it)->getMinTimestamp() <= end; ++it)
+            {
+                runs.push_back(*it);
+            }
+        }
+
+        stats.queryCount++;
+        stats.runsProbed += runs.size();
+        stats.lastFanOut = runs.size();
+    }
+
+    for (const auto &table : frozen)
+    {
+        auto first = table->entries.lower_bound(start);
+        auto last = table->entries.upper_bound(end);
+        for (auto it = first; it != last; ++it)
+        {
+            inMemory.push_back(it->second->clone());
+        }
+    }
+    return runs;
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> LsmDiskStorage::retrieve(std::time_t start, std::time_t end)
+{
+    std::vector<std::unique_ptr<HistoryEntry>> results;
+    for (const auto &run : collectSources(start, end, results))
+    {
+        auto cursor = SegmentFile::openCursor(run, start, end);
+        while (auto entry = cursor->next())
+        {
+            results.push_back(std::move(entry));
+        }
+    }
+    return results;
+}
+
+std::unique_ptr<HistoryCursor> LsmDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    std::vector<std::unique_ptr<HistoryEntry>> inMemory;
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    for (const auto &run : collectSources(start, end, inMemory))
+    {
+        inputs.push_back(SegmentFile::openCursor(run, start, end));
+    }
+    inputs.push_back(std::make_unique<VectorCursor>(std::move(inMemory)));
+    return std::make_unique<MergeCursor>(std::move(inputs));
+}
+
+void LsmDiskStorage::run()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return stopping || needsWork(); });
+            if (stopping)
+                return;
+        }
+
+        std::string error;
+        try
+        {
+            std::lock_guard<std::mutex> job(jobMutex);
+            std::shared_ptr<Memtable> frozen;
+            Compaction compaction;
+            bool due = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!immutables.empty())
+                    frozen = immutables.front();
+                else
+                    due = pickCompaction(compaction);
+            }
+            if (frozen)
+                flushMemtable(frozen);
+            else if (due)
+                compact(compaction);
+        }
+        catch (const std::exception &e)
+        {
+            error = e.what();
+            std::cerr << "LSM background job failed: " << error << std::endl;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        backgroundError = error;
+        drained.notify_all();
+        if (!error.empty())
+        {
+            wake.wait_for(lock, ERROR_RETRY_DELAY, [this]
+                          { return stopping; });
+        }
+    }
+}
+
+bool LsmDiskStorage::needsWork() const
+{
+    Compaction unused;
+    return !immutables.empty() || pickCompaction(unused);
+}
+
+void LsmDiskStorage::waitForCompactions()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this]
+                 { return !needsWork() || !backgroundError.empty(); });
+}
+
+void LsmDiskStorage::flushMemtable(const std::shared_ptr<Memtable> &frozen)
+{
+    Run run;
+    if (!frozen->entries.empty())
+    {
+        std::vector<const HistoryEntry *> sorted;
+        sorted.reserve(frozen->entries.size());
+        for (const auto &[timestamp, entry] : frozen->entries)
+        {
+            sorted.push_back(entry.get());
+        }
+        uint64_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            id = nextFileId++;
+        }
+        std::string path = filePath(RUN_PREFIX, id, RUN_EXTENSION);
+        SegmentFile::write(path, sorted, caching);
+        run = std::make_shared<const SegmentFile>(path, caching);
+    }
+
+    // The run replaces the memtable for readers in one step
+    std::string manifest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (run)
+        {
+            levels[0].push_back(run);
+            stats.flushedBytes += run->getSize();
+            diskUsage += run->getSize();
+        }
+        std::error_code error;
+        auto walSize = std::filesystem::file_size(frozen->walPath, error);
+        stats.walBytes += error ? 0 : static_cast<size_t>(walSize);
+        immutables.pop_front();
+        manifest = manifestText();
+    }
+    writeManifest(manifest);
+    frozen->wal.reset();
+    std::filesystem::remove(frozen->walPath);
+}
+
+size_t LsmDiskStorage::levelBytes(size_t level) const
+{
+    size_t bytes = 0;
+    for (const auto &run : levels[level])
+    {
+        bytes += run->getSize();
+    }
+    return bytes;
+}
+
+size_t LsmDiskStorage::levelLimit(size_t level) const
+{
+    size_t limit = memtableBytes * L0_COMPACTION_TRIGGER;
+    for (size_t i = 1; i < level; ++i)
+    {
+        limit *= LEVEL_SIZE_RATIO;
+    }
+    return limit;
+}
+
+bool LsmDiskStorage::pickCompaction(Compaction &job) const
+{
+    if (levels[0].size() >= L0_COMPACTION_TRIGGER)
+    {
+        job.level = 0;
+        job.inputs = levels[0];
+        std::time_t start = MAX_TIMESTAMP;
+        std::time_t end = MIN_TIMESTAMP;
+        for (const auto &run : job.inputs)
+        {
+            start = std::min(start, run->getMinTimestamp());
+            end = std::max(end, run->getMaxTimestamp());
+        }
+        for (const auto &run : levels[1])
+        {
+            if (run->overlaps(start, end))
+                job.overlapping.push_back(run);
+        }
+
+        // In-order data gives disjoint level-0 runs, which can move down as they are
+        if (job.overlapping.empty())
+        {
+            std::vector<Run> sorted = job.inputs;
+            std::sort(sorted.begin(), sorted.end(), byMinTimestamp);
+            job.trivialMove = true;
+            for (size_t i = 1; i < sorted.size(); ++i)
+            {
+                if (sorted[i]->getMinTimestamp() <= sorted[i - 1]->getMaxTimestamp())
+                    job.trivialMove = false;
+            }
+        }
+        return true;
+    }
+
+    for (size_t level = 1; level + 1 < MAX_LEVELS; ++level)
+    {
+        if (levelBytes(level) <= levelLimit(level))
+            continue;
+
+        // The oldest data sinks first
+        job.level = level;
+        job.inputs = {levels[level].front()};
+        for (const auto &run : levels[level + 1])
+        {
+            if (run->overlaps(job.inputs.front()->getMinTimestamp(), job.inputs.front()->getMaxTimestamp()))
+                job.overlapping.push_back(run);
+        }
+        job.trivialMove = job.overlapping.empty();
+        return true;
+    }
+    return false;
+}
+
+void LsmDiskStorage::compact(const Compaction &job)
+{
+    std::vector<Run> outputs;
+    size_t writtenBytes = 0;
+    if (job.trivialMove)
+    {
+        outputs = job.inputs;
+    }
+    else
+    {
+        std::vector<std::unique_ptr<HistoryCursor>> inputs;
+        for (const auto *runs : {&job.inputs, &job.overlapping})
+        {
+            for (const auto &run : *runs)
+            {
+                inputs.push_back(SegmentFile::openCursor(run, MIN_TIMESTAMP, MAX_TIMESTAMP));
+            }
+        }
+        MergeCursor merged(std::move(inputs));
+
+        // Output runs are cut between distinct timestamps so they never overlap
+        std::vector<std::unique_ptr<HistoryEntry>> pending;
+        size_t pendingBytes = 0;
+        auto writeRun = [&]
+        {
+            std::vector<const HistoryEntry *> sorted;
+            sorted.reserve(pending.size());
+            for (const auto &entry : pending)
+            {
+                sorted.push_back(entry.get());
+            }
+            uint64_t id;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                id = nextFileId++;
+            }
+            std::string path = filePath(RUN_PREFIX, id, RUN_EXTENSION);
+            SegmentFile::write(path, sorted, caching);
+            outputs.push_back(std::make_shared<const SegmentFile>(path, caching));
+            writtenBytes += outputs.back()->getSize();
+            pending.clear();
+            pendingBytes = 0;
+        };
+        try
+        {
+            while (auto entry = merged.next())
+            {
+                if (pendingBytes >= memtableBytes && entry->getTimestamp() != pending.back()->getTimestamp())
+                    writeRun();
+                pendingBytes += entry->getSize();
+                pending.push_back(std::move(entry));
+            }
+            if (!pending.empty())
+                writeRun();
+        }
+        catch (...)
+        {
+            for (const auto &run : outputs)
+            {
+                std::filesystem::remove(run->getPath());
+            }
+            throw;
+        }
+    }
+
+    std::string manifest;
+    size_t removedBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto removeRuns = [](std::vector<Run> &level, const std::vector<Run> &runs)
+        {
+            level.erase(std::remove_if(level.begin(), level.end(), [&runs](const Run &run)
+                                       { return std::find(runs.begin(), runs.end(), run) != runs.end(); }),
+                        level.end());
+        };
+        removeRuns(levels[job.level], job.inputs);
+        removeRuns(levels[job.level + 1], job.overlapping);
+        installRuns(job.level + 1, outputs);
+
+        if (job.trivialMove)
+        {
+            stats.trivialMoveCount++;
+        }
+        else
+        {
+            for (const auto *runs : {&job.inputs, &job.overlapping})
+            {
+                for (const auto &run : *runs)
+                {
+                    removedBytes += run->getSize();
+                }
+            }
+            stats.compactionCount++;
+            stats.compactedBytes += writtenBytes;
+            diskUsage += writtenBytes;
+            diskUsage -= removedBytes;
+        }
+        manifest = manifestText();
+    }
+    writeManifest(manifest);
+
+    if (!job.trivialMove)
+    {
+        for (const auto *runs : {&job.inputs, &job.overlapping})
+        {
+            for (const auto &run : *runs)
+            {
+                run->retire();
+            }
+        }
+    }
+}
+
+void LsmDiskStorage::installRuns(size_t level, const std::vector<Run> &runs)
+{
+    levels[level].insert(levels[level].end(), runs.begin(), runs.end());
+    if (level > 0)
+    {
+        std::sort(levels[level].begin(), levels[level].end(), byMinTimestamp);
+    }
+}
+
+std::string LsmDiskStorage::manifestText() const
+{
+    std::ostringstream text;
+    text << MANIFEST_HEADER << "\n";
+    text << "wal " << (immutables.empty() ? memtable->id : immutables.front()->id) << "\n";
+    for (size_t level = 0; level < MAX_LEVELS; ++level)
+    {
+        for (const auto &run : levels[level])
+        {
+            text << level << " " << std::filesystem::path(run->getPath()).filename().string() << "\n";
+        }
+    }
+    return text.str();
+}
+
+void LsmDiskStorage::writeManifest(const std::string &text) const
+{
+    std::string path = (std::filesystem::path(directory) / MANIFEST_NAME).string();
+    SegmentWriter::writeFile(path, std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+LsmDiskStorage::Stats LsmDiskStorage::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    result.runsPerLevel.clear();
+    for (const auto &level : levels)
+    {
+        result.runsPerLevel.push_back(level.size());
+    }
+    while (result.runsPerLevel.size() > 1 && result.runsPerLevel.back() == 0)
+    {
+        result.runsPerLevel.pop_back();
+    }
+    return result;
+}
+
+void LsmDiskStorage::clear()
+{
+    std::lock_guard<std::mutex> job(jobMutex);
+    std::vector<Run> runs;
+    std::vector<std::string> logs;
+    std::string manifest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &level : levels)
+        {
+            runs.insert(runs.end(), level.begin(), level.end());
+            level.clear();
+        }
+        for (auto &table : immutables)
+        {
+            table->wal.reset();
+            logs.push_back(table->walPath);
+        }
+        immutables.clear();
+        memtable->wal.reset();
+        logs.push_back(memtable->walPath);
+        memtable = newMemtable();
+
+        stats = Stats{};
+        diskUsage = 0;
+        entryCount = 0;
+        manifest = manifestText();
+    }
+    writeManifest(manifest);
+    for (const auto &run : runs)
+    {
+        run->retire();
+    }
+    for (const auto &log : logs)
+    {
+        std::filesystem::remove(log);
+    }
+    drained.notify_all();
+    std::cout << "LSM store cleared." << std::endl;
+}
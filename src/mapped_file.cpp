@@ -0,0 +1,103 @@
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path, const std::string &kind)
+    : bytes(nullptr), length(0)
+{
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Can't open " + kind + " " + path + ": " + std::strerror(errno));
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Can't stat " + kind + " " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if (length > 0)
+    {
+        void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Can't map " + kind + " " + path + ": " + std::strerror(errno));
+        }
+        bytes = static_cast<const uint8_t *>(mapped);
+    }
+    ::close(fd); // The mapping keeps the file open
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in)
+        throw std::runtime_error("Can't open " + kind + " " + path);
+    length = static_cast<size_t>(in.tellg());
+    buffer.resize(length);
+    in.seekg(0);
+    in.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(length));
+    bytes = buffer.data();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : bytes(other.bytes), length(other.length)
+#ifdef _WIN32
+      , buffer(std::move(other.buffer))
+#endif
+{
+    other.bytes = nullptr;
+    other.length = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        bytes = other.bytes;
+        length = other.length;
+#ifdef _WIN32
+        buffer = std::move(other.buffer);
+#endif
+        other.bytes = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+#ifndef _WIN32
+    if (bytes)
+        ::munmap(const_cast<uint8_t *>(bytes), length);
+#endif
+    bytes = nullptr;
+}
+
+void MappedFile::adviseWillNeed(size_t offset, size_t count) const
+{
+#ifndef _WIN32
+    static const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t from = offset / pageSize * pageSize;
+    size_t to = std::min(length, offset + count);
+    if (bytes && to > from)
+        ::madvise(const_cast<uint8_t *>(bytes) + from, to - from, MADV_WILLNEED);
+#else
+    (void)offset;
+    (void)count;
+#endif
+}
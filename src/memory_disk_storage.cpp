@@ -0,0 +1,261 @@
+#include "memory_disk_storage.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <stdexcept>
+
+namespace
+{
+    // Below this many draws the sum is drawn exactly
+    const size_t EXACT_DRAW_LIMIT = 32;
+
+    double toDouble(std::chrono::nanoseconds duration)
+    {
+        return static_cast<double>(duration.count());
+    }
+}
+
+MemoryDiskStorage::LatencyProfile MemoryDiskStorage::LatencyProfile::ssd()
+{
+    using namespace std::chrono;
+    LatencyProfile profile;
+    profile.perFlush = {Latency::Distribution::Exponential, microseconds(200), nanoseconds(0)};
+    profile.perRowWritten = {Latency::Distribution::Constant, nanoseconds(50), nanoseconds(0)};
+    profile.perRetrieve = {Latency::Distribution::Exponential, microseconds(100), nanoseconds(0)};
+    profile.perRowRead = {Latency::Distribution::Constant, nanoseconds(20), nanoseconds(0)};
+    profile.stallProbability = 0.001;
+    profile.stall = {Latency::Distribution::LogNormal, milliseconds(5), milliseconds(2)};
+    return profile;
+}
+
+MemoryDiskStorage::LatencyProfile MemoryDiskStorage::LatencyProfile::hdd()
+{
+    using namespace std::chrono;
+    LatencyProfile profile;
+    profile.perFlush = {Latency::Distribution::LogNormal, milliseconds(8), milliseconds(4)};
+    profile.perRowWritten = {Latency::Distribution::Constant, nanoseconds(100), nanoseconds(0)};
+    profile.perRetrieve = {Latency::Distribution::LogNormal, milliseconds(6), milliseconds(3)};
+    profile.perRowRead = {Latency::Distribution::Constant, nanoseconds(50), nanoseconds(0)};
+    profile.stallProbability = 0.01;
+    profile.stall = {Latency::Distribution::LogNormal, milliseconds(50), milliseconds(30)};
+    return profile;
+}
+
+MemoryDiskStorage::MemoryDiskStorage(const LatencyProfile &profile, uint64_t seed)
+    : diskUsage(0), profile(profile), random(seed), writer(std::make_unique<WorkerPool>(1))
+{
+}
+
+MemoryDiskStorage::~MemoryDiskStorage() = default;
+
+std::chrono::nanoseconds MemoryDiskStorage::draw(const Latency &latency, size_t count)
+{
+    double mean = toDouble(latency.mean);
+    double spread = toDouble(latency.spread);
+    if (count == 0 || mean <= 0)
+        return std::chrono::nanoseconds(0);
+
+    double stddev = 0;
+    switch (latency.distribution)
+    {
+    case Latency::Distribution::Constant:
+        break;
+    case Latency::Distribution::Uniform:
+        stddev = spread / std::sqrt(3.0);
+        break;
+    case Latency::Distribution::Exponential:
+        stddev = mean;
+        break;
+    case Latency::Distribution::LogNormal:
+        stddev = spread;
+        break;
+    }
+
+    double total = 0;
+    if (stddev == 0)
+    {
+        total = mean * static_cast<double>(count);
+    }
+    else if (count > EXACT_DRAW_LIMIT)
+    {
+        // Sum of many independent draws
+        std::normal_distribution<double> sum(mean * static_cast<double>(count), stddev * std::sqrt(static_cast<double>(count)));
+        total = sum(random);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            switch (latency.distribution)
+            {
+            case Latency::Distribution::Constant:
+                break;
+            case Latency::Distribution::Uniform:
+                total += std::uniform_real_distribution<double>(mean - spread, mean + spread)(random);
+                break;
+            case Latency::Distribution::Exponential:
+                total += std::exponential_distribution<double>(1.0 / mean)(random);
+                break;
+            case Latency::Distribution::LogNormal:
+            {
+                // Parameters of the underlying normal for the requested mean and deviation
+                double sigma2 = std::log(1.0 + (spread * spread) / (mean * mean));
+                total += std::lognormal_distribution<double>(std::log(mean) - sigma2 / 2, std::sqrt(sigma2))(random);
+                break;
+            }
+            }
+        }
+    }
+    return std::chrono::nanoseconds(static_cast<int64_t>(std::max(0.0, total)));
+}
+
+bool MemoryDiskStorage::simulate(Operation operation, size_t rows)
+{
+    std::chrono::nanoseconds delay;
+    bool fails;
+    {
+        std::lock_guard<std::mutex> lock(modelMutex);
+        bool write = operation == Operation::Flush;
+        delay = draw(write ? profile.perFlush : profile.perRetrieve) +
+                draw(write ? profile.perRowWritten : profile.perRowRead, rows);
+        std::uniform_real_distribution<double> chance(0, 1);
+        if (profile.stallProbability > 0 && chance(random) < profile.stallProbability)
+        {
+            delay += draw(profile.stall);
+            stats.stalls++;
+        }
+        double failureRate = write ? profile.flushFailureRate : profile.retrieveFailureRate;
+        fails = failureRate > 0 && chance(random) < failureRate;
+
+        stats.injectedDelay += delay;
+        if (write)
+        {
+            stats.flushes++;
+            if (fails)
+                stats.failedFlushes++;
+            else
+                stats.rowsWritten += rows;
+        }
+        else
+        {
+            stats.retrieves++;
+            if (fails)
+                stats.failedRetrieves++;
+            else
+                stats.rowsRead += rows;
+        }
+    }
+    if (delay.count() > 0)
+        std::this_thread::sleep_for(delay);
+    return !fails;
+}
+
+void MemoryDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (!simulate(Operation::Flush, entries.size()))
+        throw std::runtime_error("Injected flush failure");
+
+    size_t bytes = 0;
+    std::unique_lock<std::shared_mutex> lock(entriesMutex);
+    for (const auto &entry : entries)
+    {
+        bytes += entry->getSize();
+        this->entries.emplace(entry->getTimestamp(), entry->clone());
+    }
+    diskUsage += bytes;
+}
+
+std::future<void> MemoryDiskStorage::flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries)
+{
+    auto batch = std::make_shared<std::vector<std::unique_ptr<HistoryEntry>>>(std::move(entries));
+    auto task = std::make_shared<std::packaged_task<void()>>([this, batch]
+                                                             {
+        if (!simulate(Operation::Flush, batch->size()))
+            throw std::runtime_error("Injected flush failure");
+
+        size_t bytes = 0;
+        std::unique_lock<std::shared_mutex> lock(entriesMutex);
+        for (auto &entry : *batch)
+        {
+            bytes += entry->getSize();
+            this->entries.emplace(entry->getTimestamp(), std::move(entry));
+        }
+        diskUsage += bytes; });
+    auto done = task->get_future();
+    writer->submit([task]
+                   { (*task)(); });
+    return done;
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> MemoryDiskStorage::collect(std::time_t start, std::time_t end) const
+{
+    std::vector<std::unique_ptr<HistoryEntry>> results;
+    std::shared_lock<std::shared_mutex> lock(entriesMutex);
+    for (auto it = entries.lower_bound(start); it != entries.end() && it->first <= end; ++it)
+    {
+        results.push_back(it->second->clone());
+    }
+    return results;
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> MemoryDiskStorage::retrieve(std::time_t start, std::time_t end)
+{
+    auto results = collect(start, end);
+    if (!simulate(Operation::Retrieve, results.size()))
+        throw std::runtime_error("Injected retrieve failure");
+    return results;
+}
+
+std::unique_ptr<HistoryCursor> MemoryDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    // The whole read is paid up front
+    return std::make_unique<VectorCursor>(retrieve(start, end));
+}
+
+Aggregate MemoryDiskStorage::aggregate(std::time_t start, std::time_t end)
+{
+    Aggregate result;
+    size_t rows = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(entriesMutex);
+        for (auto it = entries.lower_bound(start); it != entries.end() && it->first <= end; ++it)
+        {
+            result.add(*it->second);
+            rows++;
+        }
+    }
+    if (!simulate(Operation::Retrieve, rows))
+        throw std::runtime_error("Injected retrieve failure");
+    return result;
+}
+
+void MemoryDiskStorage::setLatencyProfile(const LatencyProfile &profile)
+{
+    std::lock_guard<std::mutex> lock(modelMutex);
+    this->profile = profile;
+}
+
+MemoryDiskStorage::LatencyProfile MemoryDiskStorage::getLatencyProfile() const
+{
+    std::lock_guard<std::mutex> lock(modelMutex);
+    return profile;
+}
+
+MemoryDiskStorage::Stats MemoryDiskStorage::getStats() const
+{
+    std::lock_guard<std::mutex> lock(modelMutex);
+    return stats;
+}
+
+size_t MemoryDiskStorage::getEntryCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(entriesMutex);
+    return entries.size();
+}
+
+void MemoryDiskStorage::clear()
+{
+    std::unique_lock<std::shared_mutex> lock(entriesMutex);
+    entries.clear();
+    diskUsage = 0;
+}
@@ -0,0 +1,53 @@
+#include "merge_log.hpp"
+#include "segment_writer.hpp"
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const std::string LOG_EXTENSION = ".merge";
+
+    std::string logPath(const std::string &output)
+    {
+        return std::filesystem::path(output).replace_extension(LOG_EXTENSION).string();
+    }
+}
+
+void MergeLog::write(const std::string &output, const std::vector<std::string> &inputs)
+{
+    std::string text;
+    for (const auto &input : inputs)
+    {
+        text += std::filesystem::path(input).filename().string() + "\n";
+    }
+    SegmentWriter::writeFile(logPath(output), std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+void MergeLog::finish(const std::string &output)
+{
+    // The removals the log covers must be durable before it goes
+    SegmentWriter::syncDirectory(output);
+    std::filesystem::remove(logPath(output));
+}
+
+void MergeLog::recover(const std::string &directory, const std::string &outputExtension)
+{
+    for (const auto &file : std::filesystem::directory_iterator(directory))
+    {
+        if (file.path().extension() != LOG_EXTENSION)
+            continue;
+        auto output = file.path();
+        if (std::filesystem::exists(output.replace_extension(outputExtension)))
+        {
+            std::ifstream log(file.path());
+            std::string name;
+            while (std::getline(log, name))
+            {
+                if (!name.empty())
+                    std::filesystem::remove(std::filesystem::path(directory) / name);
+            }
+            SegmentWriter::syncDirectory(file.path().string());
+        }
+        std::filesystem::remove(file.path());
+    }
+}
@@ -0,0 +1,96 @@
+#include "record_codec.hpp"
+#include <stdexcept>
+
+namespace
+{
+    template <typename T>
+    void put(std::vector<uint8_t> &out, T value)
+    {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(value));
+    }
+}
+
+size_t RecordCodec::append(const HistoryEntry *entry, std::vector<uint8_t> &out)
+{
+    size_t start = out.size();
+    EntryType type = getEntryType(entry);
+    put<uint8_t>(out, static_cast<uint8_t>(type));
+    put<int64_t>(out, entry->getTimestamp());
+
+    switch (type)
+    {
+    case EntryType::Double:
+        put<double>(out, static_cast<const TypedHistoryEntry<double> *>(entry)->getValue());
+        break;
+    case EntryType::Int:
+        put<int32_t>(out, static_cast<const TypedHistoryEntry<int> *>(entry)->getValue());
+        break;
+    case EntryType::Bool:
+        put<uint8_t>(out, static_cast<const TypedHistoryEntry<bool> *>(entry)->getValue() ? 1 : 0);
+        break;
+    case EntryType::String:
+    {
+        std::string value = static_cast<const TypedHistoryEntry<std::string> *>(entry)->getValue();
+        put<uint32_t>(out, static_cast<uint32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+        break;
+    }
+    }
+    return out.size() - start;
+}
+
+size_t RecordCodec::encodedSize(const HistoryEntry *entry)
+{
+    switch (getEntryType(entry))
+    {
+    case EntryType::Double:
+        return HEADER_SIZE + 8;
+    case EntryType::Int:
+        return HEADER_SIZE + 4;
+    case EntryType::Bool:
+        return HEADER_SIZE + 1;
+    case EntryType::String:
+        return HEADER_SIZE + 4 + static_cast<const TypedHistoryEntry<std::string> *>(entry)->getValue().size();
+    }
+    throw std::runtime_error("Unknown entry type in record");
+}
+
+size_t RecordCodec::size(const uint8_t *record, size_t available)
+{
+    if (available == 0)
+        return 0;
+    switch (static_cast<EntryType>(record[0]))
+    {
+    case EntryType::Double:
+        return HEADER_SIZE + 8;
+    case EntryType::Int:
+        return HEADER_SIZE + 4;
+    case EntryType::Bool:
+        return HEADER_SIZE + 1;
+    case EntryType::String:
+        if (available < HEADER_SIZE + 4)
+            return 0;
+        return HEADER_SIZE + 4 + loadValue<uint32_t>(record + HEADER_SIZE);
+    }
+    throw std::runtime_error("Unknown entry type in record");
+}
+
+std::unique_ptr<HistoryEntry> RecordCodec::decode(const uint8_t *record)
+{
+    std::time_t time = timestamp(record);
+    const uint8_t *value = record + HEADER_SIZE;
+    switch (static_cast<EntryType>(record[0]))
+    {
+    case EntryType::Double:
+        return std::make_unique<TypedHistoryEntry<double>>(time, loadValue<double>(value));
+    case EntryType::Int:
+        return std::make_unique<TypedHistoryEntry<int>>(time, loadValue<int32_t>(value));
+    case EntryType::Bool:
+        return std::make_unique<TypedHistoryEntry<bool>>(time, value[0] != 0);
+    case EntryType::String:
+        return std::make_unique<TypedHistoryEntry<std::string>>(
+            time, std::string(reinterpret_cast<const char *>(value + 4), loadValue<uint32_t>(value)));
+    }
+    throw std::runtime_error("Unknown entry type in record");
+}
@@ -0,0 +1,313 @@
+#include "segment_disk_storage.hpp"
+#include "merge_log.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace
+{
+    const std::string SEGMENT_PREFIX = "segment_";
+    const std::string SEGMENT_EXTENSION = ".seg";
+
+    size_t tierOf(size_t bytes)
+    {
+        size_t tier = 0;
+        for (size_t limit = SegmentDiskStorage::MERGE_BASE_BYTES; bytes >= limit; limit *= SegmentDiskStorage::MERGE_FANIN)
+        {
+            tier++;
+        }
+        return tier;
+    }
+}
+
+SegmentDiskStorage::SegmentDiskStorage(const std::string &directory, SegmentWriter::Mode mode,
+                                       SegmentWriter::Caching caching)
+    : directory(directory), nextSegmentId(1), diskUsage(0), entryCount(0), caching(caching), merging(false),
+      stopping(false), merger(std::make_unique<WorkerPool>(1)), writer(std::make_unique<SegmentWriter>(mode, caching))
+{
+    std::filesystem::create_directories(directory);
+    MergeLog::recover(directory, SEGMENT_EXTENSION);
+
+    std::vector<std::pair<uint64_t, std::string>> found;
+    for (const auto &file : std::filesystem::directory_iterator(directory))
+    {
+        std::string name = file.path().filename().string();
+        if (file.path().extension() == ".tmp")
+        {
+            std::filesystem::remove(file.path()); // A flush that never completed
+            continue;
+        }
+        if (name.rfind(SEGMENT_PREFIX, 0) != 0 || file.path().extension() != SEGMENT_EXTENSION)
+            continue;
+        try
+        {
+            found.emplace_back(std::stoull(name.substr(SEGMENT_PREFIX.size())), file.path().string());
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    for (const auto &[id, path] : found)
+    {
+        nextSegmentId = std::max(nextSegmentId, id + 1);
+        try
+        {
+            auto segment = std::make_shared<const SegmentFile>(path, caching);
+            diskUsage += segment->getSize();
+            entryCount += segment->getEntryCount();
+            segments.push_back(std::move(segment));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping segment: " << e.what() << std::endl;
+        }
+    }
+    if (!segments.empty())
+    {
+        std::cout << "Opened " << segments.size() << " segments (" << entryCount << " entries) in " << directory << std::endl;
+    }
+    scheduleMerge();
+}
+
+SegmentDiskStorage::~SegmentDiskStorage()
+{
+    stopping = true; // Merges queued by the last writes are skipped
+}
+
+std::string SegmentDiskStorage::segmentPath(uint64_t id) const
+{
+    std::string number = std::to_string(id);
+    return (std::filesystem::path(directory) /
+            (SEGMENT_PREFIX + std::string(number.size() < 12 ? 12 - number.size() : 0, '0') + number + SEGMENT_EXTENSION))
+        .string();
+}
+
+void SegmentDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (!entries.empty())
+        submit(entries).get();
+}
+
+std::future<void> SegmentDiskStorage::flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries)
+{
+    if (entries.empty())
+        return DiskStorage::flushAsync(std::move(entries));
+    return submit(entries);
+}
+
+std::future<void> SegmentDiskStorage::submit(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    std::vector<const HistoryEntry *> sorted;
+    sorted.reserve(entries.size());
+    for (const auto &entry : entries)
+    {
+        sorted.push_back(entry.get());
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const HistoryEntry *a, const HistoryEntry *b)
+                     { return a->getTimestamp() < b->getTimestamp(); });
+    std::vector<uint8_t> data = SegmentFile::encode(sorted);
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        path = segmentPath(nextSegmentId++);
+    }
+
+    // Segments become visible once durable, in completion order
+    size_t count = sorted.size();
+    return writer->write(path, std::move(data), [this, path, count]
+                         {
+        auto segment = std::make_shared<const SegmentFile>(path, caching);
+        {
+            std::unique_lock<std::shared_mutex> segmentsLock(segmentsMutex);
+            segments.push_back(segment);
+        }
+        diskUsage += segment->getSize();
+        entryCount += count;
+        scheduleMerge(); });
+}
+
+void SegmentDiskStorage::scheduleMerge()
+{
+    if (!merging.exchange(true))
+        merger->submit([this]
+                       { mergeSegments(); });
+}
+
+void SegmentDiskStorage::mergeSegments()
+{
+    try
+    {
+        while (!stopping)
+        {
+            auto inputs = pickMerge();
+            if (inputs.empty())
+                break;
+            merge(inputs);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Segment merge failed: " << e.what() << std::endl; // The next flush tries again
+        merging = false;
+        return;
+    }
+    merging = false;
+    // A segment may have landed after the last pick
+    if (!stopping && !pickMerge().empty())
+        scheduleMerge();
+}
+
+std::vector<std::shared_ptr<const SegmentFile>> SegmentDiskStorage::pickMerge() const
+{
+    std::vector<std::vector<std::shared_ptr<const SegmentFile>>> tiers;
+    for (const auto &segment : snapshot())
+    {
+        if (segment->getSize() * MERGE_FANIN > MAX_MERGE_BYTES)
+            continue;
+        size_t tier = tierOf(segment->getSize());
+        if (tier >= tiers.size())
+            tiers.resize(tier + 1);
+        tiers[tier].push_back(segment);
+        if (tiers[tier].size() == MERGE_FANIN)
+            return tiers[tier];
+    }
+    return {};
+}
+
+void SegmentDiskStorage::merge(const std::vector<std::shared_ptr<const SegmentFile>> &inputs)
+{
+    std::vector<std::unique_ptr<HistoryCursor>> cursors;
+    std::time_t start = inputs.front()->getMinTimestamp();
+    std::time_t end = inputs.front()->getMaxTimestamp();
+    std::vector<std::string> inputPaths;
+    for (const auto &input : inputs)
+    {
+        start = std::min(start, input->getMinTimestamp());
+        end = std::max(end, input->getMaxTimestamp());
+        inputPaths.push_back(input->getPath());
+    }
+    for (const auto &input : inputs)
+    {
+        cursors.push_back(SegmentFile::openCursor(input, start, end));
+    }
+    MergeCursor merged(std::move(cursors));
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    while (auto entry = merged.next())
+    {
+        entries.push_back(std::move(entry));
+    }
+    std::vector<const HistoryEntry *> sorted;
+    sorted.reserve(entries.size());
+    for (const auto &entry : entries)
+    {
+        sorted.push_back(entry.get());
+    }
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        path = segmentPath(nextSegmentId++);
+    }
+
+    std::shared_ptr<const SegmentFile> segment;
+    bool installed = false;
+    try
+    {
+        MergeLog::write(path, inputPaths);
+        SegmentFile::write(path, sorted, caching);
+        segment = std::make_shared<const SegmentFile>(path, caching);
+
+        std::unique_lock<std::shared_mutex> segmentsLock(segmentsMutex);
+        // clear() may have dropped the inputs meanwhile
+        bool present = std::all_of(inputs.begin(), inputs.end(), [this](const auto &input)
+                                   { return std::find(segments.begin(), segments.end(), input) != segments.end(); });
+        if (present)
+        {
+            segments.erase(std::remove_if(segments.begin(), segments.end(), [&inputs](const auto &candidate)
+                                          { return std::find(inputs.begin(), inputs.end(), candidate) != inputs.end(); }),
+                           segments.end());
+            segments.push_back(segment);
+            for (const auto &input : inputs)
+            {
+                diskUsage -= input->getSize();
+            }
+            diskUsage += segment->getSize();
+            installed = true;
+        }
+    }
+    catch (...)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+        MergeLog::finish(path);
+        throw;
+    }
+
+    if (installed)
+    {
+        for (const auto &input : inputs)
+        {
+            input->retire();
+        }
+    }
+    else
+        segment->retire();
+    MergeLog::finish(path);
+}
+
+std::vector<std::shared_ptr<const SegmentFile>> SegmentDiskStorage::snapshot() const
+{
+    std::shared_lock<std::shared_mutex> lock(segmentsMutex);
+    return segments;
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> SegmentDiskStorage::retrieve(std::time_t start, std::time_t end)
+{
+    std::vector<std::unique_ptr<HistoryEntry>> results;
+    for (const auto &segment : snapshot())
+    {
+        if (!segment->overlaps(start, end))
+            continue;
+        auto cursor = SegmentFile::openCursor(segment, start, end);
+        while (auto entry = cursor->next())
+        {
+            results.push_back(std::move(entry));
+        }
+    }
+    return results;
+}
+
+std::unique_ptr<HistoryCursor> SegmentDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    for (const auto &segment : snapshot())
+    {
+        if (!segment->overlaps(start, end))
+            continue;
+        inputs.push_back(SegmentFile::openCursor(segment, start, end));
+    }
+    return std::make_unique<MergeCursor>(std::move(inputs));
+}
+
+size_t SegmentDiskStorage::getSegmentCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(segmentsMutex);
+    return segments.size();
+}
+
+void SegmentDiskStorage::clear()
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    std::unique_lock<std::shared_mutex> segmentsLock(segmentsMutex);
+    for (const auto &segment : segments)
+    {
+        segment->retire();
+    }
+    segments.clear();
+    diskUsage = 0;
+    entryCount = 0;
+    std::cout << "Segments cleared." << std::endl;
+}
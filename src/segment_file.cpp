@@ -0,0 +1,358 @@
+#include "segment_file.hpp"
+#include "segment_writer.hpp"
+#include "record_codec.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Footer entry per block. Blocks hold whole records in timestamp order,
+// so both bounds are nondecreasing from block to block. A record larger
+// than BLOCK_SIZE gets a block of its own that spans as many BLOCK_SIZE
+// slots as it needs; the slots after the first have entries with count 0
+// and the record's bounds.
+struct SegmentFile::BlockIndex
+{
+    int64_t minTimestamp;
+    int64_t maxTimestamp;
+    uint32_t count;
+    uint32_t bytes;
+};
+
+namespace
+{
+    const uint64_t SEGMENT_MAGIC = 0x3147455354534948; // "HISTSEG1"
+    const uint32_t SEGMENT_VERSION = 2; // 1 had no oversized blocks
+
+    using Trailer = FileTrailer;
+
+#ifndef _WIN32
+    // Reads count bytes at position, fewer only at the end of the file
+    size_t readAt(int fd, uint8_t *buffer, size_t count, size_t position, const std::string &path)
+    {
+        size_t done = 0;
+        while (done < count)
+        {
+            ssize_t n = ::pread(fd, buffer + done, count - done, static_cast<off_t>(position + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::runtime_error("Failed to read segment " + path + ": " + std::strerror(errno));
+            if (n == 0)
+                break;
+            done += static_cast<size_t>(n);
+        }
+        return done;
+    }
+#endif
+}
+
+// Streams one segment's entries in [start, end] in timestamp order, from
+// the first matching block up to the first record past end
+class SegmentFile::Cursor : public HistoryCursor
+{
+private:
+    std::shared_ptr<const SegmentFile> segment;
+    std::time_t start;
+    std::time_t end;
+    size_t block;
+    size_t endBlock;
+    size_t span; // Slots the current block takes
+    const uint8_t *position;
+    const uint8_t *blockEnd;
+    uint32_t remaining; // Records left in the current block
+    bool done;
+    size_t advised;          // Mapped: blocks before this were already advised
+    AlignedBuffer window;    // Direct: blocks read ahead
+    size_t windowFirst;
+    size_t windowCount;
+
+public:
+    Cursor(std::shared_ptr<const SegmentFile> segment, std::time_t start, std::time_t end)
+        : segment(std::move(segment)), start(start), end(end), span(1), position(nullptr), blockEnd(nullptr), remaining(0), done(false),
+          advised(0), windowFirst(0), windowCount(0)
+    {
+        block = this->segment->firstBlock(start);
+        endBlock = this->segment->endBlock(end);
+        enterBlock();
+    }
+
+    std::unique_ptr<HistoryEntry> next() override
+    {
+        while (!done)
+        {
+            if (remaining == 0)
+            {
+                block += span;
+                enterBlock();
+                continue;
+            }
+
+            const uint8_t *record = position;
+            size_t available = static_cast<size_t>(blockEnd - record);
+            size_t size = RecordCodec::size(record, available);
+            if (size == 0 || size > available)
+                throw std::runtime_error("Corrupt block in segment " + segment->path);
+            std::time_t timestamp = RecordCodec::timestamp(record);
+            position += size;
+            remaining--;
+
+            if (timestamp > end)
+                done = true;
+            else if (timestamp >= start)
+                return RecordCodec::decode(record);
+        }
+        return nullptr;
+    }
+
+private:
+    void enterBlock()
+    {
+        if (block >= segment->blockCount || segment->blocks[block].minTimestamp > end)
+        {
+            done = true;
+            return;
+        }
+        remaining = segment->blocks[block].count;
+        span = segment->spanOf(block);
+
+        // Continuation slots share the block's bounds, so endBlock covers them
+        if (segment->mapping.data())
+        {
+            if (block + span > advised)
+            {
+                advised = std::min(block + std::max(span, READAHEAD_BLOCKS), endBlock);
+                segment->mapping.adviseWillNeed(block * BLOCK_SIZE, (advised - block) * BLOCK_SIZE);
+            }
+            position = segment->mapping.data() + block * BLOCK_SIZE;
+            blockEnd = position + span * BLOCK_SIZE;
+            return;
+        }
+        if (block < windowFirst || block + span > windowFirst + windowCount)
+        {
+            windowFirst = block;
+            windowCount = std::min(block + std::max(span, READAHEAD_BLOCKS), endBlock) - block;
+            if (window.size() < windowCount * BLOCK_SIZE)
+                window = AlignedBuffer(std::max(windowCount, READAHEAD_BLOCKS) * BLOCK_SIZE);
+            segment->readBlocks(windowFirst, windowCount, window.data());
+        }
+        position = window.data() + (block - windowFirst) * BLOCK_SIZE;
+        blockEnd = position + span * BLOCK_SIZE;
+    }
+};
+
+SegmentFile::SegmentFile(const std::string &path, SegmentWriter::Caching caching)
+    : path(path), caching(caching), size(0), tailOffset(0), blocks(nullptr), blockCount(0),
+      entryCount(0), minTimestamp(0), maxTimestamp(0), retired(false)
+{
+    int file = -1; // Direct reads: open until the footer is in
+#ifndef _WIN32
+    file = SegmentWriter::openFile(path, O_RDONLY | O_CLOEXEC, this->caching);
+    if (file < 0)
+        throw std::runtime_error("Can't open segment " + path + ": " + std::strerror(errno));
+    struct stat info;
+    if (::fstat(file, &info) != 0)
+    {
+        ::close(file);
+        throw std::runtime_error("Can't stat segment " + path);
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (this->caching == SegmentWriter::Caching::Buffered)
+    {
+        ::close(file);
+        file = -1;
+    }
+#else
+    this->caching = SegmentWriter::Caching::Buffered;
+#endif
+    if (this->caching == SegmentWriter::Caching::Buffered)
+    {
+        mapping = MappedFile(path, "segment");
+        size = mapping.size();
+    }
+
+    Trailer trailer{};
+    try
+    {
+        if (size >= sizeof(Trailer))
+            trailer = loadValue<Trailer>(tailAt(size - sizeof(Trailer), file));
+        if (size < sizeof(Trailer) || trailer.magic != SEGMENT_MAGIC ||
+            trailer.version < 1 || trailer.version > SEGMENT_VERSION ||
+            size != trailer.blockCount * (BLOCK_SIZE + sizeof(BlockIndex)) + sizeof(Trailer))
+            throw std::runtime_error("Not a valid segment file: " + path);
+        blocks = reinterpret_cast<const BlockIndex *>(tailAt(trailer.blockCount * BLOCK_SIZE, file));
+    }
+    catch (...)
+    {
+#ifndef _WIN32
+        if (file >= 0)
+            ::close(file);
+#endif
+        throw;
+    }
+#ifndef _WIN32
+    // Cursors reopen the file for each read, so segments don't hold descriptors
+    if (file >= 0)
+        ::close(file);
+#endif
+    blockCount = trailer.blockCount;
+    entryCount = trailer.entryCount;
+    minTimestamp = trailer.minTimestamp;
+    maxTimestamp = trailer.maxTimestamp;
+}
+
+SegmentFile::~SegmentFile()
+{
+    if (retired && caching == SegmentWriter::Caching::Direct)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+}
+
+void SegmentFile::retire() const
+{
+    // Mapped segments can go right away (see MappedFile); direct cursors
+    // reopen the file and need the name until the last reference is dropped
+    if (caching == SegmentWriter::Caching::Direct)
+        retired = true;
+    else
+        std::filesystem::remove(path);
+}
+
+const uint8_t *SegmentFile::tailAt(size_t offset, int file)
+{
+    if (mapping.data())
+        return mapping.data() + offset;
+#ifndef _WIN32
+    // Small files come in with the trailer read; larger footers need a second read
+    if (tail.size() == 0 || offset < tailOffset)
+    {
+        tailOffset = offset / BLOCK_SIZE * BLOCK_SIZE;
+        tail = AlignedBuffer((size - tailOffset + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE);
+        if (readAt(file, tail.data(), tail.size(), tailOffset, path) != size - tailOffset)
+            throw std::runtime_error("Short read from segment " + path);
+    }
+#else
+    (void)file;
+#endif
+    return tail.data() + (offset - tailOffset);
+}
+
+void SegmentFile::readBlocks(size_t first, size_t count, uint8_t *out) const
+{
+#ifndef _WIN32
+    // One open per READAHEAD_BLOCKS read: descriptors stay bounded by the
+    // reads in progress rather than by the number of segments
+    SegmentWriter::Caching granted = caching;
+    int file = SegmentWriter::openFile(path, O_RDONLY | O_CLOEXEC, granted);
+    if (file < 0)
+        throw std::runtime_error("Can't open segment " + path + ": " + std::strerror(errno));
+    size_t read;
+    try
+    {
+        read = readAt(file, out, count * BLOCK_SIZE, first * BLOCK_SIZE, path);
+    }
+    catch (...)
+    {
+        ::close(file);
+        throw;
+    }
+    ::close(file);
+    if (read != count * BLOCK_SIZE)
+        throw std::runtime_error("Short read from segment " + path);
+#else
+    (void)first;
+    (void)count;
+    (void)out;
+#endif
+}
+
+std::vector<uint8_t> SegmentFile::encode(const std::vector<const HistoryEntry *> &sorted)
+{
+    if (sorted.empty())
+        throw std::runtime_error("Can't write an empty segment");
+
+    // Blocks are filled with whole records and zero padded
+    std::vector<uint8_t> file;
+    std::vector<BlockIndex> index;
+    BlockIndex current{};
+    std::vector<uint8_t> record;
+    auto sealBlock = [&]
+    {
+        size_t span = std::max<size_t>(1, (current.bytes + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        file.resize((index.size() + span) * BLOCK_SIZE, 0);
+        index.push_back(current);
+        index.insert(index.end(), span - 1, BlockIndex{current.minTimestamp, current.maxTimestamp, 0, 0});
+        current = BlockIndex{};
+    };
+    for (const HistoryEntry *entry : sorted)
+    {
+        record.clear();
+        size_t size = RecordCodec::append(entry, record);
+        if (size > MAX_RECORD_SIZE)
+            throw std::runtime_error("Entry too large for a segment record");
+        if (current.count > 0 && current.bytes + size > BLOCK_SIZE)
+            sealBlock();
+        if (current.count == 0)
+            current.minTimestamp = entry->getTimestamp();
+        current.maxTimestamp = entry->getTimestamp();
+        current.count++;
+        file.insert(file.end(), record.begin(), record.end());
+        current.bytes += static_cast<uint32_t>(size);
+        if (size > BLOCK_SIZE)
+            sealBlock(); // Oversized: alone in its block
+    }
+    if (current.count > 0)
+        sealBlock();
+
+    Trailer trailer{SEGMENT_MAGIC, SEGMENT_VERSION, static_cast<uint32_t>(index.size()), sorted.size(),
+                    static_cast<int64_t>(sorted.front()->getTimestamp()), static_cast<int64_t>(sorted.back()->getTimestamp())};
+    const uint8_t *footer = reinterpret_cast<const uint8_t *>(index.data());
+    file.insert(file.end(), footer, footer + index.size() * sizeof(BlockIndex));
+    const uint8_t *tail = reinterpret_cast<const uint8_t *>(&trailer);
+    file.insert(file.end(), tail, tail + sizeof(trailer));
+
+    return file;
+}
+
+void SegmentFile::write(const std::string &path, const std::vector<const HistoryEntry *> &sorted,
+                        SegmentWriter::Caching caching)
+{
+    SegmentWriter::writeFile(path, encode(sorted), caching);
+}
+
+std::unique_ptr<HistoryCursor> SegmentFile::openCursor(std::shared_ptr<const SegmentFile> segment,
+                                                       std::time_t start, std::time_t end)
+{
+    return std::make_unique<Cursor>(std::move(segment), start, end);
+}
+
+size_t SegmentFile::firstBlock(std::time_t start) const
+{
+    return std::partition_point(blocks, blocks + blockCount, [start](const BlockIndex &block)
+                                { return block.maxTimestamp < start; }) -
+           blocks;
+}
+
+size_t SegmentFile::endBlock(std::time_t end) const
+{
+    return std::partition_point(blocks, blocks + blockCount, [end](const BlockIndex &block)
+                                { return block.minTimestamp <= end; }) -
+           blocks;
+}
+
+size_t SegmentFile::spanOf(size_t block) const
+{
+    size_t span = std::max<size_t>(1, (blocks[block].bytes + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    if (block + span > blockCount)
+        throw std::runtime_error("Corrupt block index in segment " + path);
+    return span;
+}
@@ -0,0 +1,702 @@
+#include "segment_writer.hpp"
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <stdexcept>
+#include <chrono>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HISTORY_IO_URING 1
+#endif
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef HISTORY_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace
+{
+#ifndef _WIN32
+    std::string errorText(int error)
+    {
+        return std::strerror(error);
+    }
+
+    void writeAt(int fd, const uint8_t *buffer, size_t count, size_t position, const std::string &path)
+    {
+        size_t done = 0;
+        while (done < count)
+        {
+            ssize_t n = ::pwrite(fd, buffer + done, count - done, static_cast<off_t>(position + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::runtime_error("Failed to write " + path + ": " + errorText(errno));
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    void writeAll(int fd, const uint8_t *data, size_t size, size_t offset, const std::string &path)
+    {
+        writeAt(fd, data + offset, size - offset, offset, path);
+    }
+
+    void sync(int fd, const std::string &path)
+    {
+        if (::fsync(fd) != 0)
+            throw std::runtime_error("Failed to sync " + path + ": " + errorText(errno));
+    }
+
+    void truncateTo(int fd, size_t size, const std::string &path)
+    {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+            throw std::runtime_error("Failed to truncate " + path + ": " + errorText(errno));
+    }
+
+    size_t alignUp(size_t size)
+    {
+        const size_t alignment = SegmentWriter::DIRECT_ALIGNMENT;
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // Copies data through an aligned staging buffer in whole aligned blocks,
+    // then cuts the zero padding off the end of the file
+    void writeAligned(int fd, const std::vector<uint8_t> &data, const std::string &path)
+    {
+        AlignedBuffer staging(std::min(SegmentWriter::BUFFER_SIZE, alignUp(data.size())));
+        for (size_t offset = 0; offset < data.size(); offset += staging.size())
+        {
+            size_t count = std::min(staging.size(), data.size() - offset);
+            size_t padded = alignUp(count);
+            std::memcpy(staging.data(), data.data() + offset, count);
+            std::memset(staging.data() + count, 0, padded - count);
+            writeAt(fd, staging.data(), padded, offset, path);
+        }
+        truncateTo(fd, data.size(), path);
+    }
+#endif
+
+    void publish(const std::string &temporary, const std::string &path)
+    {
+        try
+        {
+            std::filesystem::rename(temporary, path);
+        }
+        catch (...)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+        SegmentWriter::syncDirectory(path);
+    }
+}
+
+AlignedBuffer::AlignedBuffer(size_t size)
+    : bytes(nullptr), length(size)
+{
+    if (size > 0)
+        bytes = static_cast<uint8_t *>(::operator new(size, std::align_val_t(SegmentWriter::DIRECT_ALIGNMENT)));
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+    if (bytes)
+        ::operator delete(bytes, std::align_val_t(SegmentWriter::DIRECT_ALIGNMENT));
+}
+
+AlignedBuffer::AlignedBuffer(AlignedBuffer &&other) noexcept
+    : bytes(other.bytes), length(other.length)
+{
+    other.bytes = nullptr;
+    other.length = 0;
+}
+
+AlignedBuffer &AlignedBuffer::operator=(AlignedBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (bytes)
+            ::operator delete(bytes, std::align_val_t(SegmentWriter::DIRECT_ALIGNMENT));
+        bytes = other.bytes;
+        length = other.length;
+        other.bytes = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+#ifndef _WIN32
+int SegmentWriter::openFile(const std::string &path, int flags, Caching &caching)
+{
+#ifdef O_DIRECT
+    if (caching == Caching::Direct)
+    {
+        int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL)
+            return fd;
+    }
+    caching = Caching::Buffered;
+    return ::open(path.c_str(), flags, 0644);
+#else
+    int fd = ::open(path.c_str(), flags, 0644);
+#ifdef F_NOCACHE
+    if (caching == Caching::Direct && (fd < 0 || ::fcntl(fd, F_NOCACHE, 1) != 0))
+        caching = Caching::Buffered;
+#else
+    caching = Caching::Buffered;
+#endif
+    return fd;
+#endif
+}
+#endif
+
+void SegmentWriter::syncDirectory(const std::string &path)
+{
+#ifndef _WIN32
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Can't open the directory of " + path + ": " + errorText(errno));
+    int result = ::fsync(fd);
+    int error = errno;
+    ::close(fd);
+    if (result != 0)
+        throw std::runtime_error("Failed to sync the directory of " + path + ": " + errorText(error));
+#else
+    (void)path;
+#endif
+}
+
+void SegmentWriter::writeFile(const std::string &path, const std::vector<uint8_t> &data, Caching caching)
+{
+    std::string temporary = path + ".tmp";
+#ifndef _WIN32
+    int fd = openFile(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, caching);
+    if (fd < 0)
+        throw std::runtime_error("Can't create " + temporary + ": " + errorText(errno));
+    try
+    {
+        if (caching == Caching::Direct)
+            writeAligned(fd, data, temporary);
+        else
+            writeAll(fd, data.data(), data.size(), 0, temporary);
+        sync(fd, temporary);
+    }
+    catch (...)
+    {
+        ::close(fd);
+        std::filesystem::remove(temporary);
+        throw;
+    }
+    ::close(fd);
+#else
+    (void)caching;
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size()));
+    out.close();
+    if (!out)
+    {
+        std::filesystem::remove(temporary);
+        throw std::runtime_error("Failed to write " + temporary);
+    }
+#endif
+    publish(temporary, path);
+}
+
+#ifdef HISTORY_IO_URING
+
+struct SegmentWriter::Ring
+{
+    struct Slot
+    {
+        bool busy = false;
+        int fd = -1;
+        std::string path;
+        std::string temporary;
+        std::vector<uint8_t> data; // Source of writes that don't fit a registered buffer
+        AlignedBuffer staging;     // Same, for direct writes
+        const uint8_t *source = nullptr;
+        iovec vector{};
+        size_t size = 0;     // Bytes to write, padded to DIRECT_ALIGNMENT for direct writes
+        size_t fileSize = 0; // Bytes the file ends up with
+        size_t written = 0;
+        unsigned pending = 0; // Completions still expected
+        int error = 0;        // First failure, as a negative errno
+        bool direct = false;
+        bool syncCanceled = false;
+        std::promise<void> done;
+        std::function<void()> onDurable;
+    };
+
+    static constexpr uint64_t STOP = ~uint64_t(0);
+    static constexpr unsigned MAX_WAIT_FAILURES = 100; // Transient io_uring_enter errors in a row
+
+    int fd = -1;
+    io_uring_params params{};
+    void *sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void *cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    uint8_t *buffers = static_cast<uint8_t *>(MAP_FAILED); // QUEUE_DEPTH registered buffers
+    bool registered = false;
+
+    std::mutex mutex; // Guards the submission queue and the slots
+    std::condition_variable slotFree;
+    Slot slots[QUEUE_DEPTH];
+    unsigned inFlight = 0;
+    unsigned unsubmitted = 0;
+    bool broken = false; // Completions can't be reaped; files are written synchronously
+
+    ~Ring()
+    {
+        if (buffers != MAP_FAILED)
+            ::munmap(buffers, QUEUE_DEPTH * BUFFER_SIZE);
+        if (sqes != MAP_FAILED)
+            ::munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        if (cqMap != MAP_FAILED && cqMap != sqMap)
+            ::munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED)
+            ::munmap(sqMap, sqMapSize);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // False when the kernel does not offer io_uring
+    bool setup()
+    {
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH * 2, &params));
+        if (fd < 0)
+            return false;
+
+        sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+        sqMap = ::mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED)
+            return false;
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            cqMap = sqMap;
+        else
+            cqMap = ::mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED)
+            return false;
+        void *sqeMap = ::mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED)
+            return false;
+        sqes = static_cast<io_uring_sqe *>(sqeMap);
+
+        auto *sq = static_cast<uint8_t *>(sqMap);
+        auto *cq = static_cast<uint8_t *>(cqMap);
+        sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // Registered buffers spare the kernel from pinning pages on every
+        // write; without them (e.g. a low RLIMIT_MEMLOCK) writes use WRITEV
+        void *memory = ::mmap(nullptr, QUEUE_DEPTH * BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            buffers = static_cast<uint8_t *>(memory);
+            iovec vectors[QUEUE_DEPTH];
+            for (unsigned i = 0; i < QUEUE_DEPTH; ++i)
+            {
+                vectors[i].iov_base = buffers + i * BUFFER_SIZE;
+                vectors[i].iov_len = BUFFER_SIZE;
+            }
+            registered = ::syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, vectors, QUEUE_DEPTH) == 0;
+            if (!registered)
+            {
+                ::munmap(buffers, QUEUE_DEPTH * BUFFER_SIZE);
+                buffers = static_cast<uint8_t *>(MAP_FAILED);
+            }
+        }
+        return true;
+    }
+
+    // Caller holds mutex; the queue is sized so it never runs out
+    io_uring_sqe *prepare()
+    {
+        unsigned tail = *sqTail + unsubmitted++;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe *sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        return sqe;
+    }
+
+    // Caller holds mutex. On failure the entries the kernel didn't take are
+    // withdrawn from the queue, so the tail only counts taken ones.
+    void submit()
+    {
+        __atomic_store_n(sqTail, *sqTail + unsubmitted, __ATOMIC_RELEASE);
+        unsigned count = unsubmitted;
+        unsubmitted = 0;
+        while (count > 0)
+        {
+            long submitted = ::syscall(__NR_io_uring_enter, fd, count, 0, 0, nullptr, 0);
+            if (submitted < 0 && errno == EINTR)
+                continue;
+            if (submitted < 0)
+            {
+                int error = errno;
+                __atomic_store_n(sqTail, *sqTail - count, __ATOMIC_RELEASE);
+                throw std::runtime_error("io_uring submission failed: " + errorText(error));
+            }
+            count -= static_cast<unsigned>(submitted);
+        }
+    }
+
+    // Caller holds mutex. Fails a slot none of whose entries reached the kernel.
+    void release(Slot &slot, std::exception_ptr error)
+    {
+        ::close(slot.fd);
+        std::error_code ignored;
+        std::filesystem::remove(slot.temporary, ignored);
+        slot.done.set_exception(error);
+        slot = Slot{};
+        inFlight--;
+    }
+
+    // Gives up on the ring: fails every file in flight. Their buffers stay
+    // allocated since the kernel may still be working on them.
+    void abandon(int error)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            broken = true;
+            for (Slot &slot : slots)
+            {
+                if (!slot.busy)
+                    continue;
+                ::close(slot.fd);
+                std::error_code ignored;
+                std::filesystem::remove(slot.temporary, ignored);
+                slot.done.set_exception(std::make_exception_ptr(
+                    std::runtime_error("io_uring completion failed for " + slot.temporary + ": " + errorText(error))));
+                slot.busy = false;
+            }
+            inFlight = 0;
+        }
+        slotFree.notify_all();
+    }
+
+    // Completes a slot whose write and fsync have both been reaped. Runs
+    // without the mutex: nobody else touches a busy slot.
+    void finish(Slot &slot)
+    {
+        try
+        {
+            if (slot.error < 0)
+                throw std::runtime_error("Failed to write " + slot.temporary + ": " + errorText(-slot.error));
+            // A short write breaks the link and cancels the fsync; finish both here
+            if (slot.written < slot.size)
+                writeAll(slot.fd, slot.source, slot.size, slot.written, slot.temporary);
+            // Direct writes carry no linked fsync: the size only settles here
+            if (slot.direct)
+                truncateTo(slot.fd, slot.fileSize, slot.temporary);
+            if (slot.direct || slot.written < slot.size || slot.syncCanceled)
+                sync(slot.fd, slot.temporary);
+            ::close(slot.fd);
+            slot.fd = -1;
+            publish(slot.temporary, slot.path);
+            if (slot.onDurable)
+                slot.onDurable();
+            slot.done.set_value();
+        }
+        catch (...)
+        {
+            if (slot.fd >= 0)
+            {
+                ::close(slot.fd);
+                std::error_code ignored;
+                std::filesystem::remove(slot.temporary, ignored);
+            }
+            slot.done.set_exception(std::current_exception());
+        }
+    }
+};
+
+std::future<void> SegmentWriter::submit(const std::string &path, std::vector<uint8_t> data,
+                                        std::function<void()> onDurable)
+{
+    std::unique_lock<std::mutex> lock(ring->mutex);
+    ring->slotFree.wait(lock, [this]
+                        { return ring->inFlight < QUEUE_DEPTH || ring->broken; });
+    if (ring->broken)
+    {
+        lock.unlock();
+        return writeNow(path, std::move(data), std::move(onDurable));
+    }
+    unsigned index = 0;
+    while (ring->slots[index].busy)
+        index++;
+
+    Ring::Slot &slot = ring->slots[index];
+    slot = Ring::Slot{};
+    slot.path = path;
+    slot.temporary = path + ".tmp";
+    slot.onDurable = std::move(onDurable);
+    std::future<void> result = slot.done.get_future();
+
+    Caching granted = caching;
+    slot.fd = openFile(slot.temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, granted);
+    if (slot.fd < 0)
+    {
+        slot.done.set_exception(std::make_exception_ptr(
+            std::runtime_error("Can't create " + slot.temporary + ": " + errorText(errno))));
+        return result;
+    }
+    slot.direct = granted == Caching::Direct;
+    slot.fileSize = data.size();
+    slot.size = slot.direct ? alignUp(data.size()) : data.size();
+    slot.busy = true;
+    slot.pending = slot.direct ? 1 : 2;
+    ring->inFlight++;
+
+    // Registered buffers are page aligned, so direct writes can use them too
+    bool fixed = ring->registered && slot.size <= BUFFER_SIZE;
+    try
+    {
+        if (!fixed && slot.direct)
+            slot.staging = AlignedBuffer(slot.size);
+    }
+    catch (...)
+    {
+        ring->release(slot, std::current_exception());
+        return result;
+    }
+
+    io_uring_sqe *write = ring->prepare();
+    if (fixed)
+    {
+        uint8_t *buffer = ring->buffers + index * BUFFER_SIZE;
+        std::memcpy(buffer, data.data(), data.size());
+        std::memset(buffer + data.size(), 0, slot.size - data.size());
+        slot.source = buffer;
+        write->opcode = IORING_OP_WRITE_FIXED;
+        write->addr = reinterpret_cast<uint64_t>(buffer);
+        write->len = static_cast<uint32_t>(slot.size);
+        write->buf_index = static_cast<uint16_t>(index);
+    }
+    else if (slot.direct)
+    {
+        std::memcpy(slot.staging.data(), data.data(), data.size());
+        std::memset(slot.staging.data() + data.size(), 0, slot.size - data.size());
+        slot.source = slot.staging.data();
+        slot.vector.iov_base = slot.staging.data();
+        slot.vector.iov_len = slot.size;
+        write->opcode = IORING_OP_WRITEV;
+        write->addr = reinterpret_cast<uint64_t>(&slot.vector);
+        write->len = 1;
+    }
+    else
+    {
+        slot.data = std::move(data);
+        slot.source = slot.data.data();
+        slot.vector.iov_base = slot.data.data();
+        slot.vector.iov_len = slot.data.size();
+        write->opcode = IORING_OP_WRITEV;
+        write->addr = reinterpret_cast<uint64_t>(&slot.vector);
+        write->len = 1;
+    }
+    write->fd = slot.fd;
+    write->off = 0;
+    write->user_data = index * 2;
+
+    if (!slot.direct)
+    {
+        write->flags = IOSQE_IO_LINK; // The fsync starts only after the write succeeds
+        io_uring_sqe *fsync = ring->prepare();
+        fsync->opcode = IORING_OP_FSYNC;
+        fsync->fd = slot.fd;
+        fsync->user_data = index * 2 + 1;
+    }
+
+    unsigned queued = *ring->sqTail;
+    try
+    {
+        ring->submit();
+    }
+    catch (...)
+    {
+        // Only the write can have gone out ahead of its fsync; finish() syncs then
+        unsigned taken = *ring->sqTail - queued;
+        if (taken == 0)
+            ring->release(slot, std::current_exception());
+        else
+        {
+            slot.pending = taken;
+            slot.syncCanceled = true;
+        }
+        lock.unlock();
+        ring->slotFree.notify_all();
+    }
+    return result;
+}
+
+void SegmentWriter::complete()
+{
+    unsigned failures = 0;
+    while (true)
+    {
+        if (::syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+        {
+            // EAGAIN and EBUSY clear once memory frees up or completions are
+            // reaped; anything else, or a long run of them, won't
+            int error = errno;
+            if (error != EINTR && ((error != EAGAIN && error != EBUSY) || ++failures > Ring::MAX_WAIT_FAILURES))
+            {
+                ring->abandon(error);
+                return;
+            }
+            if (error != EINTR)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        else
+            failures = 0;
+
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+            uint64_t tag = cqe.user_data;
+            int result = cqe.res;
+            __atomic_store_n(ring->cqHead, head + 1, __ATOMIC_RELEASE);
+            if (tag == Ring::STOP)
+                return;
+
+            Ring::Slot &slot = ring->slots[tag / 2];
+            bool finished;
+            {
+                std::lock_guard<std::mutex> lock(ring->mutex);
+                if (tag % 2 == 0)
+                {
+                    if (result < 0)
+                        slot.error = result;
+                    else
+                        slot.written = static_cast<size_t>(result);
+                }
+                else if (result == -ECANCELED)
+                    slot.syncCanceled = true;
+                else if (result < 0 && slot.error == 0)
+                    slot.error = result;
+                finished = --slot.pending == 0;
+            }
+            if (!finished)
+                continue;
+
+            ring->finish(slot);
+            {
+                std::lock_guard<std::mutex> lock(ring->mutex);
+                slot = Ring::Slot{};
+                ring->inFlight--;
+            }
+            ring->slotFree.notify_all();
+        }
+    }
+}
+
+#else
+
+struct SegmentWriter::Ring
+{
+};
+
+#endif
+
+SegmentWriter::SegmentWriter(Mode mode, Caching caching)
+    : caching(caching)
+{
+#ifdef HISTORY_IO_URING
+    if (mode == Mode::Synchronous)
+        return;
+    auto candidate = std::make_unique<Ring>();
+    if (candidate->setup())
+    {
+        ring = std::move(candidate);
+        completer = std::thread(&SegmentWriter::complete, this);
+    }
+#else
+    (void)mode;
+#endif
+}
+
+SegmentWriter::~SegmentWriter()
+{
+#ifdef HISTORY_IO_URING
+    if (!ring)
+        return;
+    {
+        std::unique_lock<std::mutex> lock(ring->mutex);
+        ring->slotFree.wait(lock, [this]
+                            { return ring->inFlight == 0; });
+        if (!ring->broken) // Otherwise the completion thread is gone already
+        {
+            io_uring_sqe *stop = ring->prepare();
+            stop->opcode = IORING_OP_NOP;
+            stop->user_data = Ring::STOP;
+            ring->submit();
+        }
+    }
+    completer.join();
+#endif
+}
+
+std::future<void> SegmentWriter::write(const std::string &path, std::vector<uint8_t> data,
+                                       std::function<void()> onDurable)
+{
+#ifdef HISTORY_IO_URING
+    if (ring)
+        return submit(path, std::move(data), std::move(onDurable));
+#endif
+    return writeNow(path, std::move(data), std::move(onDurable));
+}
+
+std::future<void> SegmentWriter::writeNow(const std::string &path, std::vector<uint8_t> data,
+                                          std::function<void()> onDurable)
+{
+    std::promise<void> done;
+    try
+    {
+        writeFile(path, data, caching);
+        if (onDurable)
+            onDurable();
+        done.set_value();
+    }
+    catch (...)
+    {
+        done.set_exception(std::current_exception());
+    }
+    return done.get_future();
+}
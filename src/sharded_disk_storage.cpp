@@ -0,0 +1,315 @@
+#include "sharded_disk_storage.hpp"
+#include "record_codec.hpp"
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+namespace
+{
+    // splitmix64 finalizer: neighbouring timestamps land on unrelated shards
+    uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ULL;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebULL;
+        value ^= value >> 31;
+        return value;
+    }
+
+    std::time_t sliceOf(std::time_t timestamp, std::time_t sliceSeconds)
+    {
+        std::time_t slice = timestamp / sliceSeconds;
+        return timestamp % sliceSeconds < 0 ? slice - 1 : slice;
+    }
+
+}
+
+// One flushAsync() batch, completed once every shard's part is done
+struct ShardedDiskStorage::PendingFlush
+{
+    struct Part
+    {
+        size_t shard;
+        std::vector<std::unique_ptr<HistoryEntry>> entries; // Left to store after skipStored()
+        std::vector<std::vector<uint8_t>> skipped;          // Stored by an earlier failed batch
+        std::exception_ptr error;
+    };
+
+    std::mutex mutex;
+    std::vector<Part> parts;
+    size_t remaining;
+    std::promise<void> done;
+
+    // True for the part that finishes last
+    bool finish(Part &part, std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        part.error = error;
+        return --remaining == 0;
+    }
+};
+
+ShardedDiskStorage::ShardedDiskStorage(std::vector<std::unique_ptr<DiskStorage>> shards, Placement placement,
+                                       std::time_t sliceSeconds)
+    : shards(std::move(shards)), placement(placement), sliceSeconds(sliceSeconds), concurrentRetrieve(true),
+      stored(this->shards.size())
+{
+    if (this->shards.empty())
+        throw std::runtime_error("Sharded storage needs at least one shard");
+    if (sliceSeconds <= 0)
+        throw std::runtime_error("Shard slice must be positive");
+
+    for (const auto &shard : this->shards)
+    {
+        concurrentRetrieve = concurrentRetrieve && shard->supportsConcurrentRetrieve();
+        writers.push_back(std::make_unique<WorkerPool>(1));
+    }
+    readers = std::make_unique<WorkerPool>(this->shards.size());
+}
+
+ShardedDiskStorage::~ShardedDiskStorage() = default;
+
+size_t ShardedDiskStorage::shardFor(std::time_t timestamp) const
+{
+    uint64_t key = placement == Placement::TimeSlice
+                       ? static_cast<uint64_t>(sliceOf(timestamp, sliceSeconds))
+                       : mix(static_cast<uint64_t>(timestamp));
+    return static_cast<size_t>(key % shards.size());
+}
+
+std::vector<size_t> ShardedDiskStorage::shardsInRange(std::time_t start, std::time_t end) const
+{
+    std::vector<size_t> targets;
+    if (placement == Placement::TimeSlice && start <= end &&
+        static_cast<uint64_t>(sliceOf(end, sliceSeconds) - sliceOf(start, sliceSeconds)) < shards.size() - 1)
+    {
+        for (std::time_t slice = sliceOf(start, sliceSeconds); slice <= sliceOf(end, sliceSeconds); ++slice)
+        {
+            targets.push_back(static_cast<size_t>(static_cast<uint64_t>(slice) % shards.size()));
+        }
+        std::sort(targets.begin(), targets.end());
+        return targets;
+    }
+    for (size_t shard = 0; shard < shards.size(); ++shard)
+    {
+        targets.push_back(shard);
+    }
+    return targets;
+}
+
+void ShardedDiskStorage::forEachShard(const std::vector<size_t> &targets, const std::function<void(size_t)> &task, bool write)
+{
+    std::vector<std::future<void>> pending;
+    for (size_t shard : targets)
+    {
+        auto job = std::make_shared<std::packaged_task<void()>>([&task, shard]
+                                                                { task(shard); });
+        pending.push_back(job->get_future());
+        WorkerPool &pool = write || !concurrentRetrieve ? *writers[shard] : *readers;
+        pool.submit([job]
+                    { (*job)(); });
+    }
+
+    // Every task references task, so all of them finish before anything is rethrown
+    std::exception_ptr error;
+    for (auto &part : pending)
+    {
+        try
+        {
+            part.get();
+        }
+        catch (...)
+        {
+            if (!error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+void ShardedDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (entries.empty())
+        return;
+    std::vector<std::unique_ptr<HistoryEntry>> copy;
+    copy.reserve(entries.size());
+    for (const auto &entry : entries)
+    {
+        copy.push_back(entry->clone());
+    }
+    flushAsync(std::move(copy)).get();
+}
+
+std::future<void> ShardedDiskStorage::flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries)
+{
+    if (entries.empty())
+        return DiskStorage::flushAsync(std::move(entries));
+
+    std::vector<std::vector<std::unique_ptr<HistoryEntry>>> parts(shards.size());
+    for (auto &entry : entries)
+    {
+        parts[shardFor(entry->getTimestamp())].push_back(std::move(entry));
+    }
+
+    auto pending = std::make_shared<PendingFlush>();
+    for (size_t shard = 0; shard < shards.size(); ++shard)
+    {
+        if (!parts[shard].empty())
+            pending->parts.push_back({shard, std::move(parts[shard]), {}, nullptr});
+    }
+    pending->remaining = pending->parts.size();
+    auto done = pending->done.get_future();
+    for (auto &part : pending->parts)
+    {
+        writers[part.shard]->submit([this, &part, pending]
+                                    {
+            std::exception_ptr error;
+            try
+            {
+                skipStored(part.shard, part.entries, part.skipped);
+                if (!part.entries.empty())
+                    shards[part.shard]->flush(part.entries);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            if (pending->finish(part, error))
+                finishFlush(*pending); });
+    }
+    return done;
+}
+
+void ShardedDiskStorage::skipStored(size_t shard, std::vector<std::unique_ptr<HistoryEntry>> &entries,
+                                    std::vector<std::vector<uint8_t>> &skipped)
+{
+    std::lock_guard<std::mutex> lock(storedMutex);
+    auto &records = stored[shard];
+    if (records.empty())
+        return;
+    std::vector<uint8_t> record;
+    auto kept = entries.begin();
+    for (auto &entry : entries)
+    {
+        record.clear();
+        RecordCodec::append(entry.get(), record);
+        auto match = records.find(record);
+        if (match != records.end())
+        {
+            records.erase(match);
+            skipped.push_back(record);
+        }
+        else
+            *kept++ = std::move(entry);
+    }
+    entries.erase(kept, entries.end());
+    // Only the retry, the next batch to reach the shard, may skip. Records it
+    // didn't bring are dropped so they can't swallow later genuine samples.
+    records.clear();
+}
+
+void ShardedDiskStorage::finishFlush(PendingFlush &pending)
+{
+    std::exception_ptr error;
+    for (const auto &part : pending.parts)
+    {
+        if (part.error && !error)
+            error = part.error;
+    }
+    if (!error)
+    {
+        pending.done.set_value();
+        return;
+    }
+
+    // The caller retries the whole batch, so remember what did get stored:
+    // the parts that succeeded and the entries every part skipped
+    {
+        std::lock_guard<std::mutex> lock(storedMutex);
+        for (auto &part : pending.parts)
+        {
+            auto &records = stored[part.shard];
+            for (auto &record : part.skipped)
+            {
+                records.insert(std::move(record));
+            }
+            if (part.error)
+                continue;
+            std::vector<uint8_t> record;
+            for (const auto &entry : part.entries)
+            {
+                record.clear();
+                RecordCodec::append(entry.get(), record);
+                records.insert(record);
+            }
+        }
+    }
+    pending.done.set_exception(error);
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> ShardedDiskStorage::retrieve(std::time_t start, std::time_t end)
+{
+    // Each shard's result is sorted on its own thread; only the merge is serial
+    std::vector<size_t> targets = shardsInRange(start, end);
+    std::vector<std::unique_ptr<HistoryCursor>> sorted(shards.size());
+    forEachShard(targets, [this, &sorted, start, end](size_t shard)
+                 { sorted[shard] = std::make_unique<VectorCursor>(shards[shard]->retrieve(start, end)); },
+                 false);
+
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    for (size_t shard : targets)
+    {
+        inputs.push_back(std::move(sorted[shard]));
+    }
+    std::vector<std::unique_ptr<HistoryEntry>> results;
+    MergeCursor merged(std::move(inputs));
+    while (auto entry = merged.next())
+    {
+        results.push_back(std::move(entry));
+    }
+    return results;
+}
+
+std::unique_ptr<HistoryCursor> ShardedDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    std::vector<size_t> targets = shardsInRange(start, end);
+    std::vector<std::unique_ptr<HistoryCursor>> cursors(shards.size());
+    forEachShard(targets, [this, &cursors, start, end](size_t shard)
+                 { cursors[shard] = shards[shard]->openCursor(start, end); },
+                 false);
+
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    for (size_t shard : targets)
+    {
+        inputs.push_back(std::move(cursors[shard]));
+    }
+    return std::make_unique<MergeCursor>(std::move(inputs));
+}
+
+Aggregate ShardedDiskStorage::aggregate(std::time_t start, std::time_t end)
+{
+    std::vector<size_t> targets = shardsInRange(start, end);
+    std::vector<Aggregate> partials(shards.size());
+    forEachShard(targets, [this, &partials, start, end](size_t shard)
+                 { partials[shard] = shards[shard]->aggregate(start, end); },
+                 false);
+
+    Aggregate result;
+    for (size_t shard : targets)
+    {
+        result.merge(partials[shard]);
+    }
+    return result;
+}
+
+size_t ShardedDiskStorage::getDiskUsage() const
+{
+    size_t total = 0;
+    for (const auto &shard : shards)
+    {
+        total += shard->getDiskUsage();
+    }
+    return total;
+}
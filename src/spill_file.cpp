@@ -0,0 +1,216 @@
+#include "spill_file.hpp"
+#include "record_codec.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const size_t READ_CHUNK = 64 * 1024;
+
+    // Reads records from [start, end) of a spill file in large chunks
+    class RecordReader
+    {
+    private:
+        std::ifstream in;
+        std::vector<uint8_t> buffer;
+        size_t used;           // Bytes of buffer already returned
+        std::streamoff offset; // File position of buffer[used]
+        std::streamoff end;
+
+    public:
+        RecordReader(const std::string &path, std::streamoff start, std::streamoff end)
+            : in(path, std::ios::binary), used(0), offset(start), end(end)
+        {
+            in.seekg(start);
+        }
+
+        // Position after the last record returned
+        std::streamoff position() const { return offset; }
+
+        // nullptr at the end or for a torn or corrupt tail
+        std::unique_ptr<HistoryEntry> next()
+        {
+            size_t size;
+            while (true)
+            {
+                size_t have = buffer.size() - used;
+                size = RecordCodec::size(buffer.data() + used, have);
+                if (size > static_cast<size_t>(end - offset))
+                    return nullptr;
+                if (size != 0 && size <= have)
+                    break;
+                if (!fill(std::max(READ_CHUNK, size)))
+                    return nullptr;
+            }
+            auto entry = RecordCodec::decode(buffer.data() + used);
+            used += size;
+            offset += static_cast<std::streamoff>(size);
+            return entry;
+        }
+
+    private:
+        // Reads up to count more bytes, stopping at end; false if none came in
+        bool fill(size_t count)
+        {
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(used));
+            used = 0;
+            size_t have = buffer.size();
+            count = std::min(count, static_cast<size_t>(end - offset) - have);
+            if (count == 0)
+                return false;
+            buffer.resize(have + count);
+            in.read(reinterpret_cast<char *>(buffer.data() + have), static_cast<std::streamsize>(count));
+            buffer.resize(have + static_cast<size_t>(in.gcount()));
+            return buffer.size() > have;
+        }
+    };
+}
+
+SpillFile::SpillFile(const std::string &path)
+    : path(path), out(nullptr), readOffset(0), writeOffset(0), pendingCount(0), spilledCount(0)
+{
+    // Entries left over from a previous run are still pending
+    if (std::filesystem::exists(path))
+    {
+        RecordReader records(path, 0, static_cast<std::streamoff>(std::filesystem::file_size(path)));
+        while (records.next())
+        {
+            pendingCount++;
+            writeOffset = records.position();
+        }
+    }
+
+    openForAppend(pendingCount == 0);
+    if (pendingCount > 0)
+    {
+        std::filesystem::resize_file(path, writeOffset); // Drop a torn trailing record
+        std::cout << "Recovered " << pendingCount << " spilled entries from " << path << std::endl;
+    }
+}
+
+SpillFile::~SpillFile()
+{
+    if (out)
+        std::fclose(out);
+    if (pendingCount == 0)
+    {
+        std::filesystem::remove(path);
+    }
+}
+
+void SpillFile::openForAppend(bool truncate)
+{
+    if (out)
+        std::fclose(out);
+    out = std::fopen(path.c_str(), truncate ? "wb" : "ab");
+    if (!out)
+    {
+        throw std::runtime_error("Can't open spill file: " + path);
+    }
+}
+
+void SpillFile::append(const std::vector<std::unique_ptr<HistoryEntry>> &entries, bool sync)
+{
+    // Encoded up front so a batch goes out in one write
+    std::vector<uint8_t> records;
+    for (const auto &entry : entries)
+    {
+        RecordCodec::append(entry.get(), records);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (std::fwrite(records.data(), 1, records.size(), out) != records.size() ||
+            std::fflush(out) != 0)
+        {
+            throw std::runtime_error("Failed to append to spill file: " + path);
+        }
+        writeOffset += static_cast<std::streamoff>(records.size());
+        pendingCount += entries.size();
+        spilledCount += entries.size();
+    }
+    if (sync)
+        this->sync();
+}
+
+void SpillFile::sync()
+{
+#ifndef _WIN32
+    // A duplicate descriptor stays valid if release() reopens the file meanwhile
+    int fd;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fd = ::dup(fileno(out));
+    }
+    if (fd < 0)
+        throw std::runtime_error("Failed to sync spill file: " + path);
+    int result = ::fsync(fd);
+    ::close(fd);
+    if (result != 0)
+        throw std::runtime_error("Failed to sync spill file: " + path);
+#else
+    std::lock_guard<std::mutex> lock(mutex);
+    if (_commit(_fileno(out)) != 0)
+        throw std::runtime_error("Failed to sync spill file: " + path);
+#endif
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> SpillFile::peek(size_t maxEntries, std::streamoff &nextOffset) const
+{
+    std::streamoff start, end;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        start = readOffset;
+        end = writeOffset;
+    }
+
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    nextOffset = start;
+    if (start == end)
+        return entries;
+
+    RecordReader records(path, start, end);
+    while (entries.size() < maxEntries)
+    {
+        auto entry = records.next();
+        if (!entry)
+            break;
+        entries.push_back(std::move(entry));
+        nextOffset = records.position();
+    }
+    return entries;
+}
+
+void SpillFile::release(std::streamoff nextOffset, size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    readOffset = nextOffset;
+    pendingCount -= std::min(count, pendingCount);
+
+    // Everything merged: start the file over instead of growing it forever
+    if (readOffset == writeOffset)
+    {
+        openForAppend(true);
+        readOffset = writeOffset = 0;
+        pendingCount = 0;
+    }
+}
+
+size_t SpillFile::getPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pendingCount;
+}
+
+size_t SpillFile::getSpilledCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return spilledCount;
+}
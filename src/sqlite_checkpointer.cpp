@@ -0,0 +1,185 @@
+#include "sqlite_checkpointer.hpp"
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+
+SQLiteCheckpointer::SQLiteCheckpointer(const std::string &dbPath, size_t walSizeLimit)
+    : dbPath(dbPath), pageSize(4096), walSizeLimit(walSizeLimit), walPages(0), commitCount(0), walBytes(0), stopping(false)
+{
+    if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK)
+    {
+        std::string error = "Can't open checkpoint connection: " + std::string(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+    }
+
+    // Reading the schema attaches the connection to the WAL; until then checkpoints are no-ops
+    sqlite3_exec(db, "SELECT count(*) FROM sqlite_master", nullptr, nullptr, nullptr);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA page_size", -1, &stmt, nullptr) == SQLITE_OK)
+    {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            pageSize = static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+        sqlite3_finalize(stmt);
+    }
+
+    // A WAL left by an earlier run keeps its size until it is truncated
+    std::error_code error;
+    auto size = std::filesystem::file_size(dbPath + "-wal", error);
+    walBytes = error ? 0 : static_cast<size_t>(size);
+
+    worker = std::thread(&SQLiteCheckpointer::run, this);
+}
+
+SQLiteCheckpointer::~SQLiteCheckpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+
+    // Leave an empty WAL behind if no reader is still holding it
+    sqlite3_busy_timeout(db, ESCALATION_BUSY_TIMEOUT_MS);
+    sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_TRUNCATE, nullptr, nullptr);
+    sqlite3_close(db);
+}
+
+int SQLiteCheckpointer::onWalCommit(void *checkpointer, sqlite3 *, const char *, int pages)
+{
+    auto *self = static_cast<SQLiteCheckpointer *>(checkpointer);
+    self->walPages = pages;
+    self->commitCount++;
+
+    // A restarted WAL is overwritten from the front, so the file only grows
+    size_t bytes = WAL_HEADER_SIZE + static_cast<size_t>(pages) * (self->pageSize + WAL_FRAME_HEADER_SIZE);
+    size_t previous = self->walBytes;
+    while (bytes > previous && !self->walBytes.compare_exchange_weak(previous, bytes))
+    {
+    }
+    if (pages >= CHECKPOINT_PAGES)
+    {
+        self->wake.notify_one();
+    }
+    return SQLITE_OK;
+}
+
+SQLiteCheckpointer::Stats SQLiteCheckpointer::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void SQLiteCheckpointer::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t checkedCommits = 0;
+    while (!stopping)
+    {
+        // Wake early once a commit pushes the WAL past the threshold; otherwise
+        // checkpoint whatever is there on the interval. Frames readers pinned
+        // last time only count again after another commit.
+        wake.wait_for(lock, CHECKPOINT_INTERVAL, [&]
+                      { return stopping || (walPages >= CHECKPOINT_PAGES && commitCount != checkedCommits); });
+        if (stopping)
+            break;
+        if (walPages == 0)
+            continue;
+
+        checkedCommits = commitCount;
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+void SQLiteCheckpointer::checkpoint()
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    int logFrames = 0, checkpointedFrames = 0;
+    int rc = sqlite3_wal_checkpoint_v2(db, nullptr, SQLITE_CHECKPOINT_PASSIVE, &logFrames, &checkpointedFrames);
+    int mode = SQLITE_CHECKPOINT_PASSIVE;
+
+    // Waiting escalations are spaced out, since each can stall the writer
+    size_t limit = walSizeLimit;
+    bool wait = getWalSize() / 2 > limit;
+    if (!wait || begin - lastEscalation >= ESCALATION_INTERVAL)
+    {
+        if (getWalSize() > limit)
+        {
+            mode = SQLITE_CHECKPOINT_TRUNCATE;
+        }
+        else if (checkpointedFrames < logFrames && static_cast<size_t>(logFrames) * pageSize > limit / 2)
+        {
+            mode = SQLITE_CHECKPOINT_RESTART;
+        }
+    }
+
+    // Escalated modes block the writer while they wait for readers
+    size_t walBytesBefore = walBytes;
+    int walPagesBefore = walPages;
+    if (mode != SQLITE_CHECKPOINT_PASSIVE)
+    {
+        if (wait)
+        {
+            sqlite3_busy_timeout(db, ESCALATION_BUSY_TIMEOUT_MS);
+            lastEscalation = begin;
+        }
+        rc = sqlite3_wal_checkpoint_v2(db, nullptr, mode, &logFrames, &checkpointedFrames);
+        sqlite3_busy_timeout(db, 0);
+    }
+
+    // A completed escalation restarts the WAL. Otherwise the checkpointed
+    // frames come off the count, unless a commit has restarted it since;
+    // frames readers are still pinning are retried after the next commit.
+    if (mode != SQLITE_CHECKPOINT_PASSIVE && rc == SQLITE_OK)
+    {
+        walPages.compare_exchange_strong(walPagesBefore, 0);
+    }
+    else if (checkpointedFrames > 0)
+    {
+        int pages = walPages;
+        while (pages >= logFrames && !walPages.compare_exchange_weak(pages, pages - checkpointedFrames))
+        {
+        }
+    }
+    if (mode == SQLITE_CHECKPOINT_TRUNCATE && rc == SQLITE_OK &&
+        !walBytes.compare_exchange_strong(walBytesBefore, 0))
+    {
+        // A commit slipped in before the truncate; ask the file system once
+        std::error_code error;
+        auto size = std::filesystem::file_size(dbPath + "-wal", error);
+        walBytes = error ? 0 : static_cast<size_t>(size);
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    switch (mode)
+    {
+    case SQLITE_CHECKPOINT_PASSIVE:
+        stats.passiveCount++;
+        break;
+    case SQLITE_CHECKPOINT_RESTART:
+        stats.restartCount++;
+        break;
+    case SQLITE_CHECKPOINT_TRUNCATE:
+        stats.truncateCount++;
+        break;
+    }
+    if (rc == SQLITE_BUSY)
+    {
+        stats.busyCount++;
+    }
+    else if (rc != SQLITE_OK)
+    {
+        std::cerr << "Checkpoint failed: " << sqlite3_errmsg(db) << std::endl;
+    }
+    stats.lastWalFrames = logFrames;
+    stats.lastDuration = duration;
+    stats.maxDuration = std::max(stats.maxDuration, duration);
+}
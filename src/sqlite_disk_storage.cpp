@@ -2,9 +2,251 @@
 #include <stdexcept>
 #include <filesystem>
 #include <iostream>
+#include <algorithm>
 
-SQLiteDiskStorage::SQLiteDiskStorage(const std::string &dbPath) : dbPath(dbPath)
+namespace
 {
+    // Covering index over everything in a chunks row except the payload
+    std::string summaryIndexName(const std::string &chunksTable)
+    {
+        std::string name = chunksTable;
+        name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+        return "\"" + name + "_summary\"";
+    }
+
+    // Index that sealing walks to find the oldest rows of one type
+    std::string typeIndexName(const std::string &rowsTable)
+    {
+        std::string name = rowsTable;
+        name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+        return "\"" + name + "_type\"";
+    }
+
+    // history_meta key holding the widest chunk of one chunks table
+    std::string chunkSpanKey(const std::string &chunksTable)
+    {
+        std::string name = chunksTable;
+        name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+        return "max_chunk_span:" + name;
+    }
+
+    // start_ts is the clustering key; a chunk starting more than this before
+    // a range cannot overlap it
+    int64_t readChunkSpan(SQLiteReader &reader, const std::string &chunksTable)
+    {
+        return reader.queryInt("SELECT value FROM history_meta WHERE key = '" + chunkSpanKey(chunksTable) + "'", 0);
+    }
+
+    // Columns: timestamp, type code, value
+    std::unique_ptr<HistoryEntry> decodeRow(sqlite3_stmt *stmt)
+    {
+        std::time_t timestamp = sqlite3_column_int64(stmt, 0);
+
+        switch (static_cast<EntryType>(sqlite3_column_int(stmt, 1)))
+        {
+        case EntryType::Double:
+            return std::make_unique<TypedHistoryEntry<double>>(timestamp, sqlite3_column_double(stmt, 2));
+        case EntryType::Int:
+            return std::make_unique<TypedHistoryEntry<int>>(timestamp, sqlite3_column_int(stmt, 2));
+        case EntryType::Bool:
+            return std::make_unique<TypedHistoryEntry<bool>>(timestamp, sqlite3_column_int(stmt, 2) != 0);
+        case EntryType::String:
+        {
+            const char *value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+            return std::make_unique<TypedHistoryEntry<std::string>>(
+                timestamp, std::string(value, sqlite3_column_bytes(stmt, 2)));
+        }
+        }
+        throw std::runtime_error("Unknown type in database");
+    }
+
+    // Steps a (timestamp, type, value) statement that is already in timestamp order
+    class RowCursor : public HistoryCursor
+    {
+    private:
+        sqlite3_stmt *stmt;
+        bool exhausted;
+
+    public:
+        explicit RowCursor(sqlite3_stmt *stmt) : stmt(stmt), exhausted(false) {}
+        ~RowCursor() { sqlite3_reset(stmt); }
+
+        std::unique_ptr<HistoryEntry> next() override
+        {
+            if (exhausted)
+                return nullptr;
+            if (sqlite3_step(stmt) != SQLITE_ROW)
+            {
+                exhausted = true;
+                return nullptr;
+            }
+            return decodeRow(stmt);
+        }
+    };
+
+    // Samples of sealed chunks in timestamp order. Chunks are read by start_ts
+    // and each decoded block is a sorted run; a sample is released only once
+    // no unread chunk can start before it, so just the overlapping chunks are
+    // held, as columns rather than entries.
+    class ChunkCursor : public HistoryCursor
+    {
+    private:
+        struct Run
+        {
+            ColumnBlock block;
+            size_t position;
+            size_t end; // One past the last sample inside the range
+        };
+
+        sqlite3_stmt *stmt; // start_ts, payload ordered by start_ts
+        std::time_t start;
+        std::time_t end;
+        bool exhausted;
+        std::time_t nextChunkStart;
+        std::vector<Run> runs; // Min-heap on the timestamp at position
+
+        static bool laterRun(const Run &a, const Run &b)
+        {
+            return a.block.timestamps[a.position] > b.block.timestamps[b.position];
+        }
+
+        void loadChunk()
+        {
+            Run run{BlockCodec::decode(static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 1)),
+                                       sqlite3_column_bytes(stmt, 1)),
+                    0, 0};
+            const auto &timestamps = run.block.timestamps;
+            run.position = std::lower_bound(timestamps.begin(), timestamps.end(), start) - timestamps.begin();
+            run.end = std::upper_bound(timestamps.begin(), timestamps.end(), end) - timestamps.begin();
+            if (run.position < run.end)
+            {
+                runs.push_back(std::move(run));
+                std::push_heap(runs.begin(), runs.end(), laterRun);
+            }
+
+            exhausted = sqlite3_step(stmt) != SQLITE_ROW;
+            if (!exhausted)
+                nextChunkStart = sqlite3_column_int64(stmt, 0);
+        }
+
+    public:
+        ChunkCursor(sqlite3_stmt *stmt, std::time_t start, std::time_t end)
+            : stmt(stmt), start(start), end(end), nextChunkStart(0)
+        {
+            exhausted = sqlite3_step(stmt) != SQLITE_ROW;
+            if (!exhausted)
+                nextChunkStart = sqlite3_column_int64(stmt, 0);
+        }
+        ~ChunkCursor() { sqlite3_reset(stmt); }
+
+        std::unique_ptr<HistoryEntry> next() override
+        {
+            while (!exhausted && (runs.empty() || runs.front().block.timestamps[runs.front().position] > nextChunkStart))
+            {
+                loadChunk();
+            }
+            if (runs.empty())
+                return nullptr;
+
+            Run &earliest = runs.front();
+            std::unique_ptr<HistoryEntry> entry = earliest.block.makeEntry(earliest.position++);
+
+            // Restore the heap with the run's new head, or drop the run
+            std::pop_heap(runs.begin(), runs.end(), laterRun);
+            if (runs.back().position < runs.back().end)
+                std::push_heap(runs.begin(), runs.end(), laterRun);
+            else
+                runs.pop_back();
+            return entry;
+        }
+    };
+
+    std::unique_ptr<HistoryCursor> openTableCursor(SQLiteReader &reader, const std::string &rowsTable,
+                                                   const std::string &chunksTable, std::time_t start,
+                                                   std::time_t end)
+    {
+        sqlite3_stmt *rows = reader.prepare("SELECT timestamp, type, value FROM " + rowsTable +
+                                            " WHERE timestamp BETWEEN ?1 AND ?2 ORDER BY timestamp, seq");
+        sqlite3_bind_int64(rows, 1, start);
+        sqlite3_bind_int64(rows, 2, end);
+
+        sqlite3_stmt *chunks = reader.prepare("SELECT start_ts, payload FROM " + chunksTable +
+                                              " WHERE start_ts BETWEEN ?1 - ?3 AND ?2 AND end_ts >= ?1 ORDER BY start_ts, seq");
+        sqlite3_bind_int64(chunks, 1, start);
+        sqlite3_bind_int64(chunks, 2, end);
+        sqlite3_bind_int64(chunks, 3, readChunkSpan(reader, chunksTable));
+
+        std::vector<std::unique_ptr<HistoryCursor>> inputs;
+        inputs.push_back(std::make_unique<RowCursor>(rows));
+        inputs.push_back(std::make_unique<ChunkCursor>(chunks, start, end));
+        return std::make_unique<MergeCursor>(std::move(inputs));
+    }
+
+    // Time partitions are disjoint and sorted, so they are read one after
+    // another with only the current one's statements active
+    class PartitionCursor : public HistoryCursor
+    {
+    private:
+        SQLiteReader &reader;
+        std::vector<std::pair<std::string, std::string>> tables; // rows table, chunks table
+        size_t nextTable;
+        std::time_t start;
+        std::time_t end;
+        std::unique_ptr<HistoryCursor> current;
+
+    public:
+        PartitionCursor(SQLiteReader &reader, std::vector<std::pair<std::string, std::string>> tables,
+                        std::time_t start, std::time_t end)
+            : reader(reader), tables(std::move(tables)), nextTable(0), start(start), end(end) {}
+
+        std::unique_ptr<HistoryEntry> next() override
+        {
+            while (true)
+            {
+                if (current)
+                {
+                    auto entry = current->next();
+                    if (entry)
+                        return entry;
+                    current.reset();
+                }
+                if (nextTable >= tables.size())
+                    return nullptr;
+                current = openTableCursor(reader, tables[nextTable].first, tables[nextTable].second, start, end);
+                nextTable++;
+            }
+        }
+    };
+
+    // Owns the leased reader and its snapshot for as long as the stream is open
+    class SQLiteCursor : public HistoryCursor
+    {
+    private:
+        SQLiteReaderPool::Lease reader;
+        std::unique_ptr<HistoryCursor> merged; // Declared last so its statements are reset before the lease ends
+
+    public:
+        SQLiteCursor(SQLiteReaderPool::Lease reader, std::vector<std::unique_ptr<HistoryCursor>> inputs)
+            : reader(std::move(reader)), merged(std::make_unique<MergeCursor>(std::move(inputs))) {}
+
+        std::unique_ptr<HistoryEntry> next() override
+        {
+            return merged->next();
+        }
+    };
+}
+
+SQLiteDiskStorage::SQLiteDiskStorage(const std::string &dbPath, std::time_t partitionSpan)
+    : dbPath(dbPath), nextSeq(1),
+      insertBatchWidth(DEFAULT_INSERT_BATCH_WIDTH), maxInsertBatchWidth(1),
+      chunkSize(DEFAULT_CHUNK_SIZE), partitionSpan(partitionSpan),
+      readerPool(dbPath, DEFAULT_READER_POOL_SIZE), walSizeLimit(DEFAULT_WAL_SIZE_LIMIT),
+      pageStatsStmt(nullptr), pageSize(0), pageCount(0), freelistCount(0), walBytes(0),
+      retentionPeriod(0), incrementalVacuum(false), bulkLoader(nullptr),
+      stoppingWriter(false), writeTransactionCount(0), hotTier(nullptr)
+{
+    readerPool.setConnectionSetup([this](sqlite3 *reader)
+                                  { SQLiteHistoryModules::registerModules(reader, &hotTier); });
     if (sqlite3_open(dbPath.c_str(), &db) != SQLITE_OK)
     {
         throw std::runtime_error("Can't open database: " + std::string(sqlite3_errmsg(db)));
@@ -12,171 +254,1239 @@ SQLiteDiskStorage::SQLiteDiskStorage(const std::string &dbPath) : dbPath(dbPath)
     createTable();
     optimizeConnection();
     prepareStatements();
+    setBackgroundCheckpointing(true);
+    refreshDiskUsage();
+    writerThread = std::thread(&SQLiteDiskStorage::runWriter, this);
+}
+
+SQLiteDiskStorage::~SQLiteDiskStorage()
+{
+    if (bulkLoader)
+    {
+        bulkLoader.load()->rollback();
+    }
+    retrieveWorkers.reset();
+
+    // Queued batches are still written
+    {
+        std::lock_guard<std::mutex> lock(writeQueueMutex);
+        stoppingWriter = true;
+    }
+    writeQueueCondition.notify_one();
+    writerThread.join();
+
+    setBackgroundCheckpointing(false);
+    partitions.clear();
+    basePartition.reset();
+    sqlite3_finalize(updateMetaStmt);
+    sqlite3_finalize(pageStatsStmt);
+    sqlite3_close(db);
+}
+
+SQLiteDiskStorage::Partition::~Partition()
+{
+    for (auto &[rows, stmt] : insertStmts)
+    {
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_finalize(selectUnsealedStmt);
+    sqlite3_finalize(insertChunkStmt);
+    sqlite3_finalize(deleteSealedStmt);
+    sqlite3_finalize(selectExpiredStmt);
+    sqlite3_finalize(deleteExpiredStmt);
+    sqlite3_finalize(deleteExpiredChunksStmt);
+    sqlite3_finalize(selectExpiredSpanStmt);
+}
+
+void SQLiteDiskStorage::execute(const char *sql)
+{
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        std::string error = "SQL error: " + std::string(errMsg ? errMsg : sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
+        throw std::runtime_error(error);
+    }
+}
+
+int64_t SQLiteDiskStorage::queryInt(const char *sql, int64_t defaultValue) const
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    int64_t value = defaultValue;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+    {
+        value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+void SQLiteDiskStorage::createTable()
+{
+    // Only takes effect before the first table is created (or at the next VACUUM)
+    execute("PRAGMA auto_vacuum = INCREMENTAL");
+    incrementalVacuum = queryInt("PRAGMA auto_vacuum", 0) == 2;
+
+    // Older layouts are moved aside and migrated incrementally. Version 0 keyed
+    // rows by an AUTOINCREMENT id, version 1 stored the type as TEXT.
+    int64_t version = queryInt("PRAGMA user_version", 0);
+    if (version < SCHEMA_VERSION &&
+        queryInt("SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'history'", 0) > 0)
+    {
+        execute(("ALTER TABLE history RENAME TO history_v" + std::to_string(version)).c_str());
+    }
+
+    createPartitionTables("history", "history_chunks");
+    execute("CREATE TABLE IF NOT EXISTS history_meta ("
+            "key TEXT PRIMARY KEY,"
+            "value INTEGER NOT NULL) WITHOUT ROWID");
+    execute("CREATE TABLE IF NOT EXISTS history_partitions ("
+            "start_ts INTEGER PRIMARY KEY,"
+            "end_ts INTEGER NOT NULL)");
+    execute(("PRAGMA user_version = " + std::to_string(SCHEMA_VERSION)).c_str());
+
+    nextSeq = queryInt("SELECT value FROM history_meta WHERE key = 'next_seq'", 1);
+
+    // Older files kept one span for every chunks table; each table's own is
+    // computed when its partition is loaded
+    execute("DELETE FROM history_meta WHERE key = 'max_chunk_span'");
+
+    // The span is fixed when the file is created so partition boundaries never shift
+    int64_t storedSpan = queryInt("SELECT value FROM history_meta WHERE key = 'partition_span'", -1);
+    if (storedSpan < 0)
+    {
+        execute(("INSERT INTO history_meta (key, value) VALUES ('partition_span', " +
+                 std::to_string(partitionSpan) + ")").c_str());
+    }
+    else
+    {
+        if (partitionSpan != 0 && storedSpan != partitionSpan)
+            std::cerr << "Using stored partition span of " << storedSpan << "s for " << dbPath << std::endl;
+        partitionSpan = storedSpan;
+    }
+
+    loadLegacyTables();
+}
+
+// Rows are clustered on (timestamp, seq) so range queries are a B-tree seek plus a sequential scan.
+// type holds an EntryType code; value has no affinity, so each value keeps its native storage class.
+// Sealed chunks are keyed by their first timestamp and the seq of their first sample.
+// Sealing reads rows by (type, timestamp, seq), which the type index serves without a scan.
+void SQLiteDiskStorage::createPartitionTables(const std::string &rowsTable, const std::string &chunksTable)
+{
+    execute(("CREATE TABLE IF NOT EXISTS " + rowsTable + " ("
+             "timestamp INTEGER NOT NULL,"
+             "seq INTEGER NOT NULL,"
+             "type INTEGER NOT NULL,"
+             "value BLOB NOT NULL,"
+             "PRIMARY KEY (timestamp, seq)) WITHOUT ROWID").c_str());
+    execute(("CREATE INDEX IF NOT EXISTS " + typeIndexName(rowsTable) + " ON " + rowsTable +
+             " (type, timestamp, seq)").c_str());
+    execute(("CREATE TABLE IF NOT EXISTS " + chunksTable + " ("
+             "start_ts INTEGER NOT NULL,"
+             "seq INTEGER NOT NULL,"
+             "type INTEGER NOT NULL,"
+             "end_ts INTEGER NOT NULL,"
+             "count INTEGER NOT NULL,"
+             "payload BLOB NOT NULL,"
+             "value_sum REAL,"
+             "value_min REAL,"
+             "value_max REAL,"
+             "PRIMARY KEY (start_ts, seq)) WITHOUT ROWID").c_str());
+
+    // Tables from before pre-aggregates existed get the columns appended;
+    // their older chunks keep NULLs and are decoded instead
+    std::string name = chunksTable;
+    name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
+    if (queryInt(("SELECT count(*) FROM pragma_table_info('" + name + "') WHERE name = 'value_sum'").c_str(), 0) == 0)
+    {
+        for (const char *column : {"value_sum", "value_min", "value_max"})
+        {
+            execute(("ALTER TABLE " + chunksTable + " ADD COLUMN " + column + " REAL").c_str());
+        }
+    }
+
+    createSummaryIndex(chunksTable);
+}
+
+// Chunk rows are mostly payload, so few fit on a page; this covering
+// index lets aggregates and chunk filtering skip the payload pages
+void SQLiteDiskStorage::createSummaryIndex(const std::string &chunksTable)
+{
+    execute(("CREATE INDEX IF NOT EXISTS " + summaryIndexName(chunksTable) + " ON " + chunksTable +
+             " (start_ts, end_ts, type, count, value_sum, value_min, value_max)").c_str());
+}
+
+void SQLiteDiskStorage::dropSummaryIndex(const std::string &chunksTable)
+{
+    execute(("DROP INDEX IF EXISTS " + summaryIndexName(chunksTable)).c_str());
+}
+
+void SQLiteDiskStorage::loadPartitions()
+{
+    basePartition = std::make_unique<Partition>(std::numeric_limits<std::time_t>::min(),
+                                                std::numeric_limits<std::time_t>::max(),
+                                                "history", "history_chunks");
+    preparePartition(*basePartition);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT start_ts, end_ts FROM history_partitions", -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    partitions.clear();
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        std::time_t start = sqlite3_column_int64(stmt, 0);
+        auto partition = std::make_unique<Partition>(start, sqlite3_column_int64(stmt, 1),
+                                                     rowsTableName(start), chunksTableName(start));
+        preparePartition(*partition);
+        partitions[start] = std::move(partition);
+    }
+    sqlite3_finalize(stmt);
+}
+
+void SQLiteDiskStorage::loadUnsealedCounts(Partition &partition)
+{
+    sqlite3_stmt *stmt;
+    std::string sql = "SELECT type, count(*) FROM " + partition.rowsTable + " GROUP BY type";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    partition.unsealedCounts.fill(0);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        int type = sqlite3_column_int(stmt, 0);
+        if (type > 0 && type < static_cast<int>(partition.unsealedCounts.size()))
+            partition.unsealedCounts[type] = static_cast<size_t>(sqlite3_column_int64(stmt, 1));
+    }
+    sqlite3_finalize(stmt);
+}
+
+void SQLiteDiskStorage::setMeta(const char *key, int64_t value)
+{
+    sqlite3_bind_text(updateMetaStmt, 1, key, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(updateMetaStmt, 2, value);
+    int rc = sqlite3_step(updateMetaStmt);
+    sqlite3_reset(updateMetaStmt);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to update " + std::string(key) + ": " + sqlite3_errmsg(db));
+    }
+}
+
+void SQLiteDiskStorage::loadLegacyTables()
+{
+    static const std::string TYPE_FROM_TEXT = "CASE type WHEN 'double' THEN 1 WHEN 'int' THEN 2 "
+                                              "WHEN 'bool' THEN 3 WHEN 'string' THEN 4 END";
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT name FROM sqlite_master WHERE type = 'table' "
+                      "AND (name = 'history_legacy' OR name GLOB 'history_v[0-9]*')";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    legacyTables.clear();
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        legacyTables.push_back({reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)), "", "", ""});
+    }
+    sqlite3_finalize(stmt);
+
+    for (auto &table : legacyTables)
+    {
+        const std::string columns = "SELECT count(*) FROM pragma_table_info('" + table.name + "') ";
+        if (queryInt((columns + "WHERE name = 'id'").c_str(), 0) > 0)
+        {
+            // Version 0: ids become the seq of migrated rows, so new rows must start above them
+            table.keyColumns = "id";
+            table.seqColumn = "id";
+            nextSeq = std::max(nextSeq, queryInt(("SELECT max(id) FROM " + table.name).c_str(), 0) + 1);
+        }
+        else
+        {
+            table.keyColumns = "timestamp, seq";
+            table.seqColumn = "seq";
+        }
+        table.typeColumn = queryInt((columns + "WHERE name = 'type' AND upper(type) = 'TEXT'").c_str(), 0) > 0
+                               ? TYPE_FROM_TEXT
+                               : "type";
+    }
+}
+
+void SQLiteDiskStorage::setBackgroundCheckpointing(bool enabled)
+{
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    if (enabled == (checkpointer != nullptr))
+        return;
+
+    if (enabled)
+    {
+        // Installing a wal_hook replaces the autocheckpoint hook
+        checkpointer = std::make_unique<SQLiteCheckpointer>(dbPath, walSizeLimit);
+        sqlite3_wal_hook(db, &SQLiteCheckpointer::onWalCommit, checkpointer.get());
+    }
+    else
+    {
+        sqlite3_wal_autocheckpoint(db, 1000);
+        checkpointer.reset();
+    }
+}
+
+void SQLiteDiskStorage::setWalSizeLimit(size_t bytes)
+{
+    walSizeLimit = bytes;
+    if (checkpointer)
+        checkpointer->setWalSizeLimit(bytes);
+}
+
+size_t SQLiteDiskStorage::getWalSize() const
+{
+    return checkpointer ? checkpointer->getWalSize() : walBytes.load();
+}
+
+SQLiteCheckpointer::Stats SQLiteDiskStorage::getCheckpointStats() const
+{
+    return checkpointer ? checkpointer->getStats() : SQLiteCheckpointer::Stats();
+}
+
+// The bulk load owns the writer's transaction; a nested BEGIN would fail and its ROLLBACK would discard the load
+void SQLiteDiskStorage::checkWritable(const char *operation) const
+{
+    if (bulkLoader)
+    {
+        throw std::runtime_error(std::string(operation) + "() is not allowed during a bulk load");
+    }
+}
+
+std::unique_ptr<SQLiteDiskStorage::BulkLoader> SQLiteDiskStorage::beginBulkLoad()
+{
+    checkWritable("beginBulkLoad");
+    return std::make_unique<BulkLoader>(*this);
+}
+
+void SQLiteDiskStorage::optimizeConnection()
+{
+    const char *sql = "PRAGMA synchronous = NORMAL; "
+                      "PRAGMA journal_mode = WAL; "
+                      "PRAGMA temp_store = MEMORY;";
+    char *errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    {
+        std::string error = "SQL error: " + std::string(errMsg);
+        sqlite3_free(errMsg);
+        throw std::runtime_error(error);
+    }
+
+    // RESTART and TRUNCATE checkpoints briefly hold the write lock
+    sqlite3_busy_timeout(db, 5000);
+}
+
+void SQLiteDiskStorage::prepareStatements()
+{
+    const char *sql = "INSERT OR REPLACE INTO history_meta (key, value) VALUES (?, ?)";
+    if (sqlite3_prepare_v2(db, sql, -1, &updateMetaStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare metadata statement");
+    }
+    sql = "SELECT * FROM pragma_page_count(), pragma_freelist_count()";
+    if (sqlite3_prepare_v2(db, sql, -1, &pageStatsStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare page statistics statement");
+    }
+    pageSize = static_cast<size_t>(queryInt("PRAGMA page_size", 4096));
+
+    // Multi-row inserts are capped by the number of host parameters a statement may have
+    maxInsertBatchWidth = std::max(1, sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / PARAMS_PER_ROW);
+    insertBatchWidth = std::min(insertBatchWidth, maxInsertBatchWidth);
+
+    loadPartitions();
+}
+
+void SQLiteDiskStorage::preparePartition(Partition &partition)
+{
+    std::string sql = "SELECT timestamp, seq, value FROM " + partition.rowsTable +
+                      " WHERE type = ? ORDER BY timestamp, seq LIMIT ?";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.selectUnsealedStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare unsealed rows statement");
+    }
+
+    sql = "INSERT INTO " + partition.chunksTable +
+          " (start_ts, seq, type, end_ts, count, payload, value_sum, value_min, value_max) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.insertChunkStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare chunk insert statement");
+    }
+
+    sql = "DELETE FROM " + partition.rowsTable + " WHERE type = ? AND (timestamp, seq) <= (?, ?)";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.deleteSealedStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare sealed rows statement");
+    }
+
+    sql = "SELECT type, timestamp, seq FROM " + partition.rowsTable +
+          " WHERE timestamp < ? ORDER BY timestamp, seq LIMIT ?";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.selectExpiredStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare expired rows statement");
+    }
+
+    sql = "DELETE FROM " + partition.rowsTable + " WHERE (timestamp, seq) <= (?, ?)";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.deleteExpiredStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare expired rows delete statement");
+    }
+
+    // Picked through the summary index so the scan never reads payload pages
+    sql = "DELETE FROM " + partition.chunksTable + " WHERE (start_ts, seq) IN ("
+          "SELECT start_ts, seq FROM " + partition.chunksTable + " INDEXED BY " + summaryIndexName(partition.chunksTable) +
+          " WHERE start_ts < ?1 AND end_ts < ?1 ORDER BY start_ts LIMIT ?2)";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.deleteExpiredChunksStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare expired chunks statement");
+    }
+
+    // Widest of the chunks the statement above would delete
+    sql = "SELECT max(end_ts - start_ts) FROM (SELECT start_ts, end_ts FROM " + partition.chunksTable +
+          " INDEXED BY " + summaryIndexName(partition.chunksTable) +
+          " WHERE start_ts < ?1 AND end_ts < ?1 ORDER BY start_ts LIMIT ?2)";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &partition.selectExpiredSpanStmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare expired chunk span statement");
+    }
+
+    loadUnsealedCounts(partition);
+    loadChunkSpan(partition);
+}
+
+void SQLiteDiskStorage::loadChunkSpan(Partition &partition)
+{
+    partition.maxChunkSpan = queryInt(("SELECT value FROM history_meta WHERE key = '" +
+                                       chunkSpanKey(partition.chunksTable) + "'").c_str(), -1);
+    if (partition.maxChunkSpan < 0)
+        recomputeChunkSpan(partition);
+}
+
+void SQLiteDiskStorage::recomputeChunkSpan(Partition &partition)
+{
+    // Only both ends of each chunk are read, which the summary index covers
+    partition.maxChunkSpan = queryInt(("SELECT max(end_ts - start_ts) FROM " + partition.chunksTable).c_str(), 0);
+    setMeta(chunkSpanKey(partition.chunksTable).c_str(), partition.maxChunkSpan);
+}
+
+SQLiteDiskStorage::Partition &SQLiteDiskStorage::partitionFor(std::time_t timestamp)
+{
+    if (partitionSpan <= 0)
+        return *basePartition;
+
+    // Floor division so negative timestamps land in the right window
+    std::time_t start = (timestamp / partitionSpan) * partitionSpan;
+    if (start > timestamp)
+        start -= partitionSpan;
+
+    auto it = partitions.find(start);
+    if (it != partitions.end())
+        return *it->second;
+
+    auto partition = std::make_unique<Partition>(start, start + partitionSpan - 1,
+                                                 rowsTableName(start), chunksTableName(start));
+    createPartitionTables(partition->rowsTable, partition->chunksTable);
+    execute(("INSERT OR IGNORE INTO history_partitions (start_ts, end_ts) VALUES (" +
+             std::to_string(partition->start) + ", " + std::to_string(partition->end) + ")").c_str());
+    preparePartition(*partition);
+
+    Partition &created = *partition;
+    partitions[start] = std::move(partition);
+    return created;
+}
+
+std::string SQLiteDiskStorage::rowsTableName(std::time_t partitionStart)
+{
+    return "\"history_p" + std::to_string(partitionStart) + "\"";
+}
+
+std::string SQLiteDiskStorage::chunksTableName(std::time_t partitionStart)
+{
+    return "\"history_chunks_p" + std::to_string(partitionStart) + "\"";
+}
+
+std::vector<SQLiteDiskStorage::Partition *> SQLiteDiskStorage::partitionsInRange(std::time_t start, std::time_t end) const
+{
+    std::vector<Partition *> result = {basePartition.get()};
+
+    // Partitions are disjoint and sorted, so only those starting before end can overlap
+    for (auto it = partitions.begin(); it != partitions.end() && it->first <= end; ++it)
+    {
+        if (it->second->end >= start)
+            result.push_back(it->second.get());
+    }
+    return result;
+}
+
+void SQLiteDiskStorage::setInsertBatchWidth(size_t width)
+{
+    insertBatchWidth = std::max<size_t>(1, std::min(width, maxInsertBatchWidth));
+}
+
+sqlite3_stmt *SQLiteDiskStorage::getInsertStatement(Partition &partition, size_t rows)
+{
+    auto it = partition.insertStmts.find(rows);
+    if (it != partition.insertStmts.end())
+        return it->second;
+
+    std::string sql = "INSERT INTO " + partition.rowsTable + " (timestamp, seq, type, value) VALUES ";
+    for (size_t i = 0; i < rows; ++i)
+    {
+        sql += i == 0 ? "(?, ?, ?, ?)" : ", (?, ?, ?, ?)";
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare insert statement");
+    }
+    partition.insertStmts[rows] = stmt;
+    return stmt;
+}
+
+void SQLiteDiskStorage::bindEntry(Partition &partition, sqlite3_stmt *stmt, int offset, const HistoryEntry *entry)
+{
+    EntryType type = getEntryType(entry);
+    sqlite3_bind_int64(stmt, offset + 1, entry->getTimestamp());
+    sqlite3_bind_int64(stmt, offset + 2, nextSeq++);
+    sqlite3_bind_int(stmt, offset + 3, static_cast<int>(type));
+    partition.unsealedCounts[static_cast<size_t>(type)]++;
+
+    switch (type)
+    {
+    case EntryType::Double:
+        sqlite3_bind_double(stmt, offset + 4, static_cast<const TypedHistoryEntry<double> *>(entry)->getValue());
+        break;
+    case EntryType::Int:
+        sqlite3_bind_int(stmt, offset + 4, static_cast<const TypedHistoryEntry<int> *>(entry)->getValue());
+        break;
+    case EntryType::Bool:
+        sqlite3_bind_int(stmt, offset + 4, static_cast<const TypedHistoryEntry<bool> *>(entry)->getValue() ? 1 : 0);
+        break;
+    case EntryType::String:
+        sqlite3_bind_text(stmt, offset + 4, static_cast<const TypedHistoryEntry<std::string> *>(entry)->getValue().c_str(),
+                          -1, SQLITE_TRANSIENT);
+        break;
+    }
+}
+
+void SQLiteDiskStorage::insertRows(Partition &partition, const std::vector<std::unique_ptr<HistoryEntry>> &entries,
+                                   size_t begin, size_t end)
+{
+    // Full-width statements for the bulk of the run, one narrower statement for the tail
+    for (size_t i = begin; i < end;)
+    {
+        size_t rows = std::min(insertBatchWidth, end - i);
+        sqlite3_stmt *stmt = getInsertStatement(partition, rows);
+
+        for (size_t row = 0; row < rows; ++row)
+        {
+            bindEntry(partition, stmt, static_cast<int>(row * PARAMS_PER_ROW), entries[i + row].get());
+        }
+
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+        {
+            throw std::runtime_error("Failed to insert entries: " + std::string(sqlite3_errmsg(db)));
+        }
+        i += rows;
+    }
+}
+
+void SQLiteDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    auto request = std::make_unique<WriteRequest>();
+    request->entries = &entries;
+    std::future<void> done = request->done.get_future();
+    submitWrite(std::move(request));
+    done.get();
+}
+
+std::future<void> SQLiteDiskStorage::flushAsync(std::vector<std::unique_ptr<HistoryEntry>> entries)
+{
+    auto request = std::make_unique<WriteRequest>();
+    request->owned = std::move(entries);
+    request->entries = &request->owned;
+    std::future<void> done = request->done.get_future();
+    submitWrite(std::move(request));
+    return done;
+}
+
+void SQLiteDiskStorage::submitWrite(std::unique_ptr<WriteRequest> request)
+{
+    checkWritable("flush");
+    {
+        std::lock_guard<std::mutex> lock(writeQueueMutex);
+        writeQueue.push_back(std::move(request));
+    }
+    writeQueueCondition.notify_one();
+}
+
+void SQLiteDiskStorage::runWriter()
+{
+    std::unique_lock<std::mutex> lock(writeQueueMutex);
+    while (true)
+    {
+        writeQueueCondition.wait(lock, [this]
+                                 { return stoppingWriter || !writeQueue.empty(); });
+        if (writeQueue.empty())
+            break;
+
+        // Everything that queued up while the last transaction ran, within a bound
+        std::vector<std::unique_ptr<WriteRequest>> requests;
+        size_t entries = 0;
+        while (!writeQueue.empty() &&
+               (requests.empty() || entries + writeQueue.front()->entries->size() <= MAX_COALESCED_ENTRIES))
+        {
+            entries += writeQueue.front()->entries->size();
+            requests.push_back(std::move(writeQueue.front()));
+            writeQueue.pop_front();
+        }
+
+        lock.unlock();
+        writeBatches(requests);
+        lock.lock();
+    }
+}
+
+void SQLiteDiskStorage::commitRequests(const std::vector<std::unique_ptr<WriteRequest>> &requests, size_t first, size_t last)
+{
+    execute("BEGIN TRANSACTION");
+    try
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            writeEntries(*requests[i]->entries);
+        }
+        if (chunkSize > 0)
+        {
+            sealChunks();
+        }
+        setMeta("next_seq", nextSeq);
+        execute("COMMIT");
+    }
+    catch (...)
+    {
+        // Nothing the transaction did to the file or the counters may
+        // survive, so the batches can be written again as they are
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        nextSeq = queryInt("SELECT value FROM history_meta WHERE key = 'next_seq'", 1);
+        loadPartitions(); // Forgets partitions the transaction created and recounts unsealed rows
+        throw;
+    }
+    writeTransactionCount++;
+    refreshDiskUsage();
+}
+
+void SQLiteDiskStorage::writeBatches(std::vector<std::unique_ptr<WriteRequest>> &requests)
+{
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    size_t committed = 0;
+    try
+    {
+        commitRequests(requests, 0, requests.size());
+        committed = requests.size();
+        for (auto &request : requests)
+        {
+            request->done.set_value();
+        }
+    }
+    catch (...)
+    {
+        if (requests.size() == 1)
+        {
+            requests.front()->done.set_exception(std::current_exception());
+            return;
+        }
+        // One bad batch must not fail the ones coalesced with it, so each
+        // is retried in a transaction of its own
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            try
+            {
+                commitRequests(requests, i, i + 1);
+                committed++;
+                requests[i]->done.set_value();
+            }
+            catch (...)
+            {
+                requests[i]->done.set_exception(std::current_exception());
+            }
+        }
+    }
+    if (committed == 0)
+        return;
+
+    // Runs after the futures are ready, so flushes don't wait for it; the
+    // batches are committed either way, so failures here are only logged
+    try
+    {
+        // Piggyback one migration batch on each transaction until the legacy table is gone
+        if (!legacyTables.empty())
+        {
+            migrateLegacy();
+        }
+
+        if (retentionPeriod > 0)
+        {
+            expireBefore(std::time(nullptr) - retentionPeriod);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Maintenance after flush failed: " << e.what() << std::endl;
+    }
+}
+
+void SQLiteDiskStorage::writeEntries(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    // Entries mostly arrive in time order, so consecutive runs share a partition
+    for (size_t i = 0; i < entries.size();)
+    {
+        Partition &partition = partitionFor(entries[i]->getTimestamp());
+        size_t runEnd = i + 1;
+        while (runEnd < entries.size() && partition.contains(entries[runEnd]->getTimestamp()))
+        {
+            runEnd++;
+        }
+        insertRows(partition, entries, i, runEnd);
+        i = runEnd;
+    }
 }
 
-SQLiteDiskStorage::~SQLiteDiskStorage()
+void SQLiteDiskStorage::sealChunks()
 {
-    sqlite3_finalize(insertStmt);
-    sqlite3_close(db);
+    // Bounded per flush so a large backlog (e.g. after a migration) is sealed gradually
+    size_t sealed = 0;
+    std::vector<Partition *> all = partitionsInRange(std::numeric_limits<std::time_t>::min(),
+                                                     std::numeric_limits<std::time_t>::max());
+    for (Partition *partition : all)
+    {
+        for (EntryType type : {EntryType::Double, EntryType::Int, EntryType::Bool, EntryType::String})
+        {
+            while (partition->unsealedCounts[static_cast<size_t>(type)] >= chunkSize && sealed < MAX_SEALS_PER_FLUSH)
+            {
+                sealChunk(*partition, type);
+                sealed++;
+            }
+        }
+    }
 }
 
-void SQLiteDiskStorage::createTable()
+void SQLiteDiskStorage::sealChunk(Partition &partition, EntryType type)
 {
-    const char *sql = "CREATE TABLE IF NOT EXISTS history ("
-                      "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                      "timestamp INTEGER NOT NULL,"
-                      "type TEXT NOT NULL,"
-                      "value BLOB NOT NULL)";
+    ColumnBlock block(type);
+    int64_t firstSeq = 0, lastSeq = 0;
+    sqlite3_stmt *select = partition.selectUnsealedStmt;
 
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    sqlite3_bind_int(select, 1, static_cast<int>(type));
+    sqlite3_bind_int64(select, 2, static_cast<sqlite3_int64>(chunkSize));
+    int rc;
+    while ((rc = sqlite3_step(select)) == SQLITE_ROW)
     {
-        std::string error = "SQL error: " + std::string(errMsg);
-        sqlite3_free(errMsg);
-        throw std::runtime_error(error);
+        lastSeq = sqlite3_column_int64(select, 1);
+        if (block.empty())
+            firstSeq = lastSeq;
+        block.timestamps.push_back(sqlite3_column_int64(select, 0));
+
+        switch (type)
+        {
+        case EntryType::Double:
+            block.doubles.push_back(sqlite3_column_double(select, 2));
+            break;
+        case EntryType::Int:
+        case EntryType::Bool:
+            block.integers.push_back(sqlite3_column_int64(select, 2));
+            break;
+        case EntryType::String:
+            block.strings.emplace_back(reinterpret_cast<const char *>(sqlite3_column_text(select, 2)),
+                                       sqlite3_column_bytes(select, 2));
+            break;
+        }
+    }
+    sqlite3_reset(select);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to read rows to seal: " + std::string(sqlite3_errmsg(db)));
     }
-}
 
-void SQLiteDiskStorage::optimizeConnection()
-{
-    const char *sql = "PRAGMA synchronous = NORMAL; "
-                      "PRAGMA journal_mode = WAL; "
-                      "PRAGMA temp_store = MEMORY;";
-    char *errMsg = nullptr;
-    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    size_t &unsealed = partition.unsealedCounts[static_cast<size_t>(type)];
+    if (block.empty())
     {
-        std::string error = "SQL error: " + std::string(errMsg);
-        sqlite3_free(errMsg);
-        throw std::runtime_error(error);
+        unsealed = 0;
+        return;
+    }
+
+    insertChunk(partition, block, firstSeq);
+
+    sqlite3_stmt *remove = partition.deleteSealedStmt;
+    sqlite3_bind_int(remove, 1, static_cast<int>(type));
+    sqlite3_bind_int64(remove, 2, block.timestamps.back());
+    sqlite3_bind_int64(remove, 3, lastSeq);
+    rc = sqlite3_step(remove);
+    sqlite3_reset(remove);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to delete sealed rows: " + std::string(sqlite3_errmsg(db)));
     }
+
+    unsealed -= std::min(unsealed, block.size());
 }
 
-void SQLiteDiskStorage::prepareStatements()
+void SQLiteDiskStorage::insertChunk(Partition &partition, const ColumnBlock &block, int64_t firstSeq)
 {
-    const char *sql = "INSERT INTO history (timestamp, type, value) VALUES (?, ?, ?)";
-    if (sqlite3_prepare_v2(db, sql, -1, &insertStmt, nullptr) != SQLITE_OK)
+    std::vector<uint8_t> payload;
+    BlockCodec::encode(block, payload);
+
+    sqlite3_stmt *insert = partition.insertChunkStmt;
+    sqlite3_bind_int64(insert, 1, block.timestamps.front());
+    sqlite3_bind_int64(insert, 2, firstSeq);
+    sqlite3_bind_int(insert, 3, static_cast<int>(block.type));
+    sqlite3_bind_int64(insert, 4, block.timestamps.back());
+    sqlite3_bind_int64(insert, 5, static_cast<sqlite3_int64>(block.size()));
+    sqlite3_bind_blob(insert, 6, payload.data(), static_cast<int>(payload.size()), SQLITE_STATIC);
+    if (block.type == EntryType::String)
     {
-        throw std::runtime_error("Failed to prepare insert statement");
+        for (int column = 7; column <= 9; ++column)
+            sqlite3_bind_null(insert, column);
+    }
+    else
+    {
+        Aggregate summary;
+        block.aggregate(0, block.size(), summary);
+        sqlite3_bind_double(insert, 7, summary.sum);
+        sqlite3_bind_double(insert, 8, summary.min);
+        sqlite3_bind_double(insert, 9, summary.max);
+    }
+    int rc = sqlite3_step(insert);
+    sqlite3_reset(insert);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to insert chunk: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    if (block.timestamps.back() - block.timestamps.front() > partition.maxChunkSpan)
+    {
+        partition.maxChunkSpan = block.timestamps.back() - block.timestamps.front();
+        setMeta(chunkSpanKey(partition.chunksTable).c_str(), partition.maxChunkSpan);
     }
 }
 
-void SQLiteDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+void SQLiteDiskStorage::retrieveRows(SQLiteReader &reader, const std::string &sql, std::time_t start, std::time_t end,
+                                     std::vector<std::unique_ptr<HistoryEntry>> &results)
 {
-    sqlite3_exec(db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+    sqlite3_stmt *stmt = reader.prepare(sql);
+    sqlite3_bind_int64(stmt, 1, start);
+    sqlite3_bind_int64(stmt, 2, end);
 
-    for (const auto &entry : entries)
+    try
     {
-        sqlite3_bind_int64(insertStmt, 1, entry->getTimestamp());
-
-        // Determine the type and bind appropriately
-        if (auto *doubleEntry = dynamic_cast<TypedHistoryEntry<double> *>(entry.get()))
+        while (sqlite3_step(stmt) == SQLITE_ROW)
         {
-            sqlite3_bind_text(insertStmt, 2, "double", -1, SQLITE_STATIC);
-            sqlite3_bind_double(insertStmt, 3, doubleEntry->getValue());
+            results.push_back(decodeRow(stmt));
         }
-        else if (auto *intEntry = dynamic_cast<TypedHistoryEntry<int> *>(entry.get()))
+    }
+    catch (...)
+    {
+        sqlite3_reset(stmt);
+        throw;
+    }
+
+    sqlite3_reset(stmt);
+}
+
+void SQLiteDiskStorage::retrieveChunks(SQLiteReader &reader, const std::string &chunksTable, std::time_t start, std::time_t end,
+                                       std::vector<std::unique_ptr<HistoryEntry>> &results)
+{
+    sqlite3_stmt *stmt = reader.prepare("SELECT payload FROM " + chunksTable +
+                                        " WHERE start_ts BETWEEN ?1 - ?3 AND ?2 AND end_ts >= ?1");
+    sqlite3_bind_int64(stmt, 1, start);
+    sqlite3_bind_int64(stmt, 2, end);
+    sqlite3_bind_int64(stmt, 3, readChunkSpan(reader, chunksTable));
+
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        ColumnBlock block;
+        try
         {
-            sqlite3_bind_text(insertStmt, 2, "int", -1, SQLITE_STATIC);
-            sqlite3_bind_int(insertStmt, 3, intEntry->getValue());
+            block = BlockCodec::decode(static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 0)),
+                                       sqlite3_column_bytes(stmt, 0));
         }
-        else if (auto *boolEntry = dynamic_cast<TypedHistoryEntry<bool> *>(entry.get()))
+        catch (...)
         {
-            sqlite3_bind_text(insertStmt, 2, "bool", -1, SQLITE_STATIC);
-            sqlite3_bind_int(insertStmt, 3, boolEntry->getValue() ? 1 : 0);
+            sqlite3_reset(stmt);
+            throw;
         }
-        else if (auto *stringEntry = dynamic_cast<TypedHistoryEntry<std::string> *>(entry.get()))
+        for (size_t i = 0; i < block.size(); ++i)
         {
-            sqlite3_bind_text(insertStmt, 2, "string", -1, SQLITE_STATIC);
-            sqlite3_bind_text(insertStmt, 3, stringEntry->getValue().c_str(), -1, SQLITE_TRANSIENT);
+            if (block.timestamps[i] >= start && block.timestamps[i] <= end)
+            {
+                results.push_back(block.makeEntry(i));
+            }
         }
-        else
+    }
+
+    sqlite3_reset(stmt);
+}
+
+size_t SQLiteDiskStorage::query(const std::string &sql, const std::function<void(sqlite3_stmt *)> &onRow)
+{
+    // The tier is settled before the snapshot, so an entry is either still
+    // in the tier or already committed to it
+    HotTier *tier = hotTier;
+    if (tier)
+        tier->prepareHotScan();
+
+    auto reader = readerPool.acquire();
+    std::vector<LegacyTable> legacy;
+    openSnapshot(*reader, legacy);
+    updateUnifiedView(*reader, legacy);
+
+    sqlite3 *handle = reader->getHandle();
+    sqlite3_stmt *stmt;
+    const char *tail = nullptr;
+    if (sqlite3_prepare_v2(handle, sql.c_str(), -1, &stmt, &tail) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare query: " + std::string(sqlite3_errmsg(handle)));
+    }
+    if (!stmt || std::string(tail).find_first_not_of(" \t\r\n;") != std::string::npos)
+    {
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("query() takes exactly one statement");
+    }
+
+    size_t rows = 0;
+    int rc;
+    try
+    {
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
         {
-            throw std::runtime_error("Unknown entry type");
+            onRow(stmt);
+            rows++;
         }
+    }
+    catch (...)
+    {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+    if (rc != SQLITE_DONE)
+    {
+        std::string error = sqlite3_errmsg(handle);
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("Query failed: " + error);
+    }
+    sqlite3_finalize(stmt);
+    reader->endSnapshot();
+    return rows;
+}
+
+void SQLiteDiskStorage::updateUnifiedView(SQLiteReader &reader, const std::vector<LegacyTable> &legacy)
+{
+    std::vector<std::string> branches = {"SELECT timestamp, type, value FROM history_ram",
+                                         "SELECT timestamp, type, value FROM history",
+                                         "SELECT timestamp, type, value FROM history_chunk_scan('history_chunks')"};
+    for (std::time_t partitionStart : partitionsInSnapshot(reader, std::numeric_limits<std::time_t>::min(),
+                                                           std::numeric_limits<std::time_t>::max()))
+    {
+        branches.push_back("SELECT timestamp, type, value FROM " + rowsTableName(partitionStart));
+        branches.push_back("SELECT timestamp, type, value FROM history_chunk_scan('history_chunks_p" +
+                           std::to_string(partitionStart) + "')");
+    }
+    for (const auto &table : legacy)
+    {
+        branches.push_back("SELECT timestamp, " + table.typeColumn + ", value FROM " + table.name);
+    }
 
-        if (sqlite3_step(insertStmt) != SQLITE_DONE)
+    // Nested compounds stay under SQLite's limit on terms per compound
+    // SELECT; WHERE terms on the view are still pushed into every branch
+    while (branches.size() > 1)
+    {
+        std::vector<std::string> grouped;
+        for (size_t i = 0; i < branches.size(); i += MAX_UNION_BRANCHES)
         {
-            std::cerr << "Error inserting entry: " << sqlite3_errmsg(db) << std::endl;
+            std::string group;
+            for (size_t j = i; j < std::min(branches.size(), i + MAX_UNION_BRANCHES); ++j)
+            {
+                group += (j == i ? "" : " UNION ALL ") + branches[j];
+            }
+            grouped.push_back(branches.size() > MAX_UNION_BRANCHES ? "SELECT * FROM (" + group + ")" : group);
         }
+        branches = std::move(grouped);
+    }
+    // The view only changes when partitions or legacy tables come or go.
+    // SQLite keeps the definition without the TEMP keyword.
+    std::string definition = "CREATE VIEW history_all AS " + branches[0];
+    sqlite3_stmt *stmt = reader.prepare("SELECT sql FROM sqlite_temp_master WHERE type = 'view' AND name = 'history_all'");
+    std::string current;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        current = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+    sqlite3_reset(stmt);
+    if (current == definition)
+        return;
 
-        sqlite3_reset(insertStmt);
+    std::string sql = "DROP VIEW IF EXISTS temp.history_all; CREATE TEMP VIEW history_all AS " + branches[0];
+    char *error = nullptr;
+    if (sqlite3_exec(reader.getHandle(), sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+    {
+        std::string message = error ? error : "unknown error";
+        sqlite3_free(error);
+        throw std::runtime_error("Failed to create history_all view: " + message);
     }
+}
 
-    sqlite3_exec(db, "END TRANSACTION", nullptr, nullptr, nullptr);
+void SQLiteDiskStorage::openSnapshot(SQLiteReader &reader, std::vector<LegacyTable> &legacy)
+{
+    // The first read pins the snapshot; holding legacyMutex until then keeps
+    // the legacy table list in step with it
+    std::shared_lock<std::shared_mutex> lock(legacyMutex);
+    reader.beginSnapshot();
+    reader.queryInt("SELECT value FROM history_meta WHERE key = 'next_seq'", 0);
+    legacy = legacyTables;
+}
+
+std::vector<std::time_t> SQLiteDiskStorage::partitionsInSnapshot(SQLiteReader &reader, std::time_t start, std::time_t end)
+{
+    // The partition catalog is read from the reader's snapshot, and partitions
+    // outside the range are never touched
+    std::vector<std::time_t> overlapping;
+    sqlite3_stmt *stmt = reader.prepare("SELECT start_ts FROM history_partitions "
+                                        "WHERE start_ts <= ?2 AND end_ts >= ?1 ORDER BY start_ts");
+    sqlite3_bind_int64(stmt, 1, start);
+    sqlite3_bind_int64(stmt, 2, end);
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+    {
+        overlapping.push_back(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    return overlapping;
 }
 
 std::vector<std::unique_ptr<HistoryEntry>> SQLiteDiskStorage::retrieve(std::time_t start, std::time_t end)
 {
     std::vector<std::unique_ptr<HistoryEntry>> results;
-    const char *sql = "SELECT timestamp, type, value FROM history WHERE timestamp BETWEEN ? AND ?";
-    sqlite3_stmt *stmt;
+    auto reader = readerPool.acquire();
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    std::vector<LegacyTable> legacy;
+    openSnapshot(*reader, legacy);
+
+    retrieveRows(*reader, "SELECT timestamp, type, value FROM history WHERE timestamp BETWEEN ?1 AND ?2", start, end, results);
+    retrieveChunks(*reader, "history_chunks", start, end, results);
+    for (std::time_t partitionStart : partitionsInSnapshot(*reader, start, end))
+    {
+        retrieveRows(*reader, "SELECT timestamp, type, value FROM " + rowsTableName(partitionStart) +
+                                  " WHERE timestamp BETWEEN ?1 AND ?2",
+                     start, end, results);
+        retrieveChunks(*reader, chunksTableName(partitionStart), start, end, results);
+    }
+
+    for (const auto &table : legacy)
+    {
+        retrieveRows(*reader, "SELECT timestamp, " + table.typeColumn + ", value FROM " + table.name +
+                                  " WHERE timestamp BETWEEN ?1 AND ?2",
+                     start, end, results);
+    }
+
+    reader->endSnapshot();
+    return results;
+}
+
+std::future<std::vector<std::unique_ptr<HistoryEntry>>> SQLiteDiskStorage::retrieveAsync(std::time_t start, std::time_t end)
+{
+    std::call_once(retrieveWorkersStarted, [this]
+                   { retrieveWorkers = std::make_unique<WorkerPool>(readerPool.getMaxReaders()); });
+
+    auto task = std::make_shared<std::packaged_task<std::vector<std::unique_ptr<HistoryEntry>>()>>([this, start, end]
+                                                                                                   { return retrieve(start, end); });
+    auto result = task->get_future();
+    retrieveWorkers->submit([task]
+                            { (*task)(); });
+    return result;
+}
+
+std::unique_ptr<HistoryCursor> SQLiteDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    auto reader = readerPool.acquire();
+
+    std::vector<LegacyTable> legacy;
+    openSnapshot(*reader, legacy);
+
+    std::vector<std::pair<std::string, std::string>> partitionTables;
+    for (std::time_t partitionStart : partitionsInSnapshot(*reader, start, end))
     {
-        throw std::runtime_error("Failed to prepare statement");
+        partitionTables.emplace_back(rowsTableName(partitionStart), chunksTableName(partitionStart));
     }
 
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    inputs.push_back(openTableCursor(*reader, "history", "history_chunks", start, end));
+    inputs.push_back(std::make_unique<PartitionCursor>(*reader, std::move(partitionTables), start, end));
+    for (const auto &table : legacy)
+    {
+        // Legacy layouts may lack a timestamp index; SQLite sorts these itself
+        sqlite3_stmt *stmt = reader->prepare("SELECT timestamp, " + table.typeColumn + ", value FROM " + table.name +
+                                             " WHERE timestamp BETWEEN ?1 AND ?2 ORDER BY timestamp");
+        sqlite3_bind_int64(stmt, 1, start);
+        sqlite3_bind_int64(stmt, 2, end);
+        inputs.push_back(std::make_unique<RowCursor>(stmt));
+    }
+
+    return std::make_unique<SQLiteCursor>(std::move(reader), std::move(inputs));
+}
+
+void SQLiteDiskStorage::aggregateRows(SQLiteReader &reader, const std::string &sql, std::time_t start, std::time_t end,
+                                      Aggregate &result)
+{
+    // Columns: count, total, min, max; min and max are NULL when nothing matched
+    sqlite3_stmt *stmt = reader.prepare(sql);
     sqlite3_bind_int64(stmt, 1, start);
     sqlite3_bind_int64(stmt, 2, end);
-
-    while (sqlite3_step(stmt) == SQLITE_ROW)
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) > 0)
     {
-        std::time_t timestamp = sqlite3_column_int64(stmt, 0);
-        std::string type = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        Aggregate partial;
+        partial.count = static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+        partial.sum = sqlite3_column_double(stmt, 1);
+        partial.min = sqlite3_column_double(stmt, 2);
+        partial.max = sqlite3_column_double(stmt, 3);
+        result.merge(partial);
+    }
+    sqlite3_reset(stmt);
+}
 
-        if (type == "double")
-        {
-            double value = sqlite3_column_double(stmt, 2);
-            results.push_back(std::make_unique<TypedHistoryEntry<double>>(timestamp, value));
-        }
-        else if (type == "int")
-        {
-            int value = sqlite3_column_int(stmt, 2);
-            results.push_back(std::make_unique<TypedHistoryEntry<int>>(timestamp, value));
-        }
-        else if (type == "bool")
-        {
-            bool value = sqlite3_column_int(stmt, 2) != 0;
-            results.push_back(std::make_unique<TypedHistoryEntry<bool>>(timestamp, value));
-        }
-        else if (type == "string")
-        {
-            const char *value = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
-            results.push_back(std::make_unique<TypedHistoryEntry<std::string>>(timestamp, std::string(value)));
-        }
-        else
+void SQLiteDiskStorage::aggregateTables(SQLiteReader &reader, const std::string &rowsTable, const std::string &chunksTable,
+                                        std::time_t start, std::time_t end, Aggregate &result)
+{
+    aggregateRows(reader, "SELECT count(value), total(value), min(value), max(value) FROM " + rowsTable +
+                              " WHERE timestamp BETWEEN ?1 AND ?2 AND type IN (1, 2, 3)",
+                  start, end, result);
+
+    // Chunks wholly inside the range answer from their pre-aggregates
+    aggregateRows(reader, "SELECT sum(count), total(value_sum), min(value_min), max(value_max) FROM " + chunksTable +
+                              " WHERE start_ts BETWEEN ?1 AND ?2 AND end_ts <= ?2 AND value_sum IS NOT NULL",
+                  start, end, result);
+
+    // Chunks straddling a range edge, or sealed before pre-aggregates existed, are decoded
+    // The keys are picked from the covering index first; filtering on the
+    // table itself would read every payload-heavy row in the range
+    sqlite3_stmt *stmt = reader.prepare("SELECT payload FROM " + chunksTable + " WHERE (start_ts, seq) IN ("
+                                        "SELECT start_ts, seq FROM " + chunksTable + " INDEXED BY " + summaryIndexName(chunksTable) +
+                                        " WHERE start_ts BETWEEN ?1 - ?3 AND ?2 AND end_ts >= ?1 AND type IN (1, 2, 3)"
+                                        " AND (start_ts < ?1 OR end_ts > ?2 OR value_sum IS NULL))");
+    sqlite3_bind_int64(stmt, 1, start);
+    sqlite3_bind_int64(stmt, 2, end);
+    sqlite3_bind_int64(stmt, 3, readChunkSpan(reader, chunksTable));
+    try
+    {
+        while (sqlite3_step(stmt) == SQLITE_ROW)
         {
-            throw std::runtime_error("Unknown type in database");
+            ColumnBlock block = BlockCodec::decode(static_cast<const uint8_t *>(sqlite3_column_blob(stmt, 0)),
+                                                   sqlite3_column_bytes(stmt, 0));
+            const auto &timestamps = block.timestamps;
+            size_t from = std::lower_bound(timestamps.begin(), timestamps.end(), start) - timestamps.begin();
+            size_t to = std::upper_bound(timestamps.begin(), timestamps.end(), end) - timestamps.begin();
+            if (from < to)
+                block.aggregate(from, to, result);
         }
     }
+    catch (...)
+    {
+        sqlite3_reset(stmt);
+        throw;
+    }
+    sqlite3_reset(stmt);
+}
 
-    sqlite3_finalize(stmt);
-    return results;
+Aggregate SQLiteDiskStorage::aggregate(std::time_t start, std::time_t end)
+{
+    Aggregate result;
+    auto reader = readerPool.acquire();
+
+    std::vector<LegacyTable> legacy;
+    openSnapshot(*reader, legacy);
+
+    aggregateTables(*reader, "history", "history_chunks", start, end, result);
+    for (std::time_t partitionStart : partitionsInSnapshot(*reader, start, end))
+    {
+        aggregateTables(*reader, rowsTableName(partitionStart), chunksTableName(partitionStart), start, end, result);
+    }
+
+    for (const auto &table : legacy)
+    {
+        aggregateRows(*reader, "SELECT count(value), total(value), min(value), max(value) FROM " + table.name +
+                                   " WHERE timestamp BETWEEN ?1 AND ?2 AND " + table.typeColumn + " IN (1, 2, 3)",
+                      start, end, result);
+    }
+
+    reader->endSnapshot();
+    return result;
 }
 
-size_t SQLiteDiskStorage::getDiskUsage() const
+void SQLiteDiskStorage::refreshDiskUsage()
 {
-    std::string mainDbPath = dbPath;
-    std::string walPath = mainDbPath + "-wal";
-    std::string shmPath = mainDbPath + "-shm";
+    if (sqlite3_step(pageStatsStmt) == SQLITE_ROW)
+    {
+        pageCount = static_cast<size_t>(sqlite3_column_int64(pageStatsStmt, 0));
+        freelistCount = static_cast<size_t>(sqlite3_column_int64(pageStatsStmt, 1));
+    }
+    sqlite3_reset(pageStatsStmt);
 
-    size_t mainSize = std::filesystem::file_size(mainDbPath);
-    size_t walSize = std::filesystem::exists(walPath) ? std::filesystem::file_size(walPath) : 0;
-    size_t shmSize = std::filesystem::exists(shmPath) ? std::filesystem::file_size(shmPath) : 0;
+    if (!checkpointer)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(dbPath + "-wal", error);
+        walBytes = error ? 0 : static_cast<size_t>(size);
+    }
+}
 
-    std::cout << "Main DB file (" << mainDbPath << ") size: " << mainSize << " bytes" << std::endl;
-    std::cout << "WAL file size: " << walSize << " bytes" << std::endl;
-    std::cout << "SHM file size: " << shmSize << " bytes" << std::endl;
+SQLiteDiskStorage::DiskUsage SQLiteDiskStorage::getDiskUsageBreakdown() const
+{
+    DiskUsage usage;
+    size_t pages = pageCount;
+    size_t freePages = std::min<size_t>(freelistCount, pages);
+    usage.liveBytes = (pages - freePages) * pageSize;
+    usage.freeBytes = freePages * pageSize;
+    usage.walBytes = getWalSize();
+    return usage;
+}
 
-    return mainSize + walSize + shmSize;
+size_t SQLiteDiskStorage::getDiskUsage() const
+{
+    return getDiskUsageBreakdown().total();
 }
 
 size_t SQLiteDiskStorage::getEntryCount() const
 {
-    const char *sql = "SELECT COUNT(*) FROM history";
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    std::string sql = "SELECT 0";
+    for (Partition *partition : partitionsInRange(std::numeric_limits<std::time_t>::min(),
+                                                  std::numeric_limits<std::time_t>::max()))
+    {
+        sql += " + (SELECT COUNT(*) FROM " + partition->rowsTable + ")"
+               " + (SELECT COALESCE(SUM(count), 0) FROM " + partition->chunksTable + ")";
+    }
+    for (const auto &table : legacyTables)
+    {
+        sql += " + (SELECT COUNT(*) FROM " + table.name + ")";
+    }
     sqlite3_stmt *stmt;
 
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK)
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
     {
         throw std::runtime_error("Failed to prepare statement for count query");
     }
@@ -193,14 +1503,259 @@ size_t SQLiteDiskStorage::getEntryCount() const
 
 void SQLiteDiskStorage::clear()
 {
-    const char *sql = "DELETE FROM history; VACUUM;";
+    checkWritable("clear");
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    {
+        std::unique_lock<std::shared_mutex> lock(legacyMutex);
+        for (const auto &table : legacyTables)
+        {
+            execute(("DROP TABLE " + table.name).c_str());
+        }
+        legacyTables.clear();
+    }
+    dropPartitionsBefore(std::numeric_limits<std::time_t>::max());
+
+    basePartition->unsealedCounts.fill(0);
+    basePartition->maxChunkSpan = 0;
+
+    // incremental_vacuum gives every free page back without rewriting the live ones
+    std::string sql = "DELETE FROM history; DELETE FROM history_chunks; "
+                      "UPDATE history_meta SET value = 0 WHERE key = '" + chunkSpanKey("history_chunks") + "'; " +
+                      (incrementalVacuum ? "PRAGMA incremental_vacuum;" : "VACUUM;");
     char *errMsg = nullptr;
-    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK)
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK)
     {
         std::string error = "SQL error in clear(): " + std::string(errMsg);
         sqlite3_free(errMsg);
         throw std::runtime_error(error);
     }
 
+    incrementalVacuum = queryInt("PRAGMA auto_vacuum", 0) == 2;
+    refreshDiskUsage();
     std::cout << "Database cleared successfully." << std::endl;
-}
\ No newline at end of file
+}
+
+bool SQLiteDiskStorage::migrateLegacy(size_t batchSize)
+{
+    checkWritable("migrateLegacy");
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    if (legacyTables.empty())
+        return true;
+
+    const LegacyTable &table = legacyTables.back();
+    const std::string oldest = "SELECT " + table.keyColumns + " FROM " + table.name +
+                               " ORDER BY " + table.keyColumns + " LIMIT " + std::to_string(batchSize);
+
+    execute("BEGIN IMMEDIATE TRANSACTION");
+    try
+    {
+        execute(("INSERT INTO history (timestamp, seq, type, value) "
+                 "SELECT timestamp, " + table.seqColumn + ", " + table.typeColumn + ", value FROM " + table.name +
+                 " ORDER BY " + table.keyColumns + " LIMIT " + std::to_string(batchSize)).c_str());
+
+        if (sqlite3_changes(db) == 0)
+        {
+            std::unique_lock<std::shared_mutex> lock(legacyMutex);
+            execute(("DROP TABLE " + table.name).c_str());
+            execute("COMMIT");
+            refreshDiskUsage();
+            std::cout << "Migration of " << table.name << " completed." << std::endl;
+            legacyTables.pop_back();
+            lock.unlock();
+            loadUnsealedCounts(*basePartition);
+            return legacyTables.empty();
+        }
+
+        execute(("DELETE FROM " + table.name + " WHERE (" + table.keyColumns + ") IN (" + oldest + ")").c_str());
+        execute("COMMIT");
+        refreshDiskUsage();
+    }
+    catch (...)
+    {
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        throw;
+    }
+    return false;
+}
+
+bool SQLiteDiskStorage::isMigrating() const
+{
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    return !legacyTables.empty();
+}
+
+size_t SQLiteDiskStorage::getChunkCount() const
+{
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    std::string sql = "SELECT 0";
+    for (Partition *partition : partitionsInRange(std::numeric_limits<std::time_t>::min(),
+                                                  std::numeric_limits<std::time_t>::max()))
+    {
+        sql += " + (SELECT COUNT(*) FROM " + partition->chunksTable + ")";
+    }
+    return static_cast<size_t>(queryInt(sql.c_str(), 0));
+}
+
+size_t SQLiteDiskStorage::getPartitionCount() const
+{
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    return partitions.size();
+}
+
+size_t SQLiteDiskStorage::dropPartitionsBefore(std::time_t cutoff)
+{
+    checkWritable("dropPartitionsBefore");
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    size_t dropped = 0;
+    execute("BEGIN IMMEDIATE TRANSACTION");
+    try
+    {
+        for (auto it = partitions.begin(); it != partitions.end() && it->second->end < cutoff;)
+        {
+            Partition &partition = *it->second;
+            execute(("DROP TABLE " + partition.rowsTable).c_str());
+            execute(("DROP TABLE " + partition.chunksTable).c_str());
+            execute(("DELETE FROM history_partitions WHERE start_ts = " + std::to_string(partition.start)).c_str());
+            execute(("DELETE FROM history_meta WHERE key = '" + chunkSpanKey(partition.chunksTable) + "'").c_str());
+            it = partitions.erase(it);
+            dropped++;
+        }
+        execute("COMMIT");
+        refreshDiskUsage();
+    }
+    catch (...)
+    {
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        loadPartitions();
+        throw;
+    }
+    return dropped;
+}
+
+size_t SQLiteDiskStorage::expireRows(Partition &partition, std::time_t cutoff, size_t batchSize)
+{
+    // Find the last key of the batch, then delete everything up to it with one range delete
+    sqlite3_stmt *select = partition.selectExpiredStmt;
+    sqlite3_bind_int64(select, 1, cutoff);
+    sqlite3_bind_int64(select, 2, static_cast<sqlite3_int64>(batchSize));
+
+    std::array<size_t, 5> expired{};
+    size_t count = 0;
+    int64_t lastTimestamp = 0, lastSeq = 0;
+    while (sqlite3_step(select) == SQLITE_ROW)
+    {
+        int type = sqlite3_column_int(select, 0);
+        if (type > 0 && type < static_cast<int>(expired.size()))
+            expired[type]++;
+        lastTimestamp = sqlite3_column_int64(select, 1);
+        lastSeq = sqlite3_column_int64(select, 2);
+        count++;
+    }
+    sqlite3_reset(select);
+    if (count == 0)
+        return 0;
+
+    sqlite3_stmt *remove = partition.deleteExpiredStmt;
+    sqlite3_bind_int64(remove, 1, lastTimestamp);
+    sqlite3_bind_int64(remove, 2, lastSeq);
+    int rc = sqlite3_step(remove);
+    sqlite3_reset(remove);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to delete expired rows: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    for (size_t type = 0; type < expired.size(); ++type)
+    {
+        partition.unsealedCounts[type] -= std::min(partition.unsealedCounts[type], expired[type]);
+    }
+    return count;
+}
+
+size_t SQLiteDiskStorage::expireChunks(Partition &partition, std::time_t cutoff, size_t batchSize)
+{
+    sqlite3_stmt *select = partition.selectExpiredSpanStmt;
+    sqlite3_bind_int64(select, 1, cutoff);
+    sqlite3_bind_int64(select, 2, static_cast<sqlite3_int64>(batchSize));
+    int64_t expiredSpan = -1;
+    if (sqlite3_step(select) == SQLITE_ROW && sqlite3_column_type(select, 0) != SQLITE_NULL)
+        expiredSpan = sqlite3_column_int64(select, 0);
+    sqlite3_reset(select);
+    if (expiredSpan < 0)
+        return 0;
+
+    sqlite3_stmt *remove = partition.deleteExpiredChunksStmt;
+    sqlite3_bind_int64(remove, 1, cutoff);
+    sqlite3_bind_int64(remove, 2, static_cast<sqlite3_int64>(batchSize));
+    int rc = sqlite3_step(remove);
+    sqlite3_reset(remove);
+    if (rc != SQLITE_DONE)
+    {
+        throw std::runtime_error("Failed to delete expired chunks: " + std::string(sqlite3_errmsg(db)));
+    }
+    size_t count = static_cast<size_t>(sqlite3_changes(db));
+
+    // Deleting the widest chunk lets the seek window shrink to what is left
+    if (expiredSpan >= partition.maxChunkSpan)
+        recomputeChunkSpan(partition);
+    return count;
+}
+
+bool SQLiteDiskStorage::expireBefore(std::time_t cutoff, size_t batchSize)
+{
+    checkWritable("expireBefore");
+    std::lock_guard<std::recursive_mutex> lock(writerMutex);
+    bool done = true;
+
+    // A whole partition goes with a table drop; one per step keeps each step short
+    if (!partitions.empty() && partitions.begin()->second->end < cutoff)
+    {
+        retentionStats.partitionsDropped += dropPartitionsBefore(partitions.begin()->second->end + 1);
+        done = false;
+    }
+    else
+    {
+        // Chunks hold chunkSize samples each, so they are deleted in proportionally smaller batches
+        size_t chunkBatch = std::max<size_t>(1, batchSize / std::max<size_t>(1, chunkSize));
+        size_t rows = 0, chunks = 0;
+
+        execute("BEGIN IMMEDIATE TRANSACTION");
+        try
+        {
+            for (Partition *partition : partitionsInRange(std::numeric_limits<std::time_t>::min(), cutoff - 1))
+            {
+                rows += expireRows(*partition, cutoff, batchSize - std::min(batchSize, rows));
+                chunks += expireChunks(*partition, cutoff, chunkBatch - std::min(chunkBatch, chunks));
+            }
+            execute("COMMIT");
+        }
+        catch (...)
+        {
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+            for (Partition *partition : partitionsInRange(std::numeric_limits<std::time_t>::min(), cutoff - 1))
+            {
+                loadUnsealedCounts(*partition);
+                loadChunkSpan(*partition);
+            }
+            throw;
+        }
+
+        retentionStats.rowsDeleted += rows;
+        retentionStats.chunksDeleted += chunks;
+        if (rows >= batchSize || chunks >= chunkBatch)
+            done = false;
+    }
+
+    // Freed pages sit on the freelist until an incremental vacuum moves them to the end of the file and truncates
+    refreshDiskUsage();
+    if (incrementalVacuum && freelistCount > 0)
+    {
+        size_t before = pageCount;
+        execute(("PRAGMA incremental_vacuum(" + std::to_string(VACUUM_PAGES_PER_STEP) + ")").c_str());
+        refreshDiskUsage();
+        retentionStats.bytesReclaimed += (before - std::min(before, pageCount.load())) * pageSize;
+        if (freelistCount > 0)
+            done = false;
+    }
+    return done;
+}
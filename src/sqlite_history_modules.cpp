@@ -0,0 +1,492 @@
+#include "sqlite_history_modules.hpp"
+#include "block_codec.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    const int COLUMN_TIMESTAMP = 0;
+    const int COLUMN_VALUE = 2;
+    const int COLUMN_CHUNKS_TABLE = 3; // HIDDEN argument of history_chunk_scan
+
+    // Timestamp constraints are passed to xFilter in order, one operator
+    // character each in idxStr
+    char rangeOperator(unsigned char op)
+    {
+        switch (op)
+        {
+        case SQLITE_INDEX_CONSTRAINT_EQ:
+            return '=';
+        case SQLITE_INDEX_CONSTRAINT_GT:
+            return '>';
+        case SQLITE_INDEX_CONSTRAINT_GE:
+            return 'g';
+        case SQLITE_INDEX_CONSTRAINT_LT:
+            return '<';
+        case SQLITE_INDEX_CONSTRAINT_LE:
+            return 'l';
+        }
+        return 0;
+    }
+
+    int bestIndex(sqlite3_index_info *info, bool chunkScan)
+    {
+        int tableConstraint = -1;
+        std::string ops;
+        std::vector<int> rangeConstraints;
+        for (int i = 0; i < info->nConstraint; ++i)
+        {
+            const auto &constraint = info->aConstraint[i];
+            if (!constraint.usable)
+                continue;
+            if (chunkScan && constraint.iColumn == COLUMN_CHUNKS_TABLE && constraint.op == SQLITE_INDEX_CONSTRAINT_EQ)
+            {
+                tableConstraint = i;
+            }
+            else if (constraint.iColumn == COLUMN_TIMESTAMP && rangeOperator(constraint.op))
+            {
+                rangeConstraints.push_back(i);
+                ops += rangeOperator(constraint.op);
+            }
+        }
+        // Without its table argument the scan cannot run; the planner tries another order
+        if (chunkScan && tableConstraint < 0)
+            return SQLITE_CONSTRAINT;
+
+        int argc = 0;
+        if (chunkScan)
+        {
+            info->aConstraintUsage[tableConstraint].argvIndex = ++argc;
+            info->aConstraintUsage[tableConstraint].omit = 1;
+        }
+        // SQLite still checks the range on every row, so bounds that are not
+        // plain numbers can be ignored in xFilter
+        for (int i : rangeConstraints)
+        {
+            info->aConstraintUsage[i].argvIndex = ++argc;
+        }
+
+        bool lower = ops.find_first_of("=>g") != std::string::npos;
+        bool upper = ops.find_first_of("=<l") != std::string::npos;
+        info->estimatedCost = 1000000.0 / (lower ? 100 : 1) / (upper ? 100 : 1);
+        info->idxStr = sqlite3_mprintf("%s", ops.c_str());
+        info->needToFreeIdxStr = 1;
+
+        // The hot tier is scanned in timestamp order; chunks interleave by type
+        if (!chunkScan && info->nOrderBy == 1 && info->aOrderBy[0].iColumn == COLUMN_TIMESTAMP && !info->aOrderBy[0].desc)
+            info->orderByConsumed = 1;
+        return SQLITE_OK;
+    }
+
+    // Narrows [start, end] to the integer timestamps the constraint can match
+    void narrowRange(char op, sqlite3_value *value, int64_t &start, int64_t &end)
+    {
+        int type = sqlite3_value_type(value);
+        if (type != SQLITE_INTEGER && type != SQLITE_FLOAT)
+            return;
+        double bound = sqlite3_value_double(value);
+        if (!(bound > -9.2e18 && bound < 9.2e18))
+            return;
+        int64_t floor = type == SQLITE_INTEGER ? sqlite3_value_int64(value) : static_cast<int64_t>(std::floor(bound));
+        int64_t ceil = type == SQLITE_INTEGER ? floor : static_cast<int64_t>(std::ceil(bound));
+
+        switch (op)
+        {
+        case '=':
+            start = std::max(start, ceil);
+            end = std::min(end, floor);
+            break;
+        case '>':
+            start = std::max(start, floor + 1);
+            break;
+        case 'g':
+            start = std::max(start, ceil);
+            break;
+        case '<':
+            end = std::min(end, ceil - 1);
+            break;
+        case 'l':
+            end = std::min(end, floor);
+            break;
+        }
+    }
+
+    void readRange(const char *ops, sqlite3_value **argv, int64_t &start, int64_t &end)
+    {
+        start = std::numeric_limits<int64_t>::min();
+        end = std::numeric_limits<int64_t>::max();
+        for (int i = 0; ops && ops[i]; ++i)
+        {
+            narrowRange(ops[i], argv[i], start, end);
+        }
+    }
+
+    int fail(sqlite3_vtab *table, const char *message)
+    {
+        sqlite3_free(table->zErrMsg);
+        table->zErrMsg = sqlite3_mprintf("%s", message);
+        return SQLITE_ERROR;
+    }
+
+    template <typename Table>
+    int disconnect(sqlite3_vtab *table)
+    {
+        delete static_cast<Table *>(table);
+        return SQLITE_OK;
+    }
+
+    // history_ram: copies the matching hot tier entries when the scan starts
+    struct HotTable : sqlite3_vtab
+    {
+        const std::atomic<HotTier *> *hotTier;
+    };
+
+    struct HotCursor : sqlite3_vtab_cursor
+    {
+        std::vector<std::unique_ptr<HistoryEntry>> entries;
+        size_t position = 0;
+    };
+
+    int hotConnect(sqlite3 *db, void *aux, int, const char *const *, sqlite3_vtab **result, char **)
+    {
+        int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(timestamp INTEGER, type INTEGER, value)");
+        if (rc != SQLITE_OK)
+            return rc;
+        auto *table = new HotTable();
+        table->hotTier = static_cast<const std::atomic<HotTier *> *>(aux);
+        *result = table;
+        return SQLITE_OK;
+    }
+
+    int hotBestIndex(sqlite3_vtab *, sqlite3_index_info *info)
+    {
+        return bestIndex(info, false);
+    }
+
+    int hotOpen(sqlite3_vtab *, sqlite3_vtab_cursor **result)
+    {
+        *result = new HotCursor();
+        return SQLITE_OK;
+    }
+
+    int hotClose(sqlite3_vtab_cursor *cursor)
+    {
+        delete static_cast<HotCursor *>(cursor);
+        return SQLITE_OK;
+    }
+
+    int hotFilter(sqlite3_vtab_cursor *base, int, const char *ops, int, sqlite3_value **argv)
+    {
+        auto *cursor = static_cast<HotCursor *>(base);
+        cursor->entries.clear();
+        cursor->position = 0;
+
+        int64_t start, end;
+        readRange(ops, argv, start, end);
+        HotTier *tier = static_cast<HotTable *>(base->pVtab)->hotTier->load();
+        if (!tier || start > end)
+            return SQLITE_OK;
+        try
+        {
+            cursor->entries = tier->scanHot(start, end);
+        }
+        catch (const std::exception &e)
+        {
+            return fail(base->pVtab, e.what());
+        }
+        return SQLITE_OK;
+    }
+
+    int hotNext(sqlite3_vtab_cursor *base)
+    {
+        static_cast<HotCursor *>(base)->position++;
+        return SQLITE_OK;
+    }
+
+    int hotEof(sqlite3_vtab_cursor *base)
+    {
+        auto *cursor = static_cast<HotCursor *>(base);
+        return cursor->position >= cursor->entries.size();
+    }
+
+    int hotColumn(sqlite3_vtab_cursor *base, sqlite3_context *context, int column)
+    {
+        auto *cursor = static_cast<HotCursor *>(base);
+        const HistoryEntry *entry = cursor->entries[cursor->position].get();
+        EntryType type = getEntryType(entry);
+
+        if (column == COLUMN_TIMESTAMP)
+        {
+            sqlite3_result_int64(context, entry->getTimestamp());
+        }
+        else if (column != COLUMN_VALUE)
+        {
+            sqlite3_result_int(context, static_cast<int>(type));
+        }
+        else
+        {
+            switch (type)
+            {
+            case EntryType::Double:
+                sqlite3_result_double(context, static_cast<const TypedHistoryEntry<double> *>(entry)->getValue());
+                break;
+            case EntryType::Int:
+                sqlite3_result_int(context, static_cast<const TypedHistoryEntry<int> *>(entry)->getValue());
+                break;
+            case EntryType::Bool:
+                sqlite3_result_int(context, static_cast<const TypedHistoryEntry<bool> *>(entry)->getValue() ? 1 : 0);
+                break;
+            case EntryType::String:
+            {
+                std::string value = static_cast<const TypedHistoryEntry<std::string> *>(entry)->getValue();
+                sqlite3_result_text(context, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+                break;
+            }
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    int hotRowid(sqlite3_vtab_cursor *base, sqlite3_int64 *rowid)
+    {
+        *rowid = static_cast<sqlite3_int64>(static_cast<HotCursor *>(base)->position);
+        return SQLITE_OK;
+    }
+
+    // history_chunk_scan: seeks chunks on start_ts like retrieve() and
+    // decodes one payload at a time
+    struct ChunkTable : sqlite3_vtab
+    {
+        sqlite3 *db;
+    };
+
+    struct ChunkCursor : sqlite3_vtab_cursor
+    {
+        sqlite3_stmt *stmt = nullptr;
+        std::string table;
+        ColumnBlock block;
+        size_t position = 0;
+        int64_t start = 0;
+        int64_t end = 0;
+        int64_t rowid = 0;
+        bool eof = true;
+    };
+
+    // Only names the storage itself creates are accepted, since the argument
+    // ends up in the SELECT
+    bool isChunksTable(const std::string &name)
+    {
+        const std::string base = "history_chunks";
+        if (name == base)
+            return true;
+        if (name.rfind(base + "_p", 0) != 0)
+            return false;
+        std::string start = name.substr(base.size() + 2);
+        if (!start.empty() && start[0] == '-')
+            start.erase(0, 1);
+        return !start.empty() && std::all_of(start.begin(), start.end(), [](char c)
+                                             { return c >= '0' && c <= '9'; });
+    }
+
+    int chunkConnect(sqlite3 *db, void *, int, const char *const *, sqlite3_vtab **result, char **)
+    {
+        int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(timestamp INTEGER, type INTEGER, value, chunks_table HIDDEN)");
+        if (rc != SQLITE_OK)
+            return rc;
+        auto *table = new ChunkTable();
+        table->db = db;
+        *result = table;
+        return SQLITE_OK;
+    }
+
+    int chunkBestIndex(sqlite3_vtab *, sqlite3_index_info *info)
+    {
+        return bestIndex(info, true);
+    }
+
+    int chunkOpen(sqlite3_vtab *, sqlite3_vtab_cursor **result)
+    {
+        *result = new ChunkCursor();
+        return SQLITE_OK;
+    }
+
+    int chunkClose(sqlite3_vtab_cursor *base)
+    {
+        auto *cursor = static_cast<ChunkCursor *>(base);
+        sqlite3_finalize(cursor->stmt);
+        delete cursor;
+        return SQLITE_OK;
+    }
+
+    // Moves to the first sample at or after position that is in range,
+    // decoding further chunks as needed
+    void settle(ChunkCursor *cursor)
+    {
+        while (cursor->position >= cursor->block.size() || cursor->block.timestamps[cursor->position] > cursor->end)
+        {
+            if (sqlite3_step(cursor->stmt) != SQLITE_ROW)
+            {
+                cursor->eof = true;
+                return;
+            }
+            cursor->block = BlockCodec::decode(static_cast<const uint8_t *>(sqlite3_column_blob(cursor->stmt, 0)),
+                                               sqlite3_column_bytes(cursor->stmt, 0));
+            cursor->position = std::lower_bound(cursor->block.timestamps.begin(), cursor->block.timestamps.end(), cursor->start) -
+                               cursor->block.timestamps.begin();
+        }
+    }
+
+    int chunkFilter(sqlite3_vtab_cursor *base, int, const char *ops, int, sqlite3_value **argv)
+    {
+        auto *cursor = static_cast<ChunkCursor *>(base);
+        sqlite3 *db = static_cast<ChunkTable *>(base->pVtab)->db;
+        sqlite3_finalize(cursor->stmt);
+        cursor->stmt = nullptr;
+        cursor->block.clear();
+        cursor->position = 0;
+        cursor->rowid = 0;
+        cursor->eof = true;
+
+        const char *name = reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+        if (!name || !isChunksTable(name))
+            return fail(base->pVtab, ("history_chunk_scan: not a chunks table: " + std::string(name ? name : "NULL")).c_str());
+        cursor->table = name;
+        readRange(ops, argv + 1, cursor->start, cursor->end);
+        if (cursor->start > cursor->end)
+            return SQLITE_OK;
+
+        // start_ts is the clustering key; a chunk starting more than the
+        // table's widest chunk span before the range cannot overlap it
+        int64_t chunkSpan = 0;
+        sqlite3_stmt *spanStmt;
+        if (sqlite3_prepare_v2(db, "SELECT value FROM history_meta WHERE key = 'max_chunk_span:' || ?", -1, &spanStmt, nullptr) != SQLITE_OK)
+            return fail(base->pVtab, sqlite3_errmsg(db));
+        sqlite3_bind_text(spanStmt, 1, cursor->table.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(spanStmt) == SQLITE_ROW)
+            chunkSpan = sqlite3_column_int64(spanStmt, 0);
+        sqlite3_finalize(spanStmt);
+
+        std::string sql = "SELECT payload FROM \"" + cursor->table +
+                          "\" WHERE start_ts BETWEEN ?1 - ?3 AND ?2 AND end_ts >= ?1";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &cursor->stmt, nullptr) != SQLITE_OK)
+            return fail(base->pVtab, sqlite3_errmsg(db));
+        sqlite3_bind_int64(cursor->stmt, 1, cursor->start);
+        sqlite3_bind_int64(cursor->stmt, 2, cursor->end);
+        sqlite3_bind_int64(cursor->stmt, 3, chunkSpan);
+
+        cursor->eof = false;
+        try
+        {
+            settle(cursor);
+        }
+        catch (const std::exception &e)
+        {
+            return fail(base->pVtab, e.what());
+        }
+        return SQLITE_OK;
+    }
+
+    int chunkNext(sqlite3_vtab_cursor *base)
+    {
+        auto *cursor = static_cast<ChunkCursor *>(base);
+        cursor->position++;
+        cursor->rowid++;
+        try
+        {
+            settle(cursor);
+        }
+        catch (const std::exception &e)
+        {
+            return fail(base->pVtab, e.what());
+        }
+        return SQLITE_OK;
+    }
+
+    int chunkEof(sqlite3_vtab_cursor *base)
+    {
+        return static_cast<ChunkCursor *>(base)->eof;
+    }
+
+    int chunkColumn(sqlite3_vtab_cursor *base, sqlite3_context *context, int column)
+    {
+        auto *cursor = static_cast<ChunkCursor *>(base);
+        const ColumnBlock &block = cursor->block;
+        size_t i = cursor->position;
+
+        if (column == COLUMN_TIMESTAMP)
+        {
+            sqlite3_result_int64(context, block.timestamps[i]);
+        }
+        else if (column == COLUMN_CHUNKS_TABLE)
+        {
+            sqlite3_result_text(context, cursor->table.data(), static_cast<int>(cursor->table.size()), SQLITE_TRANSIENT);
+        }
+        else if (column != COLUMN_VALUE)
+        {
+            sqlite3_result_int(context, static_cast<int>(block.type));
+        }
+        else
+        {
+            switch (block.type)
+            {
+            case EntryType::Double:
+                sqlite3_result_double(context, block.doubles[i]);
+                break;
+            case EntryType::Int:
+            case EntryType::Bool:
+                sqlite3_result_int64(context, block.integers[i]);
+                break;
+            case EntryType::String:
+                sqlite3_result_text(context, block.strings[i].data(), static_cast<int>(block.strings[i].size()), SQLITE_TRANSIENT);
+                break;
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    int chunkRowid(sqlite3_vtab_cursor *base, sqlite3_int64 *rowid)
+    {
+        *rowid = static_cast<ChunkCursor *>(base)->rowid;
+        return SQLITE_OK;
+    }
+
+    template <typename Table>
+    sqlite3_module makeModule(decltype(sqlite3_module::xConnect) connect, decltype(sqlite3_module::xBestIndex) bestIndex,
+                              decltype(sqlite3_module::xOpen) open, decltype(sqlite3_module::xClose) close,
+                              decltype(sqlite3_module::xFilter) filter, decltype(sqlite3_module::xNext) next,
+                              decltype(sqlite3_module::xEof) eof, decltype(sqlite3_module::xColumn) column,
+                              decltype(sqlite3_module::xRowid) rowid)
+    {
+        // Eponymous-only: no xCreate, so CREATE VIRTUAL TABLE is refused
+        sqlite3_module module{};
+        module.xConnect = connect;
+        module.xBestIndex = bestIndex;
+        module.xDisconnect = disconnect<Table>;
+        module.xDestroy = disconnect<Table>;
+        module.xOpen = open;
+        module.xClose = close;
+        module.xFilter = filter;
+        module.xNext = next;
+        module.xEof = eof;
+        module.xColumn = column;
+        module.xRowid = rowid;
+        return module;
+    }
+
+    const sqlite3_module HOT_MODULE = makeModule<HotTable>(hotConnect, hotBestIndex, hotOpen, hotClose, hotFilter, hotNext,
+                                                           hotEof, hotColumn, hotRowid);
+    const sqlite3_module CHUNK_SCAN_MODULE = makeModule<ChunkTable>(chunkConnect, chunkBestIndex, chunkOpen, chunkClose, chunkFilter,
+                                                                    chunkNext, chunkEof, chunkColumn, chunkRowid);
+}
+
+void SQLiteHistoryModules::registerModules(sqlite3 *db, const std::atomic<HotTier *> *hotTier)
+{
+    if (sqlite3_create_module_v2(db, "history_ram", &HOT_MODULE, const_cast<std::atomic<HotTier *> *>(hotTier), nullptr) != SQLITE_OK ||
+        sqlite3_create_module_v2(db, "history_chunk_scan", &CHUNK_SCAN_MODULE, nullptr, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to register history modules: " + std::string(sqlite3_errmsg(db)));
+    }
+}
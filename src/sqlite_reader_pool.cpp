@@ -0,0 +1,158 @@
+#include "sqlite_reader_pool.hpp"
+#include <stdexcept>
+#include <algorithm>
+
+SQLiteReader::SQLiteReader(const std::string &dbPath)
+{
+    // Each reader is used by one thread at a time, so SQLite's own mutex is not needed
+    if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK)
+    {
+        std::string error = "Can't open reader connection: " + std::string(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        throw std::runtime_error(error);
+    }
+    sqlite3_busy_timeout(db, 5000);
+    sqlite3_exec(db, "PRAGMA temp_store = MEMORY;", nullptr, nullptr, nullptr);
+}
+
+SQLiteReader::~SQLiteReader()
+{
+    finalizeStatements();
+    sqlite3_close(db);
+}
+
+void SQLiteReader::finalizeStatements()
+{
+    for (auto &[sql, stmt] : statements)
+    {
+        sqlite3_finalize(stmt);
+    }
+    statements.clear();
+}
+
+void SQLiteReader::beginSnapshot()
+{
+    // Partition tables come and go, so the cache is bounded
+    if (statements.size() > MAX_CACHED_STATEMENTS)
+        finalizeStatements();
+
+    if (sqlite3_exec(db, "BEGIN", nullptr, nullptr, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to begin read transaction: " + std::string(sqlite3_errmsg(db)));
+    }
+}
+
+void SQLiteReader::endSnapshot()
+{
+    if (!sqlite3_get_autocommit(db))
+        sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+}
+
+sqlite3_stmt *SQLiteReader::prepare(const std::string &sql)
+{
+    auto it = statements.find(sql);
+    if (it != statements.end())
+        return it->second;
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v3(db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK)
+    {
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    }
+    statements[sql] = stmt;
+    return stmt;
+}
+
+int64_t SQLiteReader::queryInt(const std::string &sql, int64_t defaultValue)
+{
+    sqlite3_stmt *stmt = prepare(sql);
+    int64_t value = defaultValue;
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        value = sqlite3_column_int64(stmt, 0);
+    sqlite3_reset(stmt);
+    return value;
+}
+
+SQLiteReaderPool::Lease::~Lease()
+{
+    if (reader)
+        pool->release(std::move(reader));
+}
+
+SQLiteReaderPool::SQLiteReaderPool(const std::string &dbPath, size_t maxReaders)
+    : dbPath(dbPath), maxReaders(std::max<size_t>(1, maxReaders)), openReaders(0)
+{
+}
+
+SQLiteReaderPool::Lease SQLiteReaderPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this]
+                   { return !idle.empty() || openReaders < maxReaders; });
+
+    if (!idle.empty())
+    {
+        std::unique_ptr<SQLiteReader> reader = std::move(idle.back());
+        idle.pop_back();
+        return Lease(this, std::move(reader));
+    }
+
+    // Open outside the lock; the slot is reserved first
+    openReaders++;
+    lock.unlock();
+    try
+    {
+        auto reader = std::make_unique<SQLiteReader>(dbPath);
+        if (connectionSetup)
+            connectionSetup(reader->getHandle());
+        return Lease(this, std::move(reader));
+    }
+    catch (...)
+    {
+        lock.lock();
+        openReaders--;
+        available.notify_one();
+        throw;
+    }
+}
+
+void SQLiteReaderPool::release(std::unique_ptr<SQLiteReader> reader)
+{
+    // A query that threw may have left its snapshot open
+    reader->endSnapshot();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (openReaders > maxReaders)
+    {
+        openReaders--;
+    }
+    else
+    {
+        idle.push_back(std::move(reader));
+    }
+    available.notify_one();
+}
+
+void SQLiteReaderPool::setMaxReaders(size_t readers)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    maxReaders = std::max<size_t>(1, readers);
+    while (openReaders > maxReaders && !idle.empty())
+    {
+        idle.pop_back();
+        openReaders--;
+    }
+    available.notify_all();
+}
+
+size_t SQLiteReaderPool::getMaxReaders() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return maxReaders;
+}
+
+size_t SQLiteReaderPool::getOpenReaders()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return openReaders;
+}
@@ -0,0 +1,583 @@
+#include "tiered_disk_storage.hpp"
+#include "segment_writer.hpp"
+#include "merge_log.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+    const std::string ARCHIVE_PREFIX = "archive_";
+    const std::string ARCHIVE_EXTENSION = ".arc";
+    const std::time_t NOTHING_ARCHIVED = std::numeric_limits<std::time_t>::min();
+
+    // Timestamp, type and exact value: equal keys are interchangeable samples
+    std::string sampleKey(const HistoryEntry &entry)
+    {
+        std::ostringstream key;
+        EntryType type = getEntryType(&entry);
+        key << entry.getTimestamp() << ' ' << static_cast<int>(type) << ' ';
+        switch (type)
+        {
+        case EntryType::Double:
+            key << std::hexfloat << static_cast<const TypedHistoryEntry<double> &>(entry).getValue();
+            break;
+        case EntryType::Int:
+            key << static_cast<const TypedHistoryEntry<int> &>(entry).getValue();
+            break;
+        case EntryType::Bool:
+            key << static_cast<const TypedHistoryEntry<bool> &>(entry).getValue();
+            break;
+        case EntryType::String:
+            key << static_cast<const TypedHistoryEntry<std::string> &>(entry).getValue();
+            break;
+        }
+        return key.str();
+    }
+}
+
+TieredDiskStorage::TieredDiskStorage(const std::string &dbPath, const std::string &archiveDirectory)
+    : hot(dbPath), archiveDirectory(archiveDirectory), watermark(NOTHING_ARCHIVED), nextArchiveId(1),
+      windowOpen(false), windowStart(0), windowEnd(0), windowTouched(false), archiveBytes(0), archivedEntryCount(0), migrationAge(DEFAULT_MIGRATION_AGE),
+      migrationBatchSize(DEFAULT_MIGRATION_BATCH), migrationRate(0), stopping(false)
+{
+    std::filesystem::create_directories(archiveDirectory);
+    MergeLog::recover(archiveDirectory, ARCHIVE_EXTENSION);
+
+    std::vector<std::pair<uint64_t, std::string>> found;
+    for (const auto &file : std::filesystem::directory_iterator(archiveDirectory))
+    {
+        std::string name = file.path().filename().string();
+        if (file.path().extension() == ".tmp")
+        {
+            std::filesystem::remove(file.path()); // A migration step that never completed
+            continue;
+        }
+        if (name.rfind(ARCHIVE_PREFIX, 0) != 0 || file.path().extension() != ARCHIVE_EXTENSION)
+            continue;
+        try
+        {
+            found.emplace_back(std::stoull(name.substr(ARCHIVE_PREFIX.size())), file.path().string());
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    // Rows archived before a crash may still be in SQLite; the watermark hides
+    // them and the next migration step expires them
+    for (const auto &[id, path] : found)
+    {
+        nextArchiveId = std::max(nextArchiveId.load(), id + 1);
+        try
+        {
+            auto archive = std::make_shared<const ArchiveFile>(path);
+            watermark = std::max(watermark, archive->getArchivedThrough());
+            archiveBytes += archive->getSize();
+            archivedEntryCount += archive->getEntryCount();
+            archives.push_back(std::move(archive));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping archive: " << e.what() << std::endl;
+        }
+    }
+    if (!archives.empty())
+    {
+        std::cout << "Opened " << archives.size() << " archive files (" << archivedEntryCount << " entries) in "
+                  << archiveDirectory << ", archived through " << watermark << std::endl;
+    }
+
+    migrator = std::thread(&TieredDiskStorage::runMigrator, this);
+}
+
+TieredDiskStorage::~TieredDiskStorage()
+{
+    {
+        std::lock_guard<std::mutex> lock(migratorMutex);
+        stopping = true;
+    }
+    migratorWake.notify_one();
+    migrator.join();
+}
+
+std::string TieredDiskStorage::archivePath(uint64_t id) const
+{
+    std::string number = std::to_string(id);
+    return (std::filesystem::path(archiveDirectory) /
+            (ARCHIVE_PREFIX + std::string(number.size() < 12 ? 12 - number.size() : 0, '0') + number + ARCHIVE_EXTENSION))
+        .string();
+}
+
+void TieredDiskStorage::setMigrationBatchSize(size_t samples)
+{
+    if (samples == 0)
+        throw std::runtime_error("Migration batch size must be positive");
+    migrationBatchSize = samples;
+}
+
+void TieredDiskStorage::flush(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (entries.empty())
+        return;
+    {
+        std::shared_lock<std::shared_mutex> lock(tierMutex);
+        if (std::none_of(entries.begin(), entries.end(), [this](const std::unique_ptr<HistoryEntry> &entry)
+                         { return entry->getTimestamp() <= watermark; }))
+        {
+            noteWindowRows(entries);
+            hot.flush(entries);
+            return;
+        }
+    }
+
+    // Late samples: the watermark must not move between the split and the writes
+    std::unique_lock<std::shared_mutex> lock(tierMutex);
+    std::vector<const HistoryEntry *> late;
+    std::vector<std::unique_ptr<HistoryEntry>> recent;
+    for (const auto &entry : entries)
+    {
+        if (entry->getTimestamp() <= watermark)
+            late.push_back(entry.get());
+        else
+            recent.push_back(entry->clone());
+    }
+    std::shared_ptr<const ArchiveFile> archive;
+    if (!late.empty())
+    {
+        std::stable_sort(late.begin(), late.end(), [](const HistoryEntry *a, const HistoryEntry *b)
+                         { return a->getTimestamp() < b->getTimestamp(); });
+        archive = writeArchive(late, watermark);
+    }
+    // Nothing is visible until both writes succeed, so a retried batch isn't served twice
+    if (!recent.empty())
+    {
+        try
+        {
+            noteWindowRows(recent);
+            hot.flush(recent);
+        }
+        catch (...)
+        {
+            if (archive)
+                archive->retire();
+            throw;
+        }
+    }
+    if (archive)
+    {
+        installArchive(archive);
+        stats.samplesLate += late.size();
+    }
+}
+
+void TieredDiskStorage::noteWindowRows(const std::vector<std::unique_ptr<HistoryEntry>> &entries)
+{
+    if (windowOpen && std::any_of(entries.begin(), entries.end(), [this](const std::unique_ptr<HistoryEntry> &entry)
+                                  { return entry->getTimestamp() >= windowStart && entry->getTimestamp() <= windowEnd; }))
+        windowTouched = true;
+}
+
+std::shared_ptr<const ArchiveFile> TieredDiskStorage::writeArchive(const std::vector<const HistoryEntry *> &sorted,
+                                                                   std::time_t archivedThrough)
+{
+    std::string path = archivePath(nextArchiveId++);
+    SegmentWriter::writeFile(path, ArchiveFile::encode(sorted, archivedThrough));
+    return std::make_shared<const ArchiveFile>(path);
+}
+
+void TieredDiskStorage::installArchive(const std::shared_ptr<const ArchiveFile> &archive)
+{
+    archives.push_back(archive);
+    watermark = std::max(watermark, archive->getArchivedThrough());
+
+    archiveBytes += archive->getSize();
+    archivedEntryCount += archive->getEntryCount();
+    stats.archiveFilesWritten++;
+    stats.bytesWritten += archive->getSize();
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> TieredDiskStorage::findArrivals(
+    std::time_t from, std::time_t through, const std::vector<std::unique_ptr<HistoryEntry>> &read)
+{
+    std::unordered_map<std::string, size_t> seen;
+    for (const auto &entry : read)
+    {
+        seen[sampleKey(*entry)]++;
+    }
+    std::vector<std::unique_ptr<HistoryEntry>> arrivals;
+    auto cursor = hot.openCursor(from + 1, through);
+    while (auto entry = cursor->next())
+    {
+        auto it = seen.find(sampleKey(*entry));
+        if (it != seen.end() && it->second > 0)
+            it->second--;
+        else
+            arrivals.push_back(std::move(entry));
+    }
+    return arrivals;
+}
+
+std::vector<std::shared_ptr<const ArchiveFile>> TieredDiskStorage::pickArchiveMerge() const
+{
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    std::vector<std::shared_ptr<const ArchiveFile>> small;
+    for (const auto &archive : archives)
+    {
+        if (archive->getEntryCount() * 4 >= migrationBatchSize)
+            continue;
+        small.push_back(archive);
+        if (small.size() == ARCHIVE_MERGE_FANIN)
+            return small;
+    }
+    return {};
+}
+
+void TieredDiskStorage::mergeArchives(const std::vector<std::shared_ptr<const ArchiveFile>> &inputs, size_t &bytesMoved)
+{
+    // Archives are immutable and clear() waits for migrateMutex, so no lock is needed until the swap
+    std::vector<std::unique_ptr<HistoryCursor>> cursors;
+    std::vector<std::string> inputPaths;
+    std::time_t archivedThrough = NOTHING_ARCHIVED;
+    for (const auto &input : inputs)
+    {
+        cursors.push_back(ArchiveFile::openCursor(input, input->getMinTimestamp(), input->getMaxTimestamp()));
+        inputPaths.push_back(input->getPath());
+        archivedThrough = std::max(archivedThrough, input->getArchivedThrough());
+    }
+    MergeCursor merged(std::move(cursors));
+    std::vector<std::unique_ptr<HistoryEntry>> entries;
+    while (auto entry = merged.next())
+    {
+        entries.push_back(std::move(entry));
+    }
+    std::vector<const HistoryEntry *> sorted;
+    sorted.reserve(entries.size());
+    for (const auto &entry : entries)
+    {
+        sorted.push_back(entry.get());
+    }
+
+    std::string path = archivePath(nextArchiveId++);
+    std::shared_ptr<const ArchiveFile> archive;
+    try
+    {
+        MergeLog::write(path, inputPaths);
+        // The inputs' own mark, so the merge never moves the watermark
+        SegmentWriter::writeFile(path, ArchiveFile::encode(sorted, archivedThrough));
+        archive = std::make_shared<const ArchiveFile>(path);
+    }
+    catch (...)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+        MergeLog::finish(path);
+        throw;
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> lock(tierMutex);
+        archives.erase(std::remove_if(archives.begin(), archives.end(), [&inputs](const auto &candidate)
+                                      { return std::find(inputs.begin(), inputs.end(), candidate) != inputs.end(); }),
+                       archives.end());
+        archives.push_back(archive);
+        for (const auto &input : inputs)
+        {
+            archiveBytes -= input->getSize();
+        }
+        archiveBytes += archive->getSize();
+        stats.archiveFilesWritten++;
+        stats.bytesWritten += archive->getSize();
+    }
+    for (const auto &input : inputs)
+    {
+        input->retire();
+        bytesMoved += input->getSize();
+    }
+    bytesMoved += archive->getSize();
+    MergeLog::finish(path);
+}
+
+std::vector<std::shared_ptr<const ArchiveFile>> TieredDiskStorage::archivesInRange(std::time_t start, std::time_t end) const
+{
+    std::vector<std::shared_ptr<const ArchiveFile>> overlapping;
+    for (const auto &archive : archives)
+    {
+        if (archive->overlaps(start, end))
+            overlapping.push_back(archive);
+    }
+    return overlapping;
+}
+
+std::vector<std::unique_ptr<HistoryEntry>> TieredDiskStorage::retrieve(std::time_t start, std::time_t end)
+{
+    // Held until SQLite has answered, so its rows can't be expired underneath it
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    std::future<std::vector<std::unique_ptr<HistoryEntry>>> recent;
+    if (end > watermark)
+        recent = hot.retrieveAsync(std::max(start, watermark + 1), end);
+
+    std::vector<std::unique_ptr<HistoryEntry>> results;
+    if (start <= watermark)
+    {
+        std::time_t archiveEnd = std::min(end, watermark);
+        for (const auto &archive : archivesInRange(start, archiveEnd))
+        {
+            auto cursor = ArchiveFile::openCursor(archive, start, archiveEnd);
+            while (auto entry = cursor->next())
+            {
+                results.push_back(std::move(entry));
+            }
+        }
+    }
+
+    if (recent.valid())
+    {
+        auto hotResults = recent.get();
+        results.insert(results.end(), std::make_move_iterator(hotResults.begin()), std::make_move_iterator(hotResults.end()));
+    }
+    return results;
+}
+
+std::unique_ptr<HistoryCursor> TieredDiskStorage::openCursor(std::time_t start, std::time_t end)
+{
+    // The SQLite cursor pins its snapshot before the lock is released
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    std::vector<std::unique_ptr<HistoryCursor>> inputs;
+    if (start <= watermark)
+    {
+        std::time_t archiveEnd = std::min(end, watermark);
+        for (const auto &archive : archivesInRange(start, archiveEnd))
+        {
+            inputs.push_back(ArchiveFile::openCursor(archive, start, archiveEnd));
+        }
+    }
+    if (end > watermark)
+        inputs.push_back(hot.openCursor(std::max(start, watermark + 1), end));
+    return std::make_unique<MergeCursor>(std::move(inputs));
+}
+
+Aggregate TieredDiskStorage::aggregate(std::time_t start, std::time_t end)
+{
+    Aggregate result;
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    if (end > watermark)
+        result = hot.aggregate(std::max(start, watermark + 1), end);
+    if (start <= watermark)
+    {
+        std::time_t archiveEnd = std::min(end, watermark);
+        for (const auto &archive : archivesInRange(start, archiveEnd))
+        {
+            archive->aggregate(start, archiveEnd, result);
+        }
+    }
+    return result;
+}
+
+bool TieredDiskStorage::migrate()
+{
+    size_t bytesMoved = 0;
+    return migrateStep(bytesMoved);
+}
+
+bool TieredDiskStorage::migrateStep(size_t &bytesMoved)
+{
+    std::lock_guard<std::mutex> step(migrateMutex);
+    bytesMoved = 0;
+    auto small = pickArchiveMerge();
+    if (!small.empty())
+    {
+        mergeArchives(small, bytesMoved);
+        small = pickArchiveMerge();
+    }
+    std::time_t age = migrationAge;
+    if (age <= 0)
+        return small.empty();
+    std::time_t cutoff = std::time(nullptr) - age;
+    bool done = true;
+
+    // Only migration steps raise the watermark, so it holds still until this
+    // one installs. Opening the window exclusively lets flushes that already
+    // passed their watermark check finish first; later ones flag the window.
+    std::time_t from;
+    {
+        std::unique_lock<std::shared_mutex> lock(tierMutex);
+        from = watermark;
+        windowOpen = cutoff > watermark;
+        windowStart = watermark + 1;
+        windowEnd = cutoff;
+        windowTouched = false;
+    }
+
+    std::vector<std::unique_ptr<HistoryEntry>> batch;
+    std::shared_ptr<const ArchiveFile> archive;
+    std::time_t through = cutoff;
+    size_t bytesRead = 0;
+    try
+    {
+        if (cutoff > from)
+        {
+            // Read, encode and sync without the lock so flushes keep going.
+            // A batch ends between distinct timestamps so no timestamp
+            // straddles the watermark.
+            size_t limit = migrationBatchSize;
+            bool more;
+            {
+                auto cursor = hot.openCursor(from + 1, cutoff);
+                auto entry = cursor->next();
+                while (entry && (batch.size() < limit || entry->getTimestamp() == batch.back()->getTimestamp()))
+                {
+                    batch.push_back(std::move(entry));
+                    entry = cursor->next();
+                }
+                more = entry != nullptr;
+            }
+            if (!batch.empty())
+            {
+                std::vector<const HistoryEntry *> sorted;
+                sorted.reserve(batch.size());
+                for (const auto &entry : batch)
+                {
+                    sorted.push_back(entry.get());
+                    bytesRead += entry->getSize();
+                }
+                through = more ? batch.back()->getTimestamp() : cutoff;
+                archive = writeArchive(sorted, through);
+                done = !more;
+            }
+        }
+    }
+    catch (...)
+    {
+        std::unique_lock<std::shared_mutex> lock(tierMutex);
+        windowOpen = false;
+        throw;
+    }
+
+    std::time_t archivedThrough;
+    {
+        std::unique_lock<std::shared_mutex> lock(tierMutex);
+        windowOpen = false;
+        if (archive)
+        {
+            // Rows flushed into the batch's range after the read would end
+            // up behind the watermark; they get an archive of their own
+            size_t arrived = 0;
+            try
+            {
+                if (windowTouched)
+                {
+                    auto arrivals = findArrivals(from, through, batch);
+                    if (!arrivals.empty())
+                    {
+                        std::vector<const HistoryEntry *> sorted;
+                        for (const auto &entry : arrivals)
+                        {
+                            sorted.push_back(entry.get());
+                            bytesRead += entry->getSize();
+                        }
+                        auto extra = writeArchive(sorted, through);
+                        installArchive(extra);
+                        bytesMoved += extra->getSize();
+                        arrived = arrivals.size();
+                    }
+                }
+            }
+            catch (...)
+            {
+                // Left on disk, the archive would raise the watermark on the next open
+                std::error_code ignored;
+                std::filesystem::remove(archive->getPath(), ignored);
+                throw;
+            }
+            installArchive(archive);
+            stats.samplesMigrated += batch.size() + arrived;
+            stats.bytesRead += bytesRead;
+            bytesMoved += bytesRead + archive->getSize();
+        }
+        archivedThrough = watermark;
+        stats.migrationSteps++;
+    }
+
+    // Readers still on the old watermark pinned their snapshots before it moved
+    if (archivedThrough != NOTHING_ARCHIVED && !hot.expireBefore(archivedThrough + 1, migrationBatchSize))
+        done = false;
+    return done && small.empty();
+}
+
+void TieredDiskStorage::runMigrator()
+{
+    std::unique_lock<std::mutex> lock(migratorMutex);
+    while (!stopping)
+    {
+        migratorWake.wait_for(lock, MIGRATION_POLL_INTERVAL, [this]
+                              { return stopping; });
+
+        // Steps run back to back until the backlog is gone, each followed by
+        // a pause long enough to hold the configured rate
+        bool done = false;
+        while (!done && !stopping)
+        {
+            lock.unlock();
+            auto started = std::chrono::steady_clock::now();
+            size_t bytesMoved = 0;
+            try
+            {
+                done = migrateStep(bytesMoved);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Migration step failed: " << e.what() << std::endl;
+                done = true; // Retried after the next poll interval
+            }
+            lock.lock();
+
+            size_t rate = migrationRate;
+            if (rate > 0 && bytesMoved > 0)
+            {
+                auto due = started + std::chrono::microseconds(static_cast<int64_t>(bytesMoved * 1000000.0 / rate));
+                migratorWake.wait_until(lock, due, [this]
+                                        { return stopping; });
+            }
+        }
+    }
+}
+
+std::time_t TieredDiskStorage::getWatermark() const
+{
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    return watermark;
+}
+
+size_t TieredDiskStorage::getArchiveFileCount() const
+{
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    return archives.size();
+}
+
+TieredDiskStorage::MigrationStats TieredDiskStorage::getMigrationStats() const
+{
+    std::shared_lock<std::shared_mutex> lock(tierMutex);
+    return stats;
+}
+
+void TieredDiskStorage::clear()
+{
+    std::lock_guard<std::mutex> step(migrateMutex);
+    std::unique_lock<std::shared_mutex> lock(tierMutex);
+    hot.clear();
+    for (const auto &archive : archives)
+    {
+        archive->retire();
+    }
+    archives.clear();
+    watermark = NOTHING_ARCHIVED;
+    archiveBytes = 0;
+    archivedEntryCount = 0;
+    std::cout << "Archive cleared." << std::endl;
+}